@@ -157,6 +157,10 @@ SOURCE=.\arb.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\arbmpn.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\basicio.cpp
 # End Source File
 # Begin Source File
@@ -165,6 +169,10 @@ SOURCE=.\bitmap.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\bytevector.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\check_objects.cpp
 # End Source File
 # Begin Source File
@@ -213,6 +221,10 @@ SOURCE=.\gctaskfarm.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\heapdump.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\interpret.cpp
 
 !IF  "$(CFG)" == "PolyLib - Win32 Release"
@@ -260,6 +272,10 @@ SOURCE=.\pecoffexport.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\perfmap.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\pexport.cpp
 # End Source File
 # Begin Source File
@@ -292,6 +308,10 @@ SOURCE=.\realconv.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\realdigits.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\reals.cpp
 # End Source File
 # Begin Source File
@@ -300,6 +320,10 @@ SOURCE=.\rts_module.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\rtstrace.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\run_time.cpp
 # End Source File
 # Begin Source File
@@ -328,6 +352,10 @@ SOURCE=.\statistics.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\statserver.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\timing.cpp
 # End Source File
 # Begin Source File
@@ -406,6 +434,10 @@ SOURCE=.\arb.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\arbmpn.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\basicio.h
 # End Source File
 # Begin Source File
@@ -414,6 +446,10 @@ SOURCE=.\bitmap.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\bytevector.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\check_objects.h
 # End Source File
 # Begin Source File
@@ -454,6 +490,10 @@ SOURCE=.\globals.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\heapdump.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\int_opcodes.h
 # End Source File
 # Begin Source File
@@ -502,6 +542,10 @@ SOURCE=.\pecoffexport.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\perfmap.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\pexport.h
 # End Source File
 # Begin Source File
@@ -542,6 +586,10 @@ SOURCE=.\realconv.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\realdigits.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\reals.h
 # End Source File
 # Begin Source File
@@ -554,6 +602,10 @@ SOURCE=.\rts_module.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\rtstrace.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\run_time.h
 # End Source File
 # Begin Source File
@@ -582,6 +634,10 @@ SOURCE=.\statistics.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\statserver.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\sys.h
 # End Source File
 # Begin Source File
@@ -34,14 +34,12 @@ pointed to.  The sign of long-form integers is coded in one of the flag bits.
 Short integers are signed quantities, and can be directly
 manipulated by the relevant instructions, but if overflow occurs then the full
 long versions of the operations will need to be called.
-Long-form integers are held as vectors of bytes (i.e. unsigned char)
-low-order byte first. It is assumed that a ``byte'' will hold an 8-bit
-quantity and a ``long'' at least two ``bytes''. It is essential that unsigned
-values are used.
+Long-form integers are held as vectors of limbs, each a machine word,
+low-order limb first, and the arithmetic on them is done with the GMP
+``mpn'' functions.  When GMP is not available arbmpn.cpp provides
+versions of the functions used here.
 Integers are always stored in the least possible number of words, and
 will be shortened to the short-form when possible.
-
-Thanks are due to D. Knuth for the long division algorithm.
 */
 
 #ifdef HAVE_CONFIG_H
@@ -91,6 +89,12 @@ Thanks are due to D. Knuth for the long division algorithm.
 #include "save_vec.h"
 #include "processes.h"
 #include "memmgr.h"
+#include "polystring.h"
+#ifndef USE_GMP
+// Functions that need a work area throw MemoryException if it cannot be
+// allocated.  It is caught here and Size is raised.
+#include "arbmpn.h"
+#endif
 
 // Number of bits in a Poly word.  N.B.  This is not necessarily the same as SIZEOF_VOIDP.
 #define BITS_PER_POLYWORD (SIZEOF_VOIDP*8)
@@ -102,7 +106,6 @@ Thanks are due to D. Knuth for the long division algorithm.
 #endif
 #endif
 
-#ifdef USE_GMP
 #define DEREFLIMBHANDLE(_x)      ((mp_limb_t *)DEREFHANDLE(_x))
 
 // Returns the length of the argument with trailing zeros removed.
@@ -114,23 +117,6 @@ static mp_size_t numLimbs(PolyWord x)
     return lu;
 }
 
-#else
-// Returns the length of the argument with trailing zeros removed.
-
-static POLYUNSIGNED get_length(PolyWord x)
-{
-    byte *u = (byte *)x.AsObjPtr();
-    POLYUNSIGNED  lu  = OBJECT_LENGTH(x)*sizeof(PolyWord);
-
-    for( ; (lu > 0) && (u[lu-1] == 0); lu--)
-    {
-        /* do nothing */
-    }
-
-    return lu;
-}
-#endif
-
 POLYUNSIGNED get_C_ulong(TaskData *taskData, PolyWord number)
 {
     if ( IS_INT(number) )
@@ -142,7 +128,6 @@ POLYUNSIGNED get_C_ulong(TaskData *taskData, PolyWord number)
     else
     {
         if (OBJ_IS_NEGATIVE(GetLengthWord(number))) raise_exception0(taskData, EXC_size );
-#ifdef USE_GMP
         unsigned length = numLimbs(number);
         if (length > 1) raise_exception0(taskData, EXC_size);
         mp_limb_t first = *(mp_limb_t*)number.AsCodePtr();
@@ -151,14 +136,6 @@ POLYUNSIGNED get_C_ulong(TaskData *taskData, PolyWord number)
             raise_exception0(taskData, EXC_size);
 #endif
         return first;
-#else
-        byte *ptr = number.AsCodePtr();
-        POLYUNSIGNED length = get_length(number);
-        if (length > sizeof(PolyWord) ) raise_exception0(taskData, EXC_size);
-        POLYSIGNED c = 0;
-        while ( length-- ) c = (c << 8) | ((byte *) ptr)[length];
-        return c;
-#endif
     }
 }
 
@@ -172,22 +149,9 @@ POLYSIGNED get_C_long(TaskData *taskData, PolyWord number)
     else
     {
         int sign   = OBJ_IS_NEGATIVE(GetLengthWord(number)) ? -1 : 0;
-#ifdef USE_GMP
         unsigned length = numLimbs(number);
         if (length > 1) raise_exception0(taskData, EXC_size);
         mp_limb_t c = *(mp_limb_t*)number.AsCodePtr();
-#else
-        POLYUNSIGNED length = get_length(number);
-        POLYUNSIGNED c = 0;
-        byte *ptr = number.AsCodePtr();
-
-        if ( length > sizeof(PolyWord) ) raise_exception0(taskData, EXC_size );
-
-        while ( length-- )
-        {
-            c = (c << 8) | ptr[length];
-        }
-#endif
         if ( sign == 0 && c <  MAX_INT_PLUS1) return   (POLYSIGNED)c;
         if ( sign != 0 && c <= MAX_INT_PLUS1) return -((POLYSIGNED)c);
 
@@ -234,12 +198,8 @@ void get_C_pair(TaskData *taskData, PolyWord number, unsigned long *pHi, unsigne
     }
     if (OBJ_IS_NEGATIVE(GetLengthWord(number))) raise_exception0(taskData, EXC_size);
 
-#ifdef USE_GMP
-    // This code won't work with GMP but it's only relevant to Windows.
-#error("get_C_pair is not implemented for GMP")
-#else    
-    POLYUNSIGNED length = get_length(number);
-#endif
+    // Windows is little-endian so we can treat the limbs as bytes.
+    POLYUNSIGNED length = numLimbs(number)*sizeof(mp_limb_t);
     POLYUNSIGNED i;
     unsigned long c;
     POLYOBJPTR ptr = number.AsObjPtr();
@@ -306,19 +266,8 @@ static Handle get_long(Handle x, Handle extend, int *sign)
             *sign = -1;
             x_v   = -x_v;
         }
- #ifdef USE_GMP
         mp_limb_t *u = DEREFLIMBHANDLE(extend);
         *u = x_v;
-#else
-        byte *u = DEREFBYTEHANDLE(extend);
-
-        /* Put into extend buffer, low order byte first. */
-        for (unsigned i = 0; i < sizeof(PolyWord); i++)
-        {
-            u[i] = x_v & 0xff;
-            x_v = x_v >> 8;
-        }
-#endif
         return extend;
     }
     else
@@ -328,24 +277,12 @@ static Handle get_long(Handle x, Handle extend, int *sign)
     }
 }
 
-#ifndef USE_GMP
-static Handle copy_long(TaskData *taskData, Handle x, POLYUNSIGNED lx)
-{
-    Handle y = alloc_and_save(taskData, WORDS(lx), F_BYTE_OBJ|F_MUTABLE_BIT);
-
-    // copy the bytes
-    byte *v = DEREFBYTEHANDLE(y);
-    memcpy(v, DEREFBYTEHANDLE(x), lx);
-    return y;
-}
-#endif
 
 /* make_canonical is used to force a result into its shortest form,
-   in the style of get_length, but also may convert its argument
+   in the style of numLimbs, but also may convert its argument
    from long to short integer */
 static Handle make_canonical(TaskData *taskData, Handle x, int sign)
 {
-#ifdef USE_GMP
     unsigned size = numLimbs(DEREFWORD(x));
     if (size <= 1) // May be zero if the result is zero.
     {
@@ -361,24 +298,42 @@ static Handle make_canonical(TaskData *taskData, Handle x, int sign)
     // Throw away any unused words.
     DEREFWORDHANDLE(x)->SetLengthWord(WORDS(size*sizeof(mp_limb_t)), F_BYTE_OBJ | (sign < 0 ? F_NEGATIVE_BIT: 0));
     return x;
-#else
-    /* get length in BYTES */
-    POLYUNSIGNED size = get_length(DEREFWORD(x));
+}
 
-    // We can use the short representation if it will fit in a word.
-    if (size <= sizeof(PolyWord))
-    {
-        /* Convert the digits. */
-        byte    *u = DEREFBYTEHANDLE(x);
-        POLYUNSIGNED r = 0;
-        for (unsigned i=0; i < sizeof(PolyWord); i++)
-        {
-            r |= ((POLYUNSIGNED)u[i]) << (8*i);
-        }
+/* Most long integers that arise in practice are only just outside the
+   range of short integers.  Operations where both arguments have at most
+   SMALL_LIMBS limbs are done on copies on the C stack and the result is only
+   allocated on the heap, with exactly the size it needs, if it is not short. */
+#define SMALL_LIMBS 2
 
-        /* Check for MAXTAGGED+1 before subtraction
-           in case MAXTAGGED is 0x7fffffff */
+// If x has at most SMALL_LIMBS limbs copy its absolute value into v, padded
+// with zeros, and set the sign.  Returns false if x is longer.
+static bool get_small(PolyWord x, mp_limb_t *v, int *sign)
+{
+    if (IS_INT(x))
+    {
+        POLYSIGNED x_v = UNTAGGED(x);
+        *sign = x_v < 0 ? -1 : 0;
+        v[0] = x_v < 0 ? -x_v : x_v;
+        for (unsigned i = 1; i < SMALL_LIMBS; i++) v[i] = 0;
+        return true;
+    }
+    mp_size_t lx = numLimbs(x);
+    if (lx > SMALL_LIMBS) return false;
+    mp_limb_t *u = (mp_limb_t *)x.AsObjPtr();
+    for (mp_size_t i = 0; i < SMALL_LIMBS; i++) v[i] = i < lx ? u[i] : 0;
+    *sign = OBJ_IS_NEGATIVE(GetLengthWord(x)) ? -1 : 0;
+    return true;
+}
 
+// Return the value of n limbs in C memory as a short integer if it will fit
+// or otherwise as a new long integer.
+static Handle make_small(TaskData *taskData, const mp_limb_t *v, mp_size_t n, int sign)
+{
+    while (n > 0 && v[n-1] == 0) n--;
+    if (n <= 1)
+    {
+        mp_limb_t r = n == 0 ? 0 : v[0];
         if (r <= MAXTAGGED || (r == MAXTAGGED+1 && sign < 0))
         {
             if (sign < 0)
@@ -387,13 +342,28 @@ static Handle make_canonical(TaskData *taskData, Handle x, int sign)
                 return taskData->saveVec.push(TAGGED(r));
         }
     }
+    Handle z = alloc_and_save(taskData, WORDS(n*sizeof(mp_limb_t)), F_BYTE_OBJ | (sign < 0 ? F_NEGATIVE_BIT: 0));
+    memcpy(DEREFLIMBHANDLE(z), v, n*sizeof(mp_limb_t));
+    return z;
+}
 
-    /* The length word of the object is changed to reflect the new length.
-       This is safe because any words thrown away must be zero. */
-    DEREFWORDHANDLE(x)->SetLengthWord(WORDS(size), F_BYTE_OBJ | (sign < 0 ? F_NEGATIVE_BIT: 0));
-
-    return x;
-#endif
+// Add signed values of SMALL_LIMBS limbs.
+static Handle add_small(TaskData *taskData, const mp_limb_t *u, int sign_u, const mp_limb_t *v, int sign_v)
+{
+    mp_limb_t w[SMALL_LIMBS+1];
+    if (sign_u == sign_v)
+    {
+        w[SMALL_LIMBS] = mpn_add_n(w, u, v, SMALL_LIMBS);
+        return make_small(taskData, w, SMALL_LIMBS+1, sign_u);
+    }
+    // Signs differ: subtract the smaller magnitude from the larger.
+    if (mpn_cmp(u, v, SMALL_LIMBS) >= 0)
+    {
+        mpn_sub_n(w, u, v, SMALL_LIMBS);
+        return make_small(taskData, w, SMALL_LIMBS, sign_u);
+    }
+    mpn_sub_n(w, v, u, SMALL_LIMBS);
+    return make_small(taskData, w, SMALL_LIMBS, sign_v);
 }
 
 
@@ -405,19 +375,9 @@ Handle Make_arbitrary_precision(TaskData *taskData, POLYSIGNED val)
         return taskData->saveVec.push(TAGGED(val));
 
     POLYUNSIGNED uval = val < 0 ? -val : val;
-#ifdef USE_GMP
     Handle y = alloc_and_save(taskData, WORDS(sizeof(mp_limb_t)), ((val < 0) ? F_NEGATIVE_BIT : 0)| F_BYTE_OBJ);
     mp_limb_t *v = DEREFLIMBHANDLE(y);
     *v = uval;
-#else
-    Handle y = alloc_and_save(taskData, 1, ((val < 0) ? F_NEGATIVE_BIT : 0)| F_BYTE_OBJ);
-    byte *v = DEREFBYTEHANDLE(y);
-    for (POLYUNSIGNED i = 0; uval != 0; i++)
-    {
-        v[i] = (byte)(uval & 0xff);
-        uval >>= 8;
-    }
-#endif
     return y;
 }
 
@@ -426,19 +386,9 @@ Handle Make_unsigned(TaskData *taskData, POLYUNSIGNED uval)
    precision integer from an unsigned value. */
 {
     if (uval <= MAXTAGGED) return taskData->saveVec.push(TAGGED(uval));
- #ifdef USE_GMP
     Handle y = alloc_and_save(taskData, WORDS(sizeof(mp_limb_t)), F_BYTE_OBJ);
     mp_limb_t *v = DEREFLIMBHANDLE(y);
     *v = uval;
-#else
-    Handle y = alloc_and_save(taskData, 1, F_BYTE_OBJ);
-    byte *v = DEREFBYTEHANDLE(y);
-    for (POLYUNSIGNED i = 0; uval != 0; i++)
-    {
-        v[i] = (byte)(uval & 0xff);
-        uval >>= 8;
-    }
-#endif
     return y;
 }
 
@@ -495,37 +445,19 @@ Handle neg_longc(TaskData *taskData, Handle x)
             return taskData->saveVec.push(TAGGED(-s));
     }
 
-    // Either overflow or long argument - convert to long form.
-#if USE_GMP
-    PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2];
-#endif
-    SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
-    Handle x_ehandle = &x_extend_addr;
-
+    mp_limb_t u[SMALL_LIMBS];
     int sign_x;
-    Handle long_x = get_long(x, x_ehandle, &sign_x);
-
-#ifdef USE_GMP
-    POLYUNSIGNED lx = numLimbs(DEREFWORD(long_x))*sizeof(mp_limb_t);
-#else
-    /* Get length of arg. */
-    POLYUNSIGNED lx = get_length(DEREFWORD(long_x));
-#endif
-    Handle long_y = alloc_and_save(taskData, WORDS(lx), F_MUTABLE_BIT|F_BYTE_OBJ);
-    byte *v = DEREFBYTEHANDLE(long_y);
-    memcpy(v, DEREFBYTEHANDLE(long_x), lx);
-#ifndef USE_GMP
-    // Make sure the last word is zero.  We may have unused bytes there.
-    memset(v+lx, 0, WORDS(lx)*sizeof(PolyWord)-lx);
-#endif
-
-    /* Return the value with the sign changed. */
-    return make_canonical(taskData, long_y, sign_x ^ -1);
+    if (get_small(DEREFWORD(x), u, &sign_x))
+        return make_small(taskData, u, SMALL_LIMBS, sign_x ^ -1);
+
+    // Long argument: copy it with the sign changed.
+    POLYUNSIGNED lx = numLimbs(DEREFWORD(x))*sizeof(mp_limb_t);
+    sign_x = OBJ_IS_NEGATIVE(GetLengthWord(DEREFWORD(x))) ? -1 : 0;
+    Handle long_y = alloc_and_save(taskData, WORDS(lx), F_BYTE_OBJ | (sign_x < 0 ? 0 : F_NEGATIVE_BIT));
+    memcpy(DEREFBYTEHANDLE(long_y), DEREFBYTEHANDLE(x), lx);
+    return long_y;
 } /* neg_longc */
 
-#ifdef USE_GMP
 static Handle add_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign)
 {
     /* find the longer number */
@@ -568,72 +500,7 @@ static Handle add_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign
     w[lu] = carry;
     return make_canonical(taskData, z, sign);
 }
-#else
-static Handle add_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign)
-{
-    byte *u; /* byte-pointer for longer number  */
-    byte *v; /* byte-pointer for shorter number */
-    Handle z;
-
-    POLYUNSIGNED lu;   /* length of u in bytes */
-    POLYUNSIGNED lv;   /* length of v in bytes */
-
-    /* find the longer number */
-    POLYUNSIGNED lx = get_length(DEREFWORD(x));
-    POLYUNSIGNED ly = get_length(DEREFWORD(y));
-
-    /* Make ``u'' the longer. */
-    if (lx < ly)
-    {
-        // Get result vector. It must be 1 byte longer than u
-        // to have space for any carry.
-        z = alloc_and_save(taskData, WORDS(ly+1), F_MUTABLE_BIT|F_BYTE_OBJ);
 
-        /* now safe to dereference pointers */
-        u = DEREFBYTEHANDLE(y); lu = ly;
-        v = DEREFBYTEHANDLE(x); lv = lx;
-    }
-
-    else
-    {
-        // Get result vector. It must be 1 byte longer than u
-        // to have space for any carry, plus one byte for the sign.
-        z = alloc_and_save(taskData, WORDS(lx+2), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-        /* now safe to dereference pointers */
-        u = DEREFBYTEHANDLE(x); lu = lx;
-        v = DEREFBYTEHANDLE(y); lv = ly;
-    }
-
-    /* do the actual addition */
-    byte  *w = DEREFBYTEHANDLE(z);
-    unsigned carry = 0;
-    POLYUNSIGNED i     = 0;
-
-    /* Do the additions */
-    for( ; i < lv; i++)
-    {
-        carry += u[i] + v[i];
-        w[i] = carry & 0xff;
-        carry >>= 8;
-    }
-
-    /* Add the carry to the rest of ``u''. */
-    for( ; i < lu; i++)
-    {
-        carry += u[i];
-        w[i] = carry & 0xff;
-        carry >>= 8;
-    }
-
-    /* Finally put the carry into the last byte */
-    w[i] = (byte)carry;
-
-    return make_canonical(taskData, z, sign);
-} /* add_unsigned_long */
-#endif
-
-#ifdef USE_GMP
 static Handle sub_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign)
 {
     mp_limb_t *u; /* limb-pointer alias for larger number  */
@@ -683,89 +550,6 @@ static Handle sub_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign
     if (lu != lv) borrow = mpn_sub_1(w+lv, u+lv, lu-lv, borrow);
     return make_canonical(taskData, z, sign);
 }
-#else
-static Handle sub_unsigned_long(TaskData *taskData, Handle x, Handle y, int sign)
-{
-    byte *u; /* byte-pointer alias for larger number  */
-    byte *v; /* byte-pointer alias for smaller number */
-    POLYUNSIGNED lu;   /* length of u in bytes */
-    POLYUNSIGNED lv;   /* length of v in bytes */
-    Handle z;
-
-    /* get the larger argument into ``u'' */
-    /* This is necessary so that we can discard */
-    /* the borrow at the end of the subtraction */
-    POLYUNSIGNED lx = get_length(DEREFWORD(x));
-    POLYUNSIGNED ly = get_length(DEREFWORD(y));
-
-    if (lx < ly)
-    {
-        sign ^= -1; /* swap sign of result SPF 21/1/94 */
-        z = alloc_and_save(taskData, WORDS(ly+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-
-        /* now safe to dereference pointers */
-        u = DEREFBYTEHANDLE(y); lu = ly;
-        v = DEREFBYTEHANDLE(x); lv = lx;
-    }
-    else if (ly < lx)
-    {
-        z = alloc_and_save(taskData, WORDS(lx+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-        /* now safe to dereference pointers */
-        u = DEREFBYTEHANDLE(x); lu = lx;
-        v = DEREFBYTEHANDLE(y); lv = ly;
-    }
-
-    else /* lx == ly */
-    { /* Must look at the numbers to decide which is bigger. */
-        POLYUNSIGNED i = lx;
-        while (i > 0 && DEREFBYTEHANDLE(x)[i-1] == DEREFBYTEHANDLE(y)[i-1]) i--;
-
-        if (i == 0) return taskData->saveVec.push(TAGGED(0)); /* They are equal */
-
-        if (DEREFBYTEHANDLE(x)[i-1] < DEREFBYTEHANDLE(y)[i-1])
-        {
-            sign ^= -1; /* swap sign of result SPF 21/1/94 */
-            z = alloc_and_save(taskData, WORDS(ly+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-            /* now safe to dereference pointers */
-            u = DEREFBYTEHANDLE(y); lu = ly;
-            v = DEREFBYTEHANDLE(x); lv = lx;
-        }
-        else
-        {
-            z = alloc_and_save(taskData, WORDS(lx+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-            /* now safe to dereference pointers */
-            u = DEREFBYTEHANDLE(x); lu = lx;
-            v = DEREFBYTEHANDLE(y); lv = ly;
-        }
-    }
-
-    byte        *w = DEREFBYTEHANDLE(z);
-    unsigned    borrow = 1; /* Becomes 0 if there is a borrow */
-    POLYUNSIGNED i = 0;
-
-    /* Do the subtractions */
-    for( ; i < lv; i++)
-    {
-        borrow += 255 + u[i] - v[i];
-        w[i] = borrow & 0xff;
-        borrow >>= 8;
-    }
-
-    /* Add the borrow into the rest of ``u''. */
-    for( ; i < lu; i++)
-    {
-        borrow += 255 + u[i];
-        w[i] = borrow & 0xff;
-        borrow >>= 8;
-    }
-
-    return make_canonical(taskData, z, sign);
-} /* sub_unsigned_long */
-#endif
 
 Handle add_longc(TaskData *taskData, Handle y, Handle x)
 {
@@ -780,19 +564,19 @@ Handle add_longc(TaskData *taskData, Handle y, Handle x)
         }
     }
 
-#if USE_GMP
+    mp_limb_t su[SMALL_LIMBS], sv[SMALL_LIMBS];
+    int sign_x, sign_y;
+    if (get_small(DEREFWORD(x), su, &sign_x) && get_small(DEREFWORD(y), sv, &sign_y))
+        return add_small(taskData, su, sign_x, sv, sign_y);
+
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
     Handle y_ehandle = &y_extend_addr;
 
-    /* Either overflow or long arguments - convert to long form */
-    int sign_x, sign_y;
+    /* Long arguments - convert to long form */
     Handle long_x = get_long(x, x_ehandle, &sign_x);
     Handle long_y = get_long(y, y_ehandle, &sign_y);
 
@@ -817,19 +601,19 @@ Handle sub_longc(TaskData *taskData, Handle y, Handle x)
             return taskData->saveVec.push(TAGGED(t));
     }
 
-#if USE_GMP
+    mp_limb_t su[SMALL_LIMBS], sv[SMALL_LIMBS];
+    int sign_x, sign_y;
+    if (get_small(DEREFWORD(x), su, &sign_x) && get_small(DEREFWORD(y), sv, &sign_y))
+        return add_small(taskData, su, sign_x, sv, sign_y ^ -1);
+
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
     Handle y_ehandle = &y_extend_addr;
 
-    /* Either overflow or long arguments. */
-    int sign_x, sign_y;
+    /* Long arguments. */
     Handle long_x = get_long(x, x_ehandle, &sign_x); /* Convert to long form */
     Handle long_y = get_long(y, y_ehandle, &sign_y);
 
@@ -847,24 +631,26 @@ Handle sub_longc(TaskData *taskData, Handle y, Handle x)
 
 Handle mult_longc(TaskData *taskData, Handle y, Handle x)
 {
+    mp_limb_t su[SMALL_LIMBS], sv[SMALL_LIMBS];
+    int sign_x, sign_y;
+    if (get_small(DEREFWORD(x), su, &sign_x) && get_small(DEREFWORD(y), sv, &sign_y))
+    {
+        mp_limb_t w[2*SMALL_LIMBS];
+        mpn_mul(w, su, SMALL_LIMBS, sv, SMALL_LIMBS);
+        return make_small(taskData, w, 2*SMALL_LIMBS, sign_x ^ sign_y);
+    }
 
-#if USE_GMP
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
     Handle y_ehandle = &y_extend_addr;
 
-    /* Either overflow or long arguments. */
-    int sign_x, sign_y;
+    /* Long arguments. */
     Handle long_x = get_long(x, x_ehandle, &sign_x); /* Convert to long form */
     Handle long_y = get_long(y, y_ehandle, &sign_y);
 
-#if USE_GMP
     mp_size_t lx = numLimbs(DEREFWORD(long_x));
     mp_size_t ly = numLimbs(DEREFWORD(long_y));
 
@@ -876,142 +662,18 @@ Handle mult_longc(TaskData *taskData, Handle y, Handle x)
     mp_limb_t *u = DEREFLIMBHANDLE(long_x), *v = DEREFLIMBHANDLE(long_y);
 
     // The first argument must be the longer.
-    if (lx < ly) mpn_mul(w, v, ly, u, lx);
-    else mpn_mul(w, u, lx, v, ly);
-
-    return make_canonical(taskData, z, sign_x ^ sign_y);
-
-#else
-    /* Get lengths of args. */
-    POLYUNSIGNED lx = get_length(DEREFWORD(long_x));
-    POLYUNSIGNED ly = get_length(DEREFWORD(long_y));
-
-    // Check for zero args.
-    if (lx == 0 || ly == 0) return taskData->saveVec.push(TAGGED(0));
-
-    /* Get space for result */
-    Handle long_z = alloc_and_save(taskData, WORDS(lx+ly+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-    /* Can now load the actual addresses because they will not change now. */
-    byte *u = DEREFBYTEHANDLE(long_x);
-    byte *v = DEREFBYTEHANDLE(long_y);
-    byte *w = DEREFBYTEHANDLE(long_z);
-
-    for(POLYUNSIGNED i = 0; i < lx; i++)
-    {
-        POLYUNSIGNED j;
-        long r = 0; /* Set the carry to zero */
-        for(j = 0; j < ly; j++)
-        {
-            /* Compute the product. */
-            r += u[i] * v[j];
-            /* Now add in to the result. */
-            r += w[i+j];
-            w[i+j] = r & 0xff;
-            r >>= 8;
-        }
-        /* Put in any carry. */
-        w[i+j] = (byte)r;
+    try {
+        if (lx < ly) mpn_mul(w, v, ly, u, lx);
+        else mpn_mul(w, u, lx, v, ly);
     }
-
-    return make_canonical(taskData, long_z, sign_x ^ sign_y);
-#endif
-} /* mult_long */
-
-#ifndef USE_GMP
-static void div_unsigned_long(byte *u, byte *v, byte *remres, byte *divres, POLYUNSIGNED lu, POLYUNSIGNED lv)
-// Unsigned division. This is the main divide and remainder routine.
-// remres must be at least lu+1 bytes long
-// divres must be at least lu-lv+1 bytes long but can be zero if not required
-{
-    POLYUNSIGNED i,j;
-    long r;
-
-    /* Find out how far to shift v to get a 1 in the top bit. */
-    int bits = 0;
-    for(r = v[lv-1]; r < 128; r <<= 1) bits++; /* 128 ??? */
-
-    /* Shift u that amount into res. We have allowed enough room for
-       overflow. */
-    r = 0;
-    for (i = 0; i < lu; i++)
-    {
-        r |= u[i] << bits; /*``Or in'' the new bits after shifting*/
-        remres[i] = r & 0xff;    /* Put into the destination. */
-        r >>= 8;                /* and shift down the carry. */
-    }
-    remres[i] = (byte)r; /* Put in the carry */
-
-    /* And v that amount. It has already been copied. */
-    if ( bits )
-    {
-        r = 0;
-        for (i = 0; i < lv; i++)
-        { r |= v[i] << bits; v[i] = r & 0xff; r >>= 8; }
-        /* No carry */
+    catch (MemoryException) {
+        raise_exception0(taskData, EXC_size);
     }
 
-    for(j = lu; j >= lv; j--)
-    {
-    /* j iterates over the higher digits of the dividend until we are left
-        with a number which is less than the divisor. This is the remainder. */
-        long quotient, dividend, r;
-        dividend = remres[j]*256 + remres[j-1];
-        quotient = (remres[j] == v[lv-1]) ? 255 : dividend/(long)v[lv-1];
-
-        if (lv != 1)
-        {
-            while ((long)v[lv-2]*quotient >
-                (dividend - quotient*(long)v[lv-1])*256 + (long)remres[j-2])
-            {
-                quotient--;
-            }
-        }
-
-        /* The quotient is at most 1 too large */
-        /* Subtract the product of this with ``v'' from ``res''. */
-        r = 1; /* Initial borrow */
-        for(i = 0; i < lv; i++)
-        {
-            r += 255 + remres[j-lv+i] - quotient * v[i];
-            remres[j-lv+i] = r & 0xff;
-            r >>= 8;
-        }
+    return make_canonical(taskData, z, sign_x ^ sign_y);
 
-        r += remres[j]; /* Borrow from leading digit. */
-                     /* If we are left with a borrow when the subtraction is complete the
-                     quotient must have been too big. We add ``v'' to the dividend and
-        subtract 1 from the quotient. */
-        if (r == 0 /* would be 1 if there were no borrow */)
-        {
-            quotient --;
-            r = 0;
-            for (i = 0; i < lv; i++)
-            {
-                r += v[i] + remres[j-lv+i];
-                remres[j-lv+i] = r & 0xff;
-                r >>= 8;
-            }
-        }
-        /* Place the next digit of quotient in result */
-        if (divres) divres[j-lv] = (byte)quotient;
-    }
+} /* mult_long */
 
-    /* Likewise the remainder. */
-    if (bits)
-    {
-        r = 0;
-        j = lv;
-        while (j > 0)
-        {
-            j--;
-            r |= remres[j];
-            remres[j] = (r >> bits) & 0xff;
-            r = (r & 0xff) << 8;
-        }
-    }
-} /* div_unsigned_long */
-#endif
 
 // Common code for div and mod.  Returns handles to the results.
 static void quotRem(TaskData *taskData, Handle y, Handle x, Handle &remHandle, Handle &divHandle)
@@ -1033,22 +695,36 @@ static void quotRem(TaskData *taskData, Handle y, Handle x, Handle &remHandle, H
         }
     }
 
-#if USE_GMP
+    mp_limb_t su[SMALL_LIMBS], sv[SMALL_LIMBS];
+    int sign_x, sign_y;
+    if (get_small(DEREFWORD(x), su, &sign_x) && get_small(DEREFWORD(y), sv, &sign_y))
+    {
+        mp_size_t ly = SMALL_LIMBS;
+        while (ly > 0 && sv[ly-1] == 0) ly--;
+        if (ly == 0) raise_exception0(taskData, EXC_divide);
+        mp_limb_t quotient[SMALL_LIMBS], remainder[SMALL_LIMBS];
+        for (unsigned i = 0; i < SMALL_LIMBS; i++) quotient[i] = remainder[i] = 0;
+        try {
+            mpn_tdiv_qr(quotient, remainder, 0, su, SMALL_LIMBS, sv, ly);
+        }
+        catch (MemoryException) {
+            raise_exception0(taskData, EXC_size);
+        }
+        remHandle = make_small(taskData, remainder, SMALL_LIMBS, sign_x /* Same sign as dividend */);
+        divHandle = make_small(taskData, quotient, SMALL_LIMBS, sign_x ^ sign_y);
+        return;
+    }
+
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
     Handle y_ehandle = &y_extend_addr;
 
-    int sign_x, sign_y;
     Handle long_x = get_long(x, x_ehandle, &sign_x);
     Handle long_y = get_long(y, y_ehandle, &sign_y);
 
-#ifdef USE_GMP
     /* Get lengths of args. */
     mp_size_t lx = numLimbs(DEREFWORD(long_x));
     mp_size_t ly = numLimbs(DEREFWORD(long_y));
@@ -1069,46 +745,16 @@ static void quotRem(TaskData *taskData, Handle y, Handle x, Handle &remHandle, H
     mp_limb_t *remainder = DEREFLIMBHANDLE(remRes);
 
     // Do the division.
-    mpn_tdiv_qr(quotient, remainder, 0, u, lx, v, ly);
-
-    // Return the results.
-    remHandle = make_canonical(taskData, remRes, sign_x /* Same sign as dividend */);
-    divHandle = make_canonical(taskData, divRes, sign_x ^ sign_y);
-#else
-    /* Get lengths of args. */
-    POLYUNSIGNED lx = get_length(DEREFWORD(long_x));
-    POLYUNSIGNED ly = get_length(DEREFWORD(long_y));
-
-    /* If length of y is zero raise divideerror */
-    if (ly == 0) raise_exception0(taskData, EXC_divide);
-    // If the length of divisor is less than the dividend the quotient is zero.
-    if (lx < ly) {
-        divHandle = taskData->saveVec.push(TAGGED(0));
-        remHandle = x; /* When x < y remainder is x. */
-        return;
+    try {
+        mpn_tdiv_qr(quotient, remainder, 0, u, lx, v, ly);
     }
-
-    /* copy in case it needs shifting */
-    long_y = copy_long(taskData, long_y, ly);
-
-    Handle divRes = alloc_and_save(taskData, WORDS(lx-ly+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-    Handle remRes = alloc_and_save(taskData, WORDS(lx+1), F_MUTABLE_BIT|F_BYTE_OBJ);
-
-    div_unsigned_long
-        (DEREFBYTEHANDLE(long_x),
-        DEREFBYTEHANDLE(long_y),
-        DEREFBYTEHANDLE(remRes), DEREFBYTEHANDLE(divRes),
-        lx, ly);
-
-    /* Clear the rest */
-    for(POLYUNSIGNED i=ly; i < lx+1; i++)
-    {
-        DEREFBYTEHANDLE(remRes)[i] = 0;
+    catch (MemoryException) {
+        raise_exception0(taskData, EXC_size);
     }
 
-    remHandle = make_canonical(taskData, remRes, sign_x /* Same sign as dividend */ );
+    // Return the results.
+    remHandle = make_canonical(taskData, remRes, sign_x /* Same sign as dividend */);
     divHandle = make_canonical(taskData, divRes, sign_x ^ sign_y);
-#endif
 }
 
 // This returns x divided by y.  This always rounds towards zero so
@@ -1143,7 +789,6 @@ Handle quot_rem_c(TaskData *taskData, Handle result, Handle y, Handle x)
 /* compare_unsigned is passed LONG integers only */
 static int compare_unsigned(Handle x, Handle y)
 {
-#ifdef USE_GMP
     mp_size_t lx = numLimbs(DEREFWORD(x));
     mp_size_t ly = numLimbs(DEREFWORD(y));
 
@@ -1152,32 +797,6 @@ static int compare_unsigned(Handle x, Handle y)
         return (lx > ly ? 1 : -1);
     }
     return mpn_cmp(DEREFLIMBHANDLE(x), DEREFLIMBHANDLE(y), lx);
-#else
-    /* First look at the lengths */
-    POLYUNSIGNED lx = get_length(DEREFWORD(x));
-    POLYUNSIGNED ly = get_length(DEREFWORD(y));
-
-    if (lx != ly)  /* u > v if u longer than v */
-    {
-        return (lx > ly ? 1 : -1);
-    }
-
-    // Same length - look at the values. */
-    byte *u = DEREFBYTEHANDLE(x);
-    byte *v = DEREFBYTEHANDLE(y);
-
-    POLYUNSIGNED i = lx;
-    while (i > 0)
-    {
-        i--;
-        if (u[i] != v[i])
-        {
-            return u[i] > v[i] ? 1 : -1;
-        }
-    }
-    /* Must be equal */
-    return 0;
-#endif
 }
 
 int compareLong(TaskData *taskData, Handle y, Handle x)
@@ -1213,44 +832,15 @@ int compareLong(TaskData *taskData, Handle y, Handle x)
         else return 1; // x is greater
     }
 
-    /* Convert to long form */
-#if USE_GMP
-    PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
-    PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
-    SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
-    Handle x_ehandle = &x_extend_addr;
-    SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
-    Handle y_ehandle = &y_extend_addr;
-
-    int sign_x, sign_y;
-    Handle long_x = get_long(x, x_ehandle, &sign_x); /* Convert to long form */
-    Handle long_y = get_long(y, y_ehandle, &sign_y);
-
-    if (sign_x >= 0) /* x is positive */
-    {
-        if (sign_y >= 0) /* y also positive */
-        {
-            return compare_unsigned(long_x, long_y);
-        }
-        else /* y negative so x > y */
-        {
-            return 1;
-        }
-    }
-    else
-    { /* x is negative */
-        if (sign_y < 0) /* y also negative */
-        {
-            return compare_unsigned(long_y, long_x);
-        }
-        else /* y positive so x < y */
-        {
-            return -1;
-        }
-    }
+    // Both long.  If the signs differ the negative one is less.  Otherwise
+    // compare the absolute values, reversing the result if they're negative.
+    bool negX = OBJ_IS_NEGATIVE(GetLengthWord(DEREFWORD(x)));
+    bool negY = OBJ_IS_NEGATIVE(GetLengthWord(DEREFWORD(y)));
+    if (negX != negY)
+        return negX ? -1 : 1;
+    else if (negX)
+        return compare_unsigned(y, x);
+    else return compare_unsigned(x, y);
 } /* compareLong */
 
 
@@ -1267,13 +857,8 @@ static Handle logical_long(TaskData *taskData, Handle x, Handle y, int signX, in
     POLYUNSIGNED lv;   /* length of v in bytes */
 
     { /* find the longer number */
-#ifdef USE_GMP
         POLYUNSIGNED lx = numLimbs(DEREFWORD(x)) * sizeof(mp_limb_t);
         POLYUNSIGNED ly = numLimbs(DEREFWORD(y)) * sizeof(mp_limb_t);
-#else
-        POLYUNSIGNED lx = get_length(DEREFWORD(x));
-        POLYUNSIGNED ly = get_length(DEREFWORD(y));
-#endif
 
         /* Make ``u'' the longer. */
         if (lx < ly)
@@ -1384,12 +969,8 @@ Handle and_longc(TaskData *taskData, Handle y, Handle x)
         return taskData->saveVec.push(TAGGED(t));
     }
 
-#if USE_GMP
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
@@ -1414,12 +995,8 @@ Handle or_longc(TaskData *taskData, Handle y, Handle x)
         return taskData->saveVec.push(TAGGED(t));
     }
 
-#if USE_GMP
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
@@ -1444,12 +1021,8 @@ Handle xor_longc(TaskData *taskData, Handle y, Handle x)
         return taskData->saveVec.push(TAGGED(t));
     }
 
-#if USE_GMP
     PolyWord    x_extend[1+WORDS(sizeof(mp_limb_t))];
     PolyWord    y_extend[1+WORDS(sizeof(mp_limb_t))];
-#else
-    PolyWord    x_extend[2], y_extend[2];
-#endif
     SaveVecEntry x_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(x_extend[1])));
     Handle x_ehandle = &x_extend_addr;
     SaveVecEntry y_extend_addr = SaveVecEntry(PolyWord::FromStackAddr(&(y_extend[1])));
@@ -1538,18 +1111,8 @@ Handle int_to_word_c(TaskData *taskData, Handle x)
     if (IS_INT(DEREFWORD(x)))
         return x;
 
-#ifdef USE_GMP
     // It may be big- or little-endian.
     POLYUNSIGNED r = (POLYUNSIGNED)*DEREFLIMBHANDLE(x);
-#else
-    // Little-endian.
-    byte    *u = DEREFBYTEHANDLE(x);
-    POLYUNSIGNED r = 0;
-    for (unsigned i=0; i < sizeof(PolyWord); i++)
-    {
-        r |= (POLYUNSIGNED)u[i] << (8*i);
-    }
-#endif
     if (OBJ_IS_NEGATIVE(x->Word().AsObjPtr()->LengthWord()))
         r = 0-r; // Use 0-r rather than -r since it's an unsigned value.
     return taskData->saveVec.push(TAGGED(r));
@@ -1724,4 +1287,141 @@ Handle lcm_arbitrary(TaskData *taskData, Handle x, Handle y)
     return mult_longc(taskData, x, div_longc(taskData, g, y));
 }
 
+/*  Conversion to and from strings of digits.  Converting digit by digit in ML
+    is quadratic in the length of the number.  mpn_get_str and mpn_set_str
+    split large numbers by powers of the radix so the cost follows that of
+    multiplication. */
+
+static const char digitChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+// A malloc'd work area that is freed when it goes out of scope.  Allocating the
+// result may raise an exception so the areas must not be freed explicitly.
+template <class T> class TempBuffer
+{
+public:
+    TempBuffer(size_t n): buff((T*)malloc(n * sizeof(T))) {}
+    ~TempBuffer() { free(buff); }
+    T *buff;
+private:
+    TempBuffer(const TempBuffer&);
+    TempBuffer& operator=(const TempBuffer&);
+};
+
+static int getRadix(TaskData *taskData, Handle radix)
+{
+    unsigned base = get_C_unsigned(taskData, DEREFWORD(radix));
+    if (base < 2 || base >= sizeof(digitChars))
+        raise_exception0(taskData, EXC_size);
+    return (int)base;
+}
+
+// Return the value of x in the given radix.  Negative numbers have a leading ~
+// and digits above 9 are upper case letters as in Int.fmt.
+Handle int_to_string_arbitrary(TaskData *taskData, Handle radix, Handle x)
+{
+    int base = getRadix(taskData, radix);
+    mp_limb_t shortValue;
+    const mp_limb_t *xl;
+    mp_size_t lx;
+    bool negative;
+    if (IS_INT(DEREFWORD(x)))
+    {
+        POLYSIGNED x_v = UNTAGGED(DEREFWORD(x));
+        negative = x_v < 0;
+        shortValue = negative ? -x_v : x_v;
+        xl = &shortValue;
+        lx = shortValue == 0 ? 0 : 1;
+    }
+    else
+    {
+        negative = OBJ_IS_NEGATIVE(GetLengthWord(DEREFWORD(x)));
+        xl = DEREFLIMBHANDLE(x);
+        lx = numLimbs(DEREFWORD(x));
+    }
+    if (lx == 0)
+        return taskData->saveVec.push(TAGGED('0'));
+
+    // mpn_get_str overwrites its argument so it needs a copy.  A limb gives at
+    // most one digit per bit and the string needs one extra character.
+    size_t maxDigits = lx * GMP_LIMB_BITS + 2;
+    TempBuffer<mp_limb_t> copy(lx + 1);
+    TempBuffer<unsigned char> digits(maxDigits);
+    if (copy.buff == 0 || digits.buff == 0)
+        raise_exception0(taskData, EXC_size);
+    memcpy(copy.buff, xl, lx * sizeof(mp_limb_t));
+    size_t n = 0;
+    try {
+        n = mpn_get_str(digits.buff+1, base, copy.buff, lx);
+    }
+    catch (MemoryException) {
+        raise_exception0(taskData, EXC_size);
+    }
+    // There may be leading zeros.
+    unsigned char *p = digits.buff+1;
+    while (n > 1 && *p == 0) { p++; n--; }
+    for (size_t i = 0; i < n; i++)
+        p[i] = digitChars[p[i]];
+    if (negative) { p--; n++; *p = '~'; }
+    return taskData->saveVec.push(Buffer_to_Poly(taskData, (const char *)p, n));
+}
+
+// Convert a string of digits in the given radix, with no sign, to an integer.
+// Letters may be in either case.
+Handle string_to_int_arbitrary(TaskData *taskData, Handle radix, Handle str)
+{
+    int base = getRadix(taskData, radix);
+    const char *chars;
+    char singleChar;
+    size_t len;
+    if (IS_INT(DEREFWORD(str)))
+    {
+        singleChar = (char)UNTAGGED(DEREFWORD(str));
+        chars = &singleChar;
+        len = 1;
+    }
+    else
+    {
+        PolyStringObject *s = (PolyStringObject *)DEREFHANDLE(str);
+        chars = s->chars;
+        len = s->length;
+    }
+
+    TempBuffer<unsigned char> digits(len == 0 ? 1 : len);
+    if (digits.buff == 0)
+        raise_exception0(taskData, EXC_size);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        char ch = chars[i];
+        int d;
+        if (ch >= '0' && ch <= '9') d = ch - '0';
+        else if (ch >= 'A' && ch <= 'Z') d = ch - 'A' + 10;
+        else if (ch >= 'a' && ch <= 'z') d = ch - 'a' + 10;
+        else d = base;
+        if (d >= base)
+            raise_exception_string(taskData, EXC_conversion, "Invalid digit");
+        // mpn_set_str requires the leading digit to be non-zero.
+        if (n != 0 || d != 0) digits.buff[n++] = (unsigned char)d;
+    }
+    if (n == 0)
+        return taskData->saveVec.push(TAGGED(0));
+
+    // The result needs at most bits-per-digit times the digits, rounded up,
+    // plus an extra limb for mpn_set_str.
+    unsigned bitsPerDigit = 1;
+    while ((1 << bitsPerDigit) < base) bitsPerDigit++;
+    mp_size_t maxLimbs = (n * bitsPerDigit) / GMP_LIMB_BITS + 2;
+    TempBuffer<mp_limb_t> limbs(maxLimbs);
+    if (limbs.buff == 0)
+        raise_exception0(taskData, EXC_size);
+    mp_size_t ln = 0;
+    try {
+        ln = mpn_set_str(limbs.buff, digits.buff, n, base);
+    }
+    catch (MemoryException) {
+        raise_exception0(taskData, EXC_size);
+    }
+    return make_small(taskData, limbs.buff, ln, 0);
+}
+
 
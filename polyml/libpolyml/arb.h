@@ -54,6 +54,8 @@ extern Handle int_to_word_c(TaskData *taskData, Handle x);
 
 extern Handle gcd_arbitrary(TaskData *taskData, Handle,Handle);
 extern Handle lcm_arbitrary(TaskData *taskData, Handle,Handle);
+extern Handle int_to_string_arbitrary(TaskData *taskData, Handle radix, Handle x);
+extern Handle string_to_int_arbitrary(TaskData *taskData, Handle radix, Handle str);
 
 extern POLYUNSIGNED     get_C_ulong(TaskData *taskData, PolyWord);
 extern unsigned short   get_C_ushort(TaskData *taskData, PolyWord);
@@ -0,0 +1,981 @@
+/*
+    Title:  arbmpn.cpp - Natural number arithmetic for builds without GMP
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+This replaces the GMP functions used by arb.cpp when GMP is not available.
+Numbers are vectors of limbs, each a Poly word, low-order limb first.
+Addition, subtraction and the single-limb operations are simple loops.
+Multiplication uses the schoolbook method for short operands, Karatsuba's
+method above MUL_KARATSUBA_THRESHOLD limbs and Toom-3 above MUL_TOOM3_THRESHOLD.
+Division by a single limb and the inner loop of long division use a
+precomputed reciprocal of the divisor (Moller and Granlund) rather than a
+hardware divide.  Long division uses Knuth's algorithm D when the divisor or
+quotient is short and otherwise the recursive method of Burnikel and Ziegler,
+which reduces the division to multiplications of half the size so that its
+cost follows that of multiplication.  Conversion to and from strings of
+digits splits the number by powers of the base for the same reason.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifndef HAVE_GMP_H
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ASSERT_H
+#include <assert.h>
+#define ASSERT(x)   assert(x)
+#else
+#define ASSERT(x)
+#endif
+
+#include "globals.h"
+#include "arbmpn.h"
+#include "run_time.h" // For MemoryException
+
+// Operand sizes, in limbs, at which the faster algorithms take over.
+#define MUL_KARATSUBA_THRESHOLD     32
+#define MUL_TOOM3_THRESHOLD         160
+#define DIV_DC_THRESHOLD            48
+#define GET_STR_DC_THRESHOLD        16
+#define SET_STR_DC_THRESHOLD        16
+
+// A double-length limb if the compiler provides one.
+#if (SIZEOF_VOIDP == 4)
+typedef unsigned long long mp_dlimb_t;
+#define HAVE_DLIMB 1
+#elif defined(__SIZEOF_INT128__)
+typedef unsigned __int128 mp_dlimb_t;
+#define HAVE_DLIMB 1
+#endif
+
+#define HALF_BITS       (GMP_LIMB_BITS/2)
+#define LOW_HALF(x)     ((x) & (((mp_limb_t)1 << HALF_BITS) - 1))
+#define HIGH_HALF(x)    ((x) >> HALF_BITS)
+#define TOP_BIT         ((mp_limb_t)1 << (GMP_LIMB_BITS-1))
+
+// Set hi,lo to the double-length product of u and v.
+static inline void umul_ppmm(mp_limb_t &hi, mp_limb_t &lo, mp_limb_t u, mp_limb_t v)
+{
+#ifdef HAVE_DLIMB
+    mp_dlimb_t p = (mp_dlimb_t)u * v;
+    hi = (mp_limb_t)(p >> GMP_LIMB_BITS);
+    lo = (mp_limb_t)p;
+#else
+    mp_limb_t ul = LOW_HALF(u), uh = HIGH_HALF(u), vl = LOW_HALF(v), vh = HIGH_HALF(v);
+    mp_limb_t x0 = ul * vl, x1 = ul * vh, x2 = uh * vl, x3 = uh * vh;
+    x1 += HIGH_HALF(x0);
+    x1 += x2;
+    if (x1 < x2) x3 += (mp_limb_t)1 << HALF_BITS;
+    hi = x3 + HIGH_HALF(x1);
+    lo = (x1 << HALF_BITS) + LOW_HALF(x0);
+#endif
+}
+
+// Divide n1,n0 by d returning the quotient and setting r to the remainder.
+// d must be normalised, i.e. have its top bit set, and n1 must be less than d.
+// This uses a hardware or library divide and is only used to compute reciprocals.
+static mp_limb_t udiv_qrnnd(mp_limb_t &r, mp_limb_t n1, mp_limb_t n0, mp_limb_t d)
+{
+#ifdef HAVE_DLIMB
+    mp_dlimb_t n = ((mp_dlimb_t)n1 << GMP_LIMB_BITS) | n0;
+    mp_limb_t q = (mp_limb_t)(n / d);
+    r = n0 - q * d;
+    return q;
+#else
+    // Knuth's algorithm D with half-limb digits.
+    mp_limb_t d1 = HIGH_HALF(d), d0 = LOW_HALF(d);
+    mp_limb_t q1 = n1 / d1, r1 = n1 - q1 * d1;
+    mp_limb_t m = q1 * d0;
+    r1 = (r1 << HALF_BITS) | HIGH_HALF(n0);
+    if (r1 < m)
+    {
+        q1--, r1 += d;
+        if (r1 >= d && r1 < m) q1--, r1 += d;
+    }
+    r1 -= m;
+    mp_limb_t q0 = r1 / d1, r0 = r1 - q0 * d1;
+    m = q0 * d0;
+    r0 = (r0 << HALF_BITS) | LOW_HALF(n0);
+    if (r0 < m)
+    {
+        q0--, r0 += d;
+        if (r0 >= d && r0 < m) q0--, r0 += d;
+    }
+    r = r0 - m;
+    return (q1 << HALF_BITS) | q0;
+#endif
+}
+
+// The reciprocal of a normalised divisor: floor((B*B-1)/d) - B
+static inline mp_limb_t invert_limb(mp_limb_t d)
+{
+    mp_limb_t r;
+    return udiv_qrnnd(r, ~d, ~(mp_limb_t)0, d);
+}
+
+// Divide nh,nl by the normalised d using its reciprocal.  nh must be less than d.
+static inline mp_limb_t udiv_qrnnd_preinv(mp_limb_t &r, mp_limb_t nh, mp_limb_t nl, mp_limb_t d, mp_limb_t dinv)
+{
+    mp_limb_t qh, ql;
+    umul_ppmm(qh, ql, nh, dinv);
+    ql += nl;
+    qh += nh + 1 + (ql < nl);
+    mp_limb_t rem = nl - qh * d;
+    if (rem > ql) { qh--; rem += d; }
+    if (rem >= d) { qh++; rem -= d; }
+    r = rem;
+    return qh;
+}
+
+static inline unsigned count_leading_zeros(mp_limb_t x)
+{
+#if (defined(__GNUC__) && SIZEOF_VOIDP == SIZEOF_LONG)
+    return __builtin_clzl(x);
+#else
+    unsigned n = 0;
+    for (; (x & TOP_BIT) == 0; x <<= 1) n++;
+    return n;
+#endif
+}
+
+// Work areas are allocated with malloc.  If that fails MemoryException is
+// thrown and arb.cpp raises Size, as it does if its own allocation fails.
+static mp_limb_t *allocLimbs(mp_size_t n)
+{
+    mp_limb_t *p = (mp_limb_t*)malloc((n == 0 ? 1 : n) * sizeof(mp_limb_t));
+    if (p == 0)
+        throw MemoryException();
+    return p;
+}
+
+// A work area that is freed when it goes out of scope, including when a
+// nested allocation throws.
+class LimbBuffer
+{
+public:
+    LimbBuffer(mp_size_t n): limbs(allocLimbs(n)) {}
+    ~LimbBuffer() { free(limbs); }
+    mp_limb_t *limbs;
+private:
+    LimbBuffer(const LimbBuffer&);
+    LimbBuffer& operator=(const LimbBuffer&);
+};
+
+mp_limb_t mpn_add_n(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n)
+{
+    mp_limb_t carry = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t u = up[i];
+        mp_limb_t s = u + vp[i];
+        mp_limb_t c = s < u;
+        mp_limb_t t = s + carry;
+        carry = c | (t < s);
+        rp[i] = t;
+    }
+    return carry;
+}
+
+mp_limb_t mpn_add_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v)
+{
+    mp_size_t i = 0;
+    for (; i < n && v != 0; i++)
+    {
+        mp_limb_t s = up[i] + v;
+        v = s < v;
+        rp[i] = s;
+    }
+    if (rp != up)
+    {
+        for (; i < n; i++) rp[i] = up[i];
+    }
+    return v;
+}
+
+mp_limb_t mpn_sub_n(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n)
+{
+    mp_limb_t borrow = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t u = up[i];
+        mp_limb_t s = u - vp[i];
+        mp_limb_t b = s > u;
+        mp_limb_t t = s - borrow;
+        borrow = b | (t > s);
+        rp[i] = t;
+    }
+    return borrow;
+}
+
+mp_limb_t mpn_sub_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v)
+{
+    mp_size_t i = 0;
+    for (; i < n && v != 0; i++)
+    {
+        mp_limb_t u = up[i];
+        rp[i] = u - v;
+        v = v > u;
+    }
+    if (rp != up)
+    {
+        for (; i < n; i++) rp[i] = up[i];
+    }
+    return v;
+}
+
+int mpn_cmp(const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n)
+{
+    while (n > 0)
+    {
+        n--;
+        if (up[n] != vp[n])
+            return up[n] > vp[n] ? 1 : -1;
+    }
+    return 0;
+}
+
+mp_limb_t mpn_lshift(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, unsigned cnt)
+{
+    // Work down from the top so that rp may be the same as up.
+    mp_limb_t high = up[n-1];
+    mp_limb_t result = high >> (GMP_LIMB_BITS - cnt);
+    for (mp_size_t i = n-1; i > 0; i--)
+    {
+        mp_limb_t low = up[i-1];
+        rp[i] = (high << cnt) | (low >> (GMP_LIMB_BITS - cnt));
+        high = low;
+    }
+    rp[0] = high << cnt;
+    return result;
+}
+
+mp_limb_t mpn_rshift(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, unsigned cnt)
+{
+    mp_limb_t low = up[0];
+    mp_limb_t result = low << (GMP_LIMB_BITS - cnt);
+    for (mp_size_t i = 0; i < n-1; i++)
+    {
+        mp_limb_t high = up[i+1];
+        rp[i] = (low >> cnt) | (high << (GMP_LIMB_BITS - cnt));
+        low = high;
+    }
+    rp[n-1] = low >> cnt;
+    return result;
+}
+
+mp_limb_t mpn_mul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v)
+{
+    mp_limb_t carry = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t hi, lo;
+        umul_ppmm(hi, lo, up[i], v);
+        lo += carry;
+        carry = hi + (lo < carry);
+        rp[i] = lo;
+    }
+    return carry;
+}
+
+mp_limb_t mpn_addmul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v)
+{
+    mp_limb_t carry = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t hi, lo;
+        umul_ppmm(hi, lo, up[i], v);
+        lo += carry;
+        hi += lo < carry;
+        mp_limb_t r = rp[i];
+        lo += r;
+        hi += lo < r;
+        rp[i] = lo;
+        carry = hi;
+    }
+    return carry;
+}
+
+mp_limb_t mpn_submul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v)
+{
+    mp_limb_t borrow = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t hi, lo;
+        umul_ppmm(hi, lo, up[i], v);
+        lo += borrow;
+        hi += lo < borrow;
+        mp_limb_t r = rp[i];
+        mp_limb_t t = r - lo;
+        hi += t > r;
+        rp[i] = t;
+        borrow = hi;
+    }
+    return borrow;
+}
+
+// Add xp to rp+off, propagating the carry up to rn limbs.  Only the low
+// part of xp that fits is added: the rest must be zero.
+static void addAt(mp_limb_t *rp, mp_size_t rn, mp_size_t off, const mp_limb_t *xp, mp_size_t xn)
+{
+    if (xn > rn - off) xn = rn - off;
+    mp_limb_t carry = mpn_add_n(rp+off, rp+off, xp, xn);
+    mpn_add_1(rp+off+xn, rp+off+xn, rn-off-xn, carry);
+}
+
+// Subtract a shorter number from a longer one, modulo B^xn.
+static void subFrom(mp_limb_t *xp, mp_size_t xn, const mp_limb_t *yp, mp_size_t yn)
+{
+    mp_limb_t borrow = mpn_sub_n(xp, xp, yp, yn);
+    mpn_sub_1(xp+yn, xp+yn, xn-yn, borrow);
+}
+
+static void addTo(mp_limb_t *xp, mp_size_t xn, const mp_limb_t *yp, mp_size_t yn)
+{
+    mp_limb_t carry = mpn_add_n(xp, xp, yp, yn);
+    mpn_add_1(xp+yn, xp+yn, xn-yn, carry);
+}
+
+static void mulBasecase(mp_limb_t *rp, const mp_limb_t *up, mp_size_t un, const mp_limb_t *vp, mp_size_t vn)
+{
+    rp[un] = mpn_mul_1(rp, up, un, vp[0]);
+    for (mp_size_t j = 1; j < vn; j++)
+        rp[un+j] = mpn_addmul_1(rp+j, up, un, vp[j]);
+}
+
+// The scratch space needed by mulN.  This isn't monotonic in n because of
+// the change of algorithm so the recursive calls take the maximum.
+static mp_size_t mulNScratch(mp_size_t n)
+{
+    if (n < MUL_KARATSUBA_THRESHOLD)
+        return 0;
+    else if (n < MUL_TOOM3_THRESHOLD)
+    {
+        mp_size_t h = n/2, hh = n - h;
+        mp_size_t s0 = mulNScratch(h), s1 = mulNScratch(hh);
+        return 6*hh + 1 + (s0 > s1 ? s0 : s1);
+    }
+    else
+    {
+        mp_size_t k = (n + 2) / 3, hl = n - 2*k;
+        mp_size_t s0 = mulNScratch(k), s1 = mulNScratch(k+1), s2 = mulNScratch(hl);
+        mp_size_t s = s0 > s1 ? s0 : s1;
+        return 6*(k+1) + 3*(2*k+2) + (s > s2 ? s : s2);
+    }
+}
+
+static void mulN(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n, mp_limb_t *tp);
+
+// Set dp to |xp - yp| where xp has n limbs and yp has n or n+1.
+// Returns true if the difference is negative.
+static bool absDiff(mp_limb_t *dp, const mp_limb_t *xp, mp_size_t n, const mp_limb_t *yp, mp_size_t yn)
+{
+    if (yn > n && yp[n] != 0)
+    {
+        dp[n] = yp[n] - mpn_sub_n(dp, yp, xp, n);
+        return true;
+    }
+    if (yn > n) dp[n] = 0;
+    if (mpn_cmp(xp, yp, n) >= 0)
+    {
+        mpn_sub_n(dp, xp, yp, n);
+        return false;
+    }
+    mpn_sub_n(dp, yp, xp, n);
+    return true;
+}
+
+// Karatsuba multiplication.  With a = a1*B^h + a0 and b = b1*B^h + b0,
+// a*b = z2*B^2h + (z0 + z2 - (a0-a1)*(b0-b1))*B^h + z0
+// where z0 = a0*b0 and z2 = a1*b1.
+static void mulKaratsuba(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n, mp_limb_t *tp)
+{
+    mp_size_t h = n/2, hh = n - h;
+    mp_limb_t *du = tp, *dv = tp + hh, *z1 = tp + 2*hh, *mid = tp + 4*hh, *next = tp + 6*hh + 1;
+
+    bool negU = absDiff(du, up, h, up+h, hh);
+    bool negV = absDiff(dv, vp, h, vp+h, hh);
+
+    mulN(rp, up, vp, h, next);
+    mulN(rp+2*h, up+h, vp+h, hh, next);
+    mulN(z1, du, dv, hh, next);
+
+    // mid = z0 + z2
+    mp_limb_t carry = mpn_add_n(mid, rp+2*h, rp, 2*h);
+    if (hh != h) carry = mpn_add_1(mid+2*h, rp+4*h, 2, carry);
+    mid[2*hh] = carry;
+    if (negU == negV)
+        mid[2*hh] -= mpn_sub_n(mid, mid, z1, 2*hh);
+    else mid[2*hh] += mpn_add_n(mid, mid, z1, 2*hh);
+
+    addAt(rp, 2*n, h, mid, 2*hh+1);
+}
+
+// Negate a two's complement number if it is negative.  Returns true if it was.
+static bool absTwos(mp_limb_t *p, mp_size_t n)
+{
+    if ((p[n-1] & TOP_BIT) == 0) return false;
+    for (mp_size_t i = 0; i < n; i++) p[i] = ~p[i];
+    mpn_add_1(p, p, n, 1);
+    return true;
+}
+
+static void negTwos(mp_limb_t *p, mp_size_t n)
+{
+    for (mp_size_t i = 0; i < n; i++) p[i] = ~p[i];
+    mpn_add_1(p, p, n, 1);
+}
+
+// Arithmetic shift right of a two's complement number by one bit.
+static void halveTwos(mp_limb_t *p, mp_size_t n)
+{
+    mp_limb_t sign = p[n-1] & TOP_BIT;
+    mpn_rshift(p, p, n, 1);
+    p[n-1] |= sign;
+}
+
+// Divide by three a number that is known to be a multiple of three.  This
+// works modulo B^n so it is also correct for two's complement numbers.
+static void divExactBy3(mp_limb_t *p, mp_size_t n)
+{
+    const mp_limb_t inv3 = (~(mp_limb_t)0 / 3) * 2 + 1; // 3*inv3 = 1 mod B
+    mp_limb_t carry = 0;
+    for (mp_size_t i = 0; i < n; i++)
+    {
+        mp_limb_t s = p[i];
+        mp_limb_t l = s - carry;
+        carry = l > s;
+        mp_limb_t q = l * inv3;
+        p[i] = q;
+        mp_limb_t hi, lo;
+        umul_ppmm(hi, lo, q, 3);
+        carry += hi;
+    }
+}
+
+// Evaluate a = a2*x^2 + a1*x + a0 at 1, -1 and -2.  Each result has k+1 limbs.
+// The values at -1 and -2 are returned as magnitudes with their signs.
+static void toom3Evaluate(const mp_limb_t *ap, mp_size_t k, mp_size_t hl,
+                          mp_limb_t *e1, mp_limb_t *em1, bool &negM1, mp_limb_t *em2, bool &negM2)
+{
+    const mp_limb_t *a0 = ap, *a1 = ap + k, *a2 = ap + 2*k;
+    // a0 + a2 in em2 temporarily.
+    memcpy(em2, a0, k * sizeof(mp_limb_t));
+    em2[k] = 0;
+    addTo(em2, k+1, a2, hl);
+    // a(1) = a0 + a2 + a1
+    e1[k] = em2[k] + mpn_add_n(e1, em2, a1, k);
+    // a(-1) = a0 + a2 - a1 as a two's complement number.
+    em1[k] = em2[k] - mpn_sub_n(em1, em2, a1, k);
+    // a(-2) = 2*(a(-1) + a2) - a0
+    memcpy(em2, em1, (k+1) * sizeof(mp_limb_t));
+    addTo(em2, k+1, a2, hl);
+    mpn_lshift(em2, em2, k+1, 1);
+    subFrom(em2, k+1, a0, k);
+    negM1 = absTwos(em1, k+1);
+    negM2 = absTwos(em2, k+1);
+}
+
+// Toom-3 multiplication.  The operands are split into three parts and the
+// product polynomial is found from its values at 0, 1, -1, -2 and infinity
+// using Bodrato's interpolation sequence.  The intermediate values are held
+// as two's complement numbers of 2k+2 limbs.
+static void mulToom3(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n, mp_limb_t *tp)
+{
+    mp_size_t k = (n + 2) / 3, hl = n - 2*k, l = 2*k + 2;
+    mp_limb_t *u1 = tp, *um1 = u1 + k+1, *um2 = um1 + k+1;
+    mp_limb_t *v1 = um2 + k+1, *vm1 = v1 + k+1, *vm2 = vm1 + k+1;
+    mp_limb_t *r1 = vm2 + k+1, *rm1 = r1 + l, *rm2 = rm1 + l, *next = rm2 + l;
+    bool negUm1, negUm2, negVm1, negVm2;
+
+    toom3Evaluate(up, k, hl, u1, um1, negUm1, um2, negUm2);
+    toom3Evaluate(vp, k, hl, v1, vm1, negVm1, vm2, negVm2);
+
+    mulN(r1, u1, v1, k+1, next);
+    mulN(rm1, um1, vm1, k+1, next);
+    if (negUm1 != negVm1) negTwos(rm1, l);
+    mulN(rm2, um2, vm2, k+1, next);
+    if (negUm2 != negVm2) negTwos(rm2, l);
+    // The values at 0 and infinity go directly into the result.
+    const mp_limb_t *r0 = rp, *rinf = rp + 4*k;
+    mulN(rp, up, vp, k, next);
+    mulN(rp + 4*k, up + 2*k, vp + 2*k, hl, next);
+
+    // rm2 = (r(-2) - r(1))/3
+    mpn_sub_n(rm2, rm2, r1, l);
+    divExactBy3(rm2, l);
+    // r1 = (r(1) - r(-1))/2
+    mpn_sub_n(r1, r1, rm1, l);
+    halveTwos(r1, l);
+    // rm1 = r(-1) - r(0)
+    subFrom(rm1, l, r0, 2*k);
+    // rm2 = (rm1 - rm2)/2 + 2*r(inf): this is the coefficient of x^3
+    mpn_sub_n(rm2, rm1, rm2, l);
+    halveTwos(rm2, l);
+    addTo(rm2, l, rinf, 2*hl);
+    addTo(rm2, l, rinf, 2*hl);
+    // rm1 = rm1 + r1 - r(inf): the coefficient of x^2
+    mpn_add_n(rm1, rm1, r1, l);
+    subFrom(rm1, l, rinf, 2*hl);
+    // r1 = r1 - rm2: the coefficient of x
+    mpn_sub_n(r1, r1, rm2, l);
+
+    memset(rp + 2*k, 0, 2*k * sizeof(mp_limb_t));
+    addAt(rp, 2*n, k, r1, l);
+    addAt(rp, 2*n, 2*k, rm1, l);
+    addAt(rp, 2*n, 3*k, rm2, l);
+}
+
+// Multiply two numbers of n limbs each.  tp must have mulNScratch(n) limbs.
+static void mulN(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n, mp_limb_t *tp)
+{
+    if (n < MUL_KARATSUBA_THRESHOLD)
+        mulBasecase(rp, up, n, vp, n);
+    else if (n < MUL_TOOM3_THRESHOLD)
+        mulKaratsuba(rp, up, vp, n, tp);
+    else mulToom3(rp, up, vp, n, tp);
+}
+
+mp_limb_t mpn_mul(mp_limb_t *rp, const mp_limb_t *up, mp_size_t un, const mp_limb_t *vp, mp_size_t vn)
+{
+    ASSERT(un >= vn && vn >= 1);
+    if (vn < MUL_KARATSUBA_THRESHOLD)
+    {
+        mulBasecase(rp, up, un, vp, vn);
+        return rp[un+vn-1];
+    }
+    LimbBuffer work(mulNScratch(vn) + 2*vn);
+    mp_limb_t *tp = work.limbs;
+    mp_limb_t *prod = tp + mulNScratch(vn);
+    mulN(rp, up, vp, vn, tp);
+    // If u is longer multiply it in pieces of vn limbs.
+    mp_size_t off = vn;
+    for (; un - off >= vn; off += vn)
+    {
+        mulN(prod, up+off, vp, vn, tp);
+        mp_limb_t carry = mpn_add_n(rp+off, rp+off, prod, vn);
+        mpn_add_1(rp+off+vn, prod+vn, vn, carry);
+    }
+    if (off < un)
+    {
+        mp_size_t rest = un - off;
+        mpn_mul(prod, vp, vn, up+off, rest);
+        mp_limb_t carry = mpn_add_n(rp+off, rp+off, prod, vn);
+        mpn_add_1(rp+off+vn, prod+vn, rest, carry);
+    }
+    return rp[un+vn-1];
+}
+
+mp_limb_t mpn_divrem_1(mp_limb_t *qp, mp_size_t qxn, const mp_limb_t *np, mp_size_t nn, mp_limb_t d)
+{
+    ASSERT(qxn == 0);
+    if (nn == 0) return 0;
+    unsigned cnt = count_leading_zeros(d);
+    d <<= cnt;
+    mp_limb_t dinv = invert_limb(d);
+    mp_limb_t r = 0;
+    if (cnt == 0)
+    {
+        for (mp_size_t i = nn; i > 0; i--)
+            qp[i-1] = udiv_qrnnd_preinv(r, r, np[i-1], d, dinv);
+        return r;
+    }
+    // Shift the numerator as we go.
+    r = np[nn-1] >> (GMP_LIMB_BITS - cnt);
+    for (mp_size_t i = nn; i > 0; i--)
+    {
+        mp_limb_t n0 = np[i-1] << cnt;
+        if (i > 1) n0 |= np[i-2] >> (GMP_LIMB_BITS - cnt);
+        qp[i-1] = udiv_qrnnd_preinv(r, r, n0, d, dinv);
+    }
+    return r >> cnt;
+}
+
+// Knuth's algorithm D.  Divides the nn limbs of np by the normalised dn limbs of
+// dp, dn >= 2, putting nn-dn quotient limbs in qp and the remainder in the low dn
+// limbs of np.  Returns the extra high limb of the quotient, which is 0 or 1.
+static mp_limb_t divSchool(mp_limb_t *qp, mp_limb_t *np, mp_size_t nn, const mp_limb_t *dp, mp_size_t dn, mp_limb_t dinv)
+{
+    mp_limb_t qh = mpn_cmp(np + nn - dn, dp, dn) >= 0;
+    if (qh) mpn_sub_n(np + nn - dn, np + nn - dn, dp, dn);
+    mp_limb_t d1 = dp[dn-1], d0 = dp[dn-2];
+    for (mp_size_t i = nn - dn; i > 0; i--)
+    {
+        mp_limb_t *w = np + i - 1; // The current dn+1 limbs
+        mp_limb_t n2 = w[dn], n1 = w[dn-1], n0 = w[dn-2];
+        mp_limb_t q, r;
+        bool rOverflow;
+        // Estimate the quotient digit from the top two limbs and then refine it
+        // using the next limb of the divisor.  It is then at most one too large.
+        if (n2 == d1) { q = ~(mp_limb_t)0; r = n1 + d1; rOverflow = r < d1; }
+        else { q = udiv_qrnnd_preinv(r, n2, n1, d1, dinv); rOverflow = false; }
+        while (! rOverflow)
+        {
+            mp_limb_t ph, pl;
+            umul_ppmm(ph, pl, q, d0);
+            if (ph < r || (ph == r && pl <= n0)) break;
+            q--;
+            r += d1;
+            rOverflow = r < d1;
+        }
+        mp_limb_t borrow = mpn_submul_1(w, dp, dn, q);
+        if (n2 < borrow)
+        {
+            q--;
+            mpn_add_n(w, w, dp, dn);
+        }
+        w[dn] = 0;
+        qp[i-1] = q;
+    }
+    return qh;
+}
+
+// Recursive division.  Divides the 2n limbs of np by the normalised n limbs of dp
+// putting the low n limbs of the quotient in qp and the remainder in the low n limbs
+// of np.  Returns the high limb of the quotient.  Each half of the quotient is found
+// by dividing by the high half of the divisor and then correcting with the product
+// of that quotient and the low half.  tp must have n limbs.
+static mp_limb_t divRecursive(mp_limb_t *qp, mp_limb_t *np, const mp_limb_t *dp, mp_size_t n, mp_limb_t dinv, mp_limb_t *tp)
+{
+    mp_size_t lo = n / 2, hi = n - lo;
+    mp_limb_t qh, ql, borrow;
+
+    if (hi < DIV_DC_THRESHOLD)
+        qh = divSchool(qp + lo, np + 2*lo, 2*hi, dp + lo, hi, dinv);
+    else qh = divRecursive(qp + lo, np + 2*lo, dp + lo, hi, dinv, tp);
+
+    mpn_mul(tp, qp + lo, hi, dp, lo);
+    borrow = mpn_sub_n(np + lo, np + lo, tp, n);
+    if (qh != 0)
+        borrow += mpn_sub_n(np + n, np + n, dp, lo);
+    while (borrow != 0)
+    {
+        qh -= mpn_sub_1(qp + lo, qp + lo, hi, 1);
+        borrow -= mpn_add_n(np + lo, np + lo, dp, n);
+    }
+
+    if (lo < DIV_DC_THRESHOLD)
+        ql = divSchool(qp, np + hi, 2*lo, dp + hi, lo, dinv);
+    else ql = divRecursive(qp, np + hi, dp + hi, lo, dinv, tp);
+
+    mpn_mul(tp, dp, hi, qp, lo);
+    borrow = mpn_sub_n(np, np, tp, n);
+    if (ql != 0)
+        borrow += mpn_sub_n(np + lo, np + lo, dp, hi);
+    while (borrow != 0)
+    {
+        mpn_sub_1(qp, qp, lo, 1);
+        borrow -= mpn_add_n(np, np, dp, n);
+    }
+    return qh;
+}
+
+void mpn_tdiv_qr(mp_limb_t *qp, mp_limb_t *rp, mp_size_t qxn,
+                 const mp_limb_t *np, mp_size_t nn, const mp_limb_t *dp, mp_size_t dn)
+{
+    ASSERT(qxn == 0 && nn >= dn && dn >= 1 && dp[dn-1] != 0);
+    if (dn == 1)
+    {
+        rp[0] = mpn_divrem_1(qp, 0, np, nn, dp[0]);
+        return;
+    }
+    mp_size_t qn = nn - dn + 1;
+    // Shift the divisor so that its top bit is set and the dividend by the same
+    // amount into an extra limb.  For the recursive method the dividend is then
+    // padded with zeros to a whole number of blocks of dn limbs and the quotient
+    // is found one block at a time.
+    bool recursive = dn >= DIV_DC_THRESHOLD && qn >= DIV_DC_THRESHOLD;
+    mp_size_t padded = recursive ? ((nn + dn) / dn) * dn : nn + 1;
+    LimbBuffer work(2*padded + dn);
+    mp_limb_t *d = work.limbs;
+    mp_limb_t *n = d + dn, *q = n + padded, *tp = q + padded - dn;
+    unsigned cnt = count_leading_zeros(dp[dn-1]);
+    if (cnt != 0)
+    {
+        mpn_lshift(d, dp, dn, cnt);
+        n[nn] = mpn_lshift(n, np, nn, cnt);
+    }
+    else
+    {
+        memcpy(d, dp, dn * sizeof(mp_limb_t));
+        memcpy(n, np, nn * sizeof(mp_limb_t));
+        n[nn] = 0;
+    }
+    mp_limb_t dinv = invert_limb(d[dn-1]);
+
+    if (recursive)
+    {
+        memset(n + nn + 1, 0, (padded - nn - 1) * sizeof(mp_limb_t));
+        // The top block is less than the divisor because its high limb is zero
+        // or is the limb shifted out of the dividend.
+        for (mp_size_t i = padded/dn - 1; i > 0; i--)
+            (void)divRecursive(q + (i-1)*dn, n + (i-1)*dn, d, dn, dinv, tp);
+        memcpy(qp, q, qn * sizeof(mp_limb_t));
+    }
+    else (void)divSchool(qp, n, nn + 1, d, dn, dinv);
+
+    if (cnt != 0)
+        mpn_rshift(rp, n, dn, cnt);
+    else memcpy(rp, n, dn * sizeof(mp_limb_t));
+}
+
+// Radix conversion.  If the base is a power of two each digit is a group of
+// bits.  Otherwise a limb holds digitsPerLimb digits and numbers are split in
+// half by the powers bigBase^(2^i), where bigBase is base^digitsPerLimb, and
+// each half converted recursively.  The cost then follows that of division or
+// multiplication.  Short numbers are converted by repeated division or
+// multiplication by bigBase.
+
+// The number of bits in a digit if the base is a power of two, otherwise zero.
+static unsigned bitsPerDigit(int base)
+{
+    unsigned bits = 0;
+    while ((1 << bits) < base) bits++;
+    return (1 << bits) == base ? bits : 0;
+}
+
+class RadixPowers
+{
+public:
+    RadixPowers(int b);
+    ~RadixPowers();
+    void Extend(mp_size_t n);
+
+    int base;
+    unsigned digitsPerLimb;
+    mp_limb_t bigBase;
+    // power[i] is bigBase^(2^i), size[i] limbs long, and is base^digits[i].
+    unsigned levels;
+    mp_limb_t *power[GMP_LIMB_BITS];
+    mp_size_t size[GMP_LIMB_BITS];
+    size_t digits[GMP_LIMB_BITS];
+};
+
+RadixPowers::RadixPowers(int b): base(b)
+{
+    digitsPerLimb = 1;
+    bigBase = b;
+    while (bigBase <= (mp_limb_t)-1 / b)
+    {
+        bigBase *= b;
+        digitsPerLimb++;
+    }
+    power[0] = allocLimbs(1);
+    power[0][0] = bigBase;
+    size[0] = 1;
+    digits[0] = digitsPerLimb;
+    levels = 1;
+}
+
+RadixPowers::~RadixPowers()
+{
+    for (unsigned i = 0; i < levels; i++)
+        free(power[i]);
+}
+
+// Add powers until the last one is at least half the size of n limbs.
+void RadixPowers::Extend(mp_size_t n)
+{
+    while (size[levels-1]*2 <= n && levels < GMP_LIMB_BITS)
+    {
+        mp_size_t pn = size[levels-1];
+        // Add it to the table first so that the destructor frees it if
+        // mpn_mul throws.
+        mp_limb_t *p = power[levels] = allocLimbs(2*pn);
+        levels++;
+        mpn_mul(p, power[levels-2], pn, power[levels-2], pn);
+        size[levels-1] = p[2*pn-1] == 0 ? 2*pn-1 : 2*pn;
+        digits[levels-1] = digits[levels-2]*2;
+    }
+}
+
+// Convert the un limbs of up, which are overwritten, to digits at str.  If
+// len is non-zero exactly len digits are produced, with leading zeros,
+// otherwise as many as needed.  Returns the number of digits.
+static size_t getStrBasecase(unsigned char *str, size_t len, mp_limb_t *up, mp_size_t un, const RadixPowers &pw)
+{
+    // The digits are produced least significant first.
+    unsigned char buff[GET_STR_DC_THRESHOLD * GMP_LIMB_BITS];
+    size_t n = 0;
+    while (un > 0 && up[un-1] == 0) un--;
+    while (un > 0)
+    {
+        mp_limb_t r = mpn_divrem_1(up, 0, up, un, pw.bigBase);
+        if (up[un-1] == 0) un--;
+        // Every digit of the limb is needed unless this is the most significant.
+        for (unsigned j = 0; j < pw.digitsPerLimb && (un != 0 || r != 0); j++)
+        {
+            buff[n++] = (unsigned char)(r % pw.base);
+            r /= pw.base;
+        }
+    }
+    size_t i = 0;
+    for (; i + n < len; i++) str[i] = 0;
+    while (n > 0) str[i++] = buff[--n];
+    return i;
+}
+
+static size_t getStrRec(unsigned char *str, size_t len, mp_limb_t *up, mp_size_t un, const RadixPowers &pw)
+{
+    while (un > 0 && up[un-1] == 0) un--;
+    if (un < GET_STR_DC_THRESHOLD)
+        return getStrBasecase(str, len, up, un, pw);
+    // Choose a power no more than half the size.  The number is then larger
+    // than the power so the quotient is non-zero.
+    unsigned i = pw.levels - 1;
+    while (i > 0 && pw.size[i]*2 > un+1) i--;
+    mp_size_t pn = pw.size[i], qn = un - pn + 1;
+    LimbBuffer work(qn + pn);
+    mp_limb_t *qp = work.limbs, *rp = qp + qn;
+    mpn_tdiv_qr(qp, rp, 0, up, un, pw.power[i], pn);
+    size_t n = getStrRec(str, len == 0 ? 0 : len - pw.digits[i], qp, qn, pw);
+    n += getStrRec(str + n, pw.digits[i], rp, pn, pw);
+    return n;
+}
+
+size_t mpn_get_str(unsigned char *str, int base, mp_limb_t *up, mp_size_t un)
+{
+    ASSERT(un >= 1 && up[un-1] != 0);
+    unsigned bits = bitsPerDigit(base);
+    if (bits != 0)
+    {
+        size_t nbits = un * GMP_LIMB_BITS - count_leading_zeros(up[un-1]);
+        size_t n = (nbits + bits - 1) / bits;
+        for (size_t d = 0; d < n; d++)
+        {
+            size_t bit = (n - 1 - d) * bits;
+            mp_size_t limb = bit / GMP_LIMB_BITS;
+            unsigned offset = bit % GMP_LIMB_BITS;
+            mp_limb_t v = up[limb] >> offset;
+            if (offset + bits > GMP_LIMB_BITS && limb + 1 < un)
+                v |= up[limb+1] << (GMP_LIMB_BITS - offset);
+            str[d] = (unsigned char)(v & ((1 << bits) - 1));
+        }
+        return n;
+    }
+    RadixPowers pw(base);
+    pw.Extend(un);
+    return getStrRec(str, 0, up, un, pw);
+}
+
+// Convert len digits at str to limbs at rp.  Returns the number of limbs
+// after removing high-order zeros.  rp must have space for one more limb
+// than the result.
+static mp_size_t setStrBasecase(mp_limb_t *rp, const unsigned char *str, size_t len, const RadixPowers &pw)
+{
+    mp_size_t rn = 0;
+    size_t chunk = len % pw.digitsPerLimb;
+    if (chunk == 0) chunk = pw.digitsPerLimb;
+    for (size_t i = 0; i < len; i += chunk, chunk = pw.digitsPerLimb)
+    {
+        mp_limb_t v = 0;
+        for (size_t j = 0; j < chunk; j++)
+            v = v * pw.base + str[i+j];
+        if (rn == 0)
+        {
+            if (v != 0) rp[rn++] = v;
+        }
+        else
+        {
+            // The first chunk may be short but after that all are full limbs.
+            mp_limb_t carry = mpn_mul_1(rp, rp, rn, pw.bigBase);
+            carry += mpn_add_1(rp, rp, rn, v);
+            if (carry != 0) rp[rn++] = carry;
+        }
+    }
+    return rn;
+}
+
+static mp_size_t setStrRec(mp_limb_t *rp, const unsigned char *str, size_t len, const RadixPowers &pw)
+{
+    if (len < SET_STR_DC_THRESHOLD * pw.digitsPerLimb)
+        return setStrBasecase(rp, str, len, pw);
+    // Split off the low digits[i] digits, no more than half of them.
+    unsigned i = pw.levels - 1;
+    while (i > 0 && pw.digits[i]*2 > len) i--;
+    size_t lowLen = pw.digits[i], highLen = len - lowLen;
+    mp_size_t pn = pw.size[i], hmax = highLen / pw.digitsPerLimb + 2;
+    // The low part is less than the power so fits in pn limbs plus one spare.
+    LimbBuffer work(hmax + pn + 1);
+    mp_limb_t *hp = work.limbs, *lp = hp + hmax;
+    mp_size_t hn = setStrRec(hp, str, highLen, pw);
+    mp_size_t ln = setStrRec(lp, str + highLen, lowLen, pw);
+    mp_size_t rn;
+    if (hn == 0)
+    {
+        memcpy(rp, lp, ln * sizeof(mp_limb_t));
+        rn = ln;
+    }
+    else
+    {
+        if (hn >= pn)
+            mpn_mul(rp, hp, hn, pw.power[i], pn);
+        else mpn_mul(rp, pw.power[i], pn, hp, hn);
+        rn = hn + pn;
+        if (ln != 0) addTo(rp, rn, lp, ln);
+        while (rn > 0 && rp[rn-1] == 0) rn--;
+    }
+    return rn;
+}
+
+mp_size_t mpn_set_str(mp_limb_t *rp, const unsigned char *str, size_t len, int base)
+{
+    unsigned bits = bitsPerDigit(base);
+    mp_size_t rn = 0;
+    if (bits != 0)
+    {
+        // Pack the bits starting from the least significant digit.
+        mp_limb_t acc = 0;
+        unsigned accBits = 0;
+        for (size_t i = len; i > 0; i--)
+        {
+            mp_limb_t d = str[i-1];
+            acc |= d << accBits;
+            accBits += bits;
+            if (accBits >= GMP_LIMB_BITS)
+            {
+                rp[rn++] = acc;
+                accBits -= GMP_LIMB_BITS;
+                acc = accBits == 0 ? 0 : d >> (bits - accBits);
+            }
+        }
+        if (accBits != 0) rp[rn++] = acc;
+        while (rn > 0 && rp[rn-1] == 0) rn--;
+        return rn;
+    }
+    RadixPowers pw(base);
+    pw.Extend(len / pw.digitsPerLimb + 1);
+    return setStrRec(rp, str, len, pw);
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+    Title:  arbmpn.h - Natural number arithmetic for builds without GMP
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef ARBMPN_H_INCLUDED
+#define ARBMPN_H_INCLUDED
+
+// When GMP is not available these provide the subset of the GMP "mpn"
+// interface used by arb.cpp so that there is only one version of the
+// arbitrary precision code.  A limb is a Poly word.  The functions have
+// the same names, arguments and results as the GMP versions, and the same
+// restrictions on overlapping arguments, except that a result must never
+// overlap an argument in mpn_mul or mpn_tdiv_qr.  Lengths are in limbs.
+// mpn_mul, mpn_tdiv_qr, mpn_get_str and mpn_set_str may need a work area and
+// throw MemoryException if it cannot be allocated.
+// globals.h must be included before this.
+
+typedef POLYUNSIGNED mp_limb_t;
+typedef POLYSIGNED mp_size_t;
+
+#define GMP_LIMB_BITS   (SIZEOF_VOIDP*8)
+#define GMP_NUMB_BITS   GMP_LIMB_BITS
+
+extern mp_limb_t mpn_add_n(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n);
+extern mp_limb_t mpn_add_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v);
+extern mp_limb_t mpn_sub_n(mp_limb_t *rp, const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n);
+extern mp_limb_t mpn_sub_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v);
+extern int mpn_cmp(const mp_limb_t *up, const mp_limb_t *vp, mp_size_t n);
+
+// Shift by 1 to GMP_LIMB_BITS-1 bits.  Return the bits shifted out.
+extern mp_limb_t mpn_lshift(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, unsigned cnt);
+extern mp_limb_t mpn_rshift(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, unsigned cnt);
+
+extern mp_limb_t mpn_mul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v);
+extern mp_limb_t mpn_addmul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v);
+extern mp_limb_t mpn_submul_1(mp_limb_t *rp, const mp_limb_t *up, mp_size_t n, mp_limb_t v);
+
+// Set rp to the un+vn limb product.  Requires un >= vn >= 1.
+extern mp_limb_t mpn_mul(mp_limb_t *rp, const mp_limb_t *up, mp_size_t un, const mp_limb_t *vp, mp_size_t vn);
+
+// Divide np by the single limb d.  qxn must be zero.  Returns the remainder.
+extern mp_limb_t mpn_divrem_1(mp_limb_t *qp, mp_size_t qxn, const mp_limb_t *np, mp_size_t nn, mp_limb_t d);
+
+// Set qp to the nn-dn+1 limb quotient and rp to the dn limb remainder.
+// Requires nn >= dn >= 1, dp[dn-1] != 0 and qxn == 0.
+extern void mpn_tdiv_qr(mp_limb_t *qp, mp_limb_t *rp, mp_size_t qxn,
+                        const mp_limb_t *np, mp_size_t nn, const mp_limb_t *dp, mp_size_t dn);
+
+// Convert to and from strings of digits, most significant first.  The digits
+// are values from 0 to base-1 not characters.  For mpn_get_str the top limb
+// must be non-zero and str must have space for the largest number of un limbs
+// plus one; up is overwritten.  mpn_set_str returns the number of limbs with
+// high-order zeros removed and rp must have space for one more limb than the
+// largest number of len digits.
+extern size_t mpn_get_str(unsigned char *str, int base, mp_limb_t *up, mp_size_t un);
+extern mp_size_t mpn_set_str(mp_limb_t *rp, const unsigned char *str, size_t len, int base);
+
+#endif
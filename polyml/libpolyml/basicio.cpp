@@ -145,6 +145,7 @@ typedef char TCHAR;
 #include "mpoly.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "locking.h"
 
 #if (defined(_WIN32) && ! defined(__CYGWIN__))
@@ -190,7 +191,7 @@ DCJM May 2000
 */
 
 PIOSTRUCT basic_io_vector;
-PLock ioLock; // Currently this just protects against two threads using the same entry
+PLock ioLock("IO"); // Currently this just protects against two threads using the same entry
 
 #if (defined(_WIN32) && ! defined(__CYGWIN__))
 class WaitStream: public WaitHandle
@@ -1533,6 +1534,7 @@ Handle fileAccess(TaskData *taskData, Handle name, Handle rights)
 Handle IO_dispatch_c(TaskData *taskData, Handle args, Handle strm, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORD(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 0: /* Return standard input */
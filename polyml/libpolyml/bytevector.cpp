@@ -0,0 +1,265 @@
+/*
+    Title:  bytevector.cpp - Bulk operations on byte vectors
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+Parsers written in ML look at one byte at a time and each Word8Vector.sub
+checks the subscript.  These functions scan a whole slice in one call.  They
+are used by PolyML.Bytes.  Searching uses memchr, which is usually vectorised.
+UTF-8 validation skips eight ASCII bytes at a time and the case folding loop
+has no branches so that the compiler can vectorise it.
+
+Allocating the result may cause a garbage collection so the arguments are
+always dereferenced again after an allocation.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "globals.h"
+#include "bytevector.h"
+#include "polystring.h"
+#include "run_time.h"
+#include "mpoly.h"
+#include "sys.h"
+#include "arb.h"
+#include "save_vec.h"
+#include "processes.h"
+
+#define SAVE(x) taskData->saveVec.push(x)
+
+// An empty vector of words.
+static Handle emptyVector(TaskData *taskData)
+{
+    return SAVE((PolyObject*)IoEntry(POLY_SYS_nullvector));
+}
+
+// Get the slice in items 1 to 3 of the argument.  Item 0 is the byte, the set,
+// the count or the mode.  "single" must remain valid while the result is used.
+static const byte *byteSlice(TaskData *taskData, Handle args, char *single, POLYUNSIGNED *length)
+{
+    return (const byte *)stringSliceArg(taskData, DEREFHANDLE(args), 1, single, length);
+}
+
+// Return the offset of the first occurrence of a byte in a slice or ~1.
+// The argument is (b, v, i, l).
+Handle findByte(TaskData *taskData, Handle args)
+{
+    unsigned b = get_C_unsigned(taskData, DEREFHANDLE(args)->Get(0));
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    const byte *p = (const byte *)memchr(bytes, b, length);
+    return SAVE(TAGGED(p == 0 ? -1 : (POLYSIGNED)(p - bytes)));
+}
+
+// Return the offset of the first byte in a slice that is in a set, given as a
+// vector of bytes, or ~1.  The argument is (set, v, i, l).
+Handle findAnyByte(TaskData *taskData, Handle args)
+{
+    char setSingle;
+    POLYUNSIGNED setLength;
+    const byte *set = (const byte *)stringChars(DEREFHANDLE(args)->Get(0), &setSingle, &setLength);
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    if (setLength == 0) return SAVE(TAGGED(-1));
+    if (setLength == 1)
+    {
+        const byte *p = (const byte *)memchr(bytes, set[0], length);
+        return SAVE(TAGGED(p == 0 ? -1 : (POLYSIGNED)(p - bytes)));
+    }
+    bool inSet[256];
+    memset(inSet, 0, sizeof(inSet));
+    for (POLYUNSIGNED i = 0; i < setLength; i++) inSet[set[i]] = true;
+    POLYUNSIGNED i = 0;
+    // Test four bytes at a time.
+    for (; i + 4 <= length; i += 4)
+    {
+        if (inSet[bytes[i]] | inSet[bytes[i+1]] | inSet[bytes[i+2]] | inSet[bytes[i+3]])
+            break;
+    }
+    for (; i < length; i++)
+    {
+        if (inSet[bytes[i]]) return SAVE(TAGGED(i));
+    }
+    return SAVE(TAGGED(-1));
+}
+
+// Return an int vector containing the offsets of every occurrence of a delimiter
+// byte in a slice.  The fields are the bytes between them.  The argument is (b, v, i, l).
+Handle splitBytes(TaskData *taskData, Handle args)
+{
+    unsigned b = get_C_unsigned(taskData, DEREFHANDLE(args)->Get(0));
+    POLYUNSIGNED count = 0;
+    {
+        char single;
+        POLYUNSIGNED length;
+        const byte *bytes = byteSlice(taskData, args, &single, &length);
+        const byte *p = bytes, *end = bytes + length;
+        while ((p = (const byte *)memchr(p, b, end - p)) != 0) { count++; p++; }
+    }
+    if (count == 0) return emptyVector(taskData);
+    if (count > MAX_OBJECT_SIZE) raise_exception0(taskData, EXC_size);
+    Handle result = alloc_and_save(taskData, count);
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    const byte *p = bytes, *end = bytes + length;
+    PolyObject *vec = DEREFHANDLE(result);
+    for (POLYUNSIGNED i = 0; i < count; i++)
+    {
+        p = (const byte *)memchr(p, b, end - p);
+        vec->Set(i, TAGGED(p - bytes));
+        p++;
+    }
+    return result;
+}
+
+// True if the eight bytes from p are all ASCII.
+static inline bool allAscii(const byte *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return (w & 0x8080808080808080ULL) == 0;
+}
+
+// Decode one non-ASCII character.  Returns the number of bytes or zero if
+// this is not well-formed UTF-8: a bad lead or continuation byte, a truncated
+// sequence, an over-long encoding, a surrogate or a value above 0x10FFFF.
+static inline unsigned decodeChar(const byte *p, const byte *end, unsigned *result)
+{
+    unsigned c = p[0], n, minValue;
+    if (c < 0xc2) return 0; // Continuation byte or over-long two-byte sequence.
+    else if (c < 0xe0) { n = 2; c &= 0x1f; minValue = 0x80; }
+    else if (c < 0xf0) { n = 3; c &= 0x0f; minValue = 0x800; }
+    else if (c < 0xf5) { n = 4; c &= 0x07; minValue = 0x10000; }
+    else return 0;
+    if ((POLYUNSIGNED)(end - p) < n) return 0;
+    for (unsigned i = 1; i < n; i++)
+    {
+        if ((p[i] & 0xc0) != 0x80) return 0;
+        c = (c << 6) | (p[i] & 0x3f);
+    }
+    if (c < minValue || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) return 0;
+    *result = c;
+    return n;
+}
+
+// Return the number of characters in a slice of UTF-8 or ~1 if it is not
+// valid.  The argument is (0, v, i, l).
+Handle countUtf8(TaskData *taskData, Handle args)
+{
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    const byte *p = bytes, *end = bytes + length;
+    POLYUNSIGNED count = 0;
+    while (p < end)
+    {
+        if (end - p >= 8 && allAscii(p)) { p += 8; count += 8; }
+        else if (*p < 0x80) { p++; count++; }
+        else
+        {
+            unsigned c, n = decodeChar(p, end, &c);
+            if (n == 0) return SAVE(TAGGED(-1));
+            p += n;
+            count++;
+        }
+    }
+    return SAVE(TAGGED(count));
+}
+
+// Decode a slice of UTF-8 into a vector of words.  The argument is (n, v, i, l)
+// where n is the number of characters returned by countUtf8.
+Handle decodeUtf8(TaskData *taskData, Handle args)
+{
+    POLYUNSIGNED count = get_C_ulong(taskData, DEREFHANDLE(args)->Get(0));
+    if (count == 0) return emptyVector(taskData);
+    // The count comes from ML.  Check it before allocating.
+    if (count > MAX_OBJECT_SIZE) raise_exception0(taskData, EXC_size);
+    Handle result = alloc_and_save(taskData, count);
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    const byte *p = bytes, *end = bytes + length;
+    PolyObject *vec = DEREFHANDLE(result);
+    POLYUNSIGNED i = 0;
+    while (p < end && i < count)
+    {
+        if (*p < 0x80) vec->Set(i++, TAGGED(*p++));
+        else
+        {
+            unsigned c, n = decodeChar(p, end, &c);
+            if (n == 0) break;
+            vec->Set(i++, TAGGED(c));
+            p += n;
+        }
+    }
+    // The count must match.  Check in case the ML code is wrong.
+    if (i != count) raise_exception0(taskData, EXC_size);
+    return result;
+}
+
+// Return a copy of a slice with ASCII letters converted to lower case if the
+// mode is 0 or upper case if it is 1.  Other bytes are unchanged.  The
+// argument is (mode, v, i, l).
+Handle foldAsciiCase(TaskData *taskData, Handle args)
+{
+    bool toUpper = get_C_unsigned(taskData, DEREFHANDLE(args)->Get(0)) != 0;
+    // Bytes from "from" to "from"+25 have bit 0x20 flipped.
+    const unsigned from = toUpper ? 'a' : 'A';
+    POLYUNSIGNED resultLength;
+    {
+        char single;
+        POLYUNSIGNED length;
+        const byte *bytes = byteSlice(taskData, args, &single, &length);
+        resultLength = length;
+        if (length == 0) return SAVE(EmptyString());
+        if (length == 1)
+        {
+            unsigned c = bytes[0];
+            return SAVE(TAGGED(c - from < 26 ? c ^ 0x20 : c));
+        }
+    }
+    Handle result = alloc_and_save(taskData, WORDS(resultLength) + 1, F_BYTE_OBJ);
+    PolyStringObject *str = (PolyStringObject*)DEREFHANDLE(result);
+    str->length = resultLength;
+    char single;
+    POLYUNSIGNED length;
+    const byte *bytes = byteSlice(taskData, args, &single, &length);
+    byte *to = (byte*)str->chars;
+    // This has no branches so the compiler can vectorise it.
+    for (POLYUNSIGNED i = 0; i < length; i++)
+    {
+        unsigned c = bytes[i];
+        to[i] = (byte)(c ^ ((c - from < 26) << 5));
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+/*
+    Title:  bytevector.h - Bulk operations on byte vectors
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef BYTEVECTOR_H_INCLUDED
+#define BYTEVECTOR_H_INCLUDED
+
+class SaveVecEntry;
+typedef SaveVecEntry *Handle;
+class TaskData;
+
+// These operate on slices of Word8Vector.vector or string values passed as
+// the vector, the start and the length.
+extern Handle findByte(TaskData *taskData, Handle args);
+extern Handle findAnyByte(TaskData *taskData, Handle args);
+extern Handle splitBytes(TaskData *taskData, Handle args);
+extern Handle countUtf8(TaskData *taskData, Handle args);
+extern Handle decodeUtf8(TaskData *taskData, Handle args);
+extern Handle foldAsciiCase(TaskData *taskData, Handle args);
+
+#endif
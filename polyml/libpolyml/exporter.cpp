@@ -58,6 +58,7 @@
 #include "osmem.h"
 #include "scanaddrs.h"
 #include "gc.h"
+#include "gctaskfarm.h"
 #include "machine_dep.h"
 #include "diagnostics.h"
 #include "memmgr.h"
@@ -98,6 +99,9 @@ CopyScan::CopyScan(unsigned h/*=0*/): hierarchy(h)
     defaultNoOverSize = 4096; // This can be small.
     tombs = 0;
     graveYard = 0;
+    inLayout = false;
+    dedupTable = 0;
+    dedupObjects = dedupWords = 0;
 }
 
 void CopyScan::initialise(bool isExport/*=true*/)
@@ -109,12 +113,11 @@ void CopyScan::initialise(bool isExport/*=true*/)
     // want to use a smaller size because they are retained after we save
     // the state and if we have many child saved states it's important not
     // to waste memory.
-    if (hierarchy == 0)
-    {
-        graveYard = new GraveYard[gMem.npSpaces];
-        if (graveYard == 0)
-            throw MemoryException();
-    }
+    // Immutable saved state spaces may also be read-only so we may need a
+    // grave-yard even when saving a state.
+    graveYard = new GraveYard[gMem.npSpaces];
+    if (graveYard == 0)
+        throw MemoryException();
     unsigned i;
     for (i = 0; i < gMem.npSpaces; i++)
     {
@@ -127,7 +130,7 @@ void CopyScan::initialise(bool isExport/*=true*/)
                 defaultMutSize += size;
             else
                 defaultImmSize += size;
-            if (space->hierarchy == 0 && ! space->isMutable)
+            if ((space->hierarchy == 0 || space->isReadOnly) && ! space->isMutable)
             {
                 // We need a separate area for the tombstones because this is read-only
                 graveYard[tombs].graves = (PolyWord*)calloc(space->spaceSize(), sizeof(PolyWord));
@@ -164,100 +167,440 @@ void CopyScan::initialise(bool isExport/*=true*/)
     }
 }
 
-CopyScan::~CopyScan()
+/*
+Objects that are in a saved state's parents do not need to be copied.  A code
+or immutable byte object may be replaced by an identical object in the parents.
+Byte objects are identical if they have the same length word and contents, as in
+the sharing phase of the GC.  Code objects can contain relative addresses so
+they are compared after the constants within the code have been set to a value
+that depends only on their offset.  The constants themselves, both those within
+the code and those in the constant area, must refer to identical objects.  These
+are usually closures and strings that have just been compiled along with the
+code so we compare the graphs of the two objects in step.  While we do this each
+object is forwarded to the object in the parents it is assumed to be identical
+to.  That deals with cycles, such as a recursive function whose code refers to
+its own closure, and if the comparison fails the forwarding is removed.
+*/
+
+#define DEDUP_MAX_DEPTH         100     // Give up if the graph is deeper than this
+#define DEDUP_MAX_OBJECTS       10000   // or larger than this.
+#define DEDUP_MAX_CANDIDATES    8       // Number of objects with the same hash to try.
+
+class DedupTable: public ScanAddress
 {
-    gMem.DeleteExportSpaces();
-    if (graveYard)
-        delete[](graveYard);
+public:
+    DedupTable(CopyScan *c): copyScan(c), table(0), tableSize(0),
+        assumed(0), nAssumed(0), maxAssumed(0), current(0), currentObj(0), failed(false) {}
+    ~DedupTable();
+    bool Create(void);
+    PolyObject *FindDuplicate(PolyObject *obj);
+
+    static bool IsCandidate(POLYUNSIGNED lengthWord)
+    {
+        return ! OBJ_IS_MUTABLE_OBJECT(lengthWord) && OBJ_OBJECT_LENGTH(lengthWord) != 0 &&
+            (OBJ_IS_CODE_OBJECT(lengthWord) || OBJ_IS_BYTE_OBJECT(lengthWord));
+    }
+
+private:
+    // A copy of a code object with the constants within the code set to a
+    // fixed value together with the original values.
+    class Normalised
+    {
+    public:
+        Normalised(): buffer(0), consts(0), nConsts(0), maxConsts(0) {}
+        ~Normalised() { free(buffer); free(consts); }
+        PolyWord *buffer;
+        struct CodeConst { POLYUNSIGNED offset; ScanRelocationKind code; PolyWord value; } *consts;
+        POLYUNSIGNED nConsts, maxConsts;
+    };
+
+    bool Normalise(PolyObject *obj, POLYUNSIGNED lengthWord, Normalised *n);
+    POLYUNSIGNED Hash(PolyObject *obj, POLYUNSIGNED lengthWord, Normalised *n);
+    POLYUNSIGNED ValueHash(PolyWord v);
+    bool SameValue(PolyWord x, PolyWord y, unsigned depth);
+    bool SameObject(PolyObject *x, PolyObject *y, unsigned depth);
+    bool Assume(PolyObject *x, POLYUNSIGNED lengthWord, PolyObject *y);
+    void Undo(void);
+    bool InParents(MemSpace *space)
+    {
+        return space != 0 && space->spaceType == ST_PERMANENT &&
+            ((PermanentMemSpace*)space)->hierarchy < copyScan->hierarchy;
+    }
+
+    virtual PolyObject *ScanObjectAddress(PolyObject *base) { return base; }
+    virtual void ScanConstant(byte *addressOfConstant, ScanRelocationKind code);
+
+    CopyScan *copyScan;
+    struct DedupEntry { POLYUNSIGNED hash; PolyObject *obj; } *table;
+    POLYUNSIGNED tableSize; // Power of two.
+    // Objects that have been forwarded while comparing.
+    struct Assumption { PolyObject *obj; POLYUNSIGNED lengthWord; MemSpace *space; } *assumed;
+    POLYUNSIGNED nAssumed, maxAssumed;
+    // Used while normalising.
+    Normalised *current;
+    PolyObject *currentObj;
+    bool failed;
+};
+
+DedupTable::~DedupTable()
+{
+    free(table);
+    free(assumed);
 }
 
+// Called for each constant within a code object.  Record the value and
+// overwrite it in the copy.
+void DedupTable::ScanConstant(byte *addressOfConstant, ScanRelocationKind code)
+{
+    Normalised *n = current;
+    if (n->nConsts == n->maxConsts)
+    {
+        POLYUNSIGNED newMax = n->maxConsts == 0 ? 16 : n->maxConsts * 2;
+        Normalised::CodeConst *newConsts =
+            (Normalised::CodeConst *)realloc(n->consts, newMax * sizeof(Normalised::CodeConst));
+        if (newConsts == 0)
+        {
+            failed = true;
+            return;
+        }
+        n->consts = newConsts;
+        n->maxConsts = newMax;
+    }
+    POLYUNSIGNED offset = addressOfConstant - (byte*)currentObj;
+    Normalised::CodeConst *c = &n->consts[n->nConsts++];
+    c->offset = offset;
+    c->code = code;
+    c->value = GetConstantValue(addressOfConstant, code);
+    // Relative addresses are set to the address of the constant itself and
+    // others to zero so the result does not depend on where the copy is.
+    byte *copyAddr = (byte*)n->buffer + offset;
+    if (code == PROCESS_RELOC_I386RELATIVE)
+        SetConstantValue(copyAddr, PolyWord::FromCodePtr(copyAddr), code);
+    else if (code == PROCESS_RELOC_SPARCRELATIVE)
+        SetConstantValue(copyAddr, PolyWord::FromStackAddr((PolyWord*)copyAddr), code);
+    else
+        SetConstantValue(copyAddr, TAGGED(0), code);
+}
 
-// This function is called for each address in an object
-// once it has been copied to its new location.  We copy first
-// then scan to update the addresses.
-POLYUNSIGNED CopyScan::ScanAddressAt(PolyWord *pt)
+// Make a normalised copy of a code object.  The length word is passed
+// explicitly because the object may have been forwarded.
+bool DedupTable::Normalise(PolyObject *obj, POLYUNSIGNED lengthWord, Normalised *n)
 {
-    PolyWord val = *pt;
-    // Ignore integers.
-    if (IS_INT(val) || val == PolyWord::FromUnsigned(0))
-        return 0;
-    // Ignore pointers to the IO area.  They will be relocated
-    // when we write out the memory
-    MemSpace *space = gMem.SpaceForAddress(val.AsAddress());
-    ASSERT(space != 0);
-    if (space->spaceType == ST_IO)
-        return 0;
+    POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
+    free(n->buffer);
+    n->buffer = (PolyWord*)malloc(words * sizeof(PolyWord));
+    if (n->buffer == 0)
+        return false;
+    memcpy((byte*)n->buffer, (byte*)obj, words * sizeof(PolyWord));
+    n->nConsts = 0;
+    current = n;
+    currentObj = obj;
+    failed = false;
+    machineDependent->ScanConstantsWithinCode(obj, obj, words, this);
+    return ! failed;
+}
 
-    // We may sometimes get addresses that have already been updated
-    // to point to the new area.  e.g. (only?) in the case of constants
-    // that have been updated in ScanConstantsWithinCode.
-    if (space->spaceType == ST_EXPORT)
-        return 0;
+// The hash of a constant in a code object.  This must be the same for
+// constants that refer to identical objects.  Small functions often have the
+// same code so the contents of strings, such as the function name, are included.
+POLYUNSIGNED DedupTable::ValueHash(PolyWord v)
+{
+    if (IS_INT(v) || v == PolyWord::FromUnsigned(0))
+        return v.AsUnsigned();
+    PolyObject *obj = v.IsCodePtr() ? ObjCodePtrToPtr(v.AsCodePtr()) : v.AsObjPtr();
+    MemSpace *space = gMem.SpaceForAddress(obj);
+    if (space == 0 || (space->spaceType != ST_LOCAL && space->spaceType != ST_PERMANENT))
+        return v.AsUnsigned();
+    // The object may have been forwarded, in which case the length word is
+    // in the new object.  The contents are unchanged.
+    PolyObject *newAddr = InParents(space) ? 0 : copyScan->NewAddress(obj);
+    POLYUNSIGNED lengthWord = newAddr != 0 ? newAddr->LengthWord() : obj->LengthWord();
+    POLYUNSIGNED hash = lengthWord;
+    if (OBJ_IS_BYTE_OBJECT(lengthWord))
+    {
+        byte *data = (byte*)obj;
+        for (POLYUNSIGNED i = 0; i < OBJ_OBJECT_LENGTH(lengthWord) * sizeof(PolyWord); i++)
+            hash = hash * 31 + data[i];
+    }
+    return hash;
+}
 
-    // If this is at a lower level than the hierarchy we are saving
-    // then leave it untouched.
-    if (space->spaceType == ST_PERMANENT)
+// The hash of an object.  Returns zero if there is insufficient memory.
+POLYUNSIGNED DedupTable::Hash(PolyObject *obj, POLYUNSIGNED lengthWord, Normalised *n)
+{
+    POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
+    byte *data = (byte*)obj;
+    POLYUNSIGNED bytes = words * sizeof(PolyWord), constCount = 0;
+    if (OBJ_IS_CODE_OBJECT(lengthWord))
     {
-        PermanentMemSpace *pmSpace = (PermanentMemSpace*)space;
-        if (pmSpace->hierarchy < hierarchy)
+        if (! Normalise(obj, lengthWord, n))
             return 0;
+        data = (byte*)n->buffer;
+        constCount = n->buffer[words-1].AsUnsigned();
+        if (constCount >= words)
+            return 0;
+        bytes = (words - constCount - 1) * sizeof(PolyWord);
+    }
+    POLYUNSIGNED hash = lengthWord;
+    for (POLYUNSIGNED i = 0; i < bytes; i++)
+        hash = hash * 31 + data[i];
+    if (OBJ_IS_CODE_OBJECT(lengthWord))
+    {
+        for (POLYUNSIGNED j = 0; j < n->nConsts; j++)
+            hash = hash * 31 + ValueHash(n->consts[j].value);
+        for (POLYUNSIGNED k = words - constCount - 1; k < words - 1; k++)
+            hash = hash * 31 + ValueHash(obj->Get(k));
     }
+    return hash == 0 ? 1 : hash;
+}
 
-    if (val.IsCodePtr())
+// Forward an object to the one in the parents that it is assumed to be identical to.
+bool DedupTable::Assume(PolyObject *x, POLYUNSIGNED lengthWord, PolyObject *y)
+{
+    if (nAssumed == maxAssumed)
     {
-        // Find the start of the code segment
-        PolyObject *oldObject = ObjCodePtrToPtr(val.AsCodePtr());
-        // Calculate the byte offset of this value within the code object.
-        POLYUNSIGNED offset = val.AsCodePtr() - (byte*)oldObject;
-        PolyObject *newObject = ScanObjectAddress(oldObject);
-        *pt = PolyWord::FromCodePtr((byte*)newObject + offset);
-        return 0;
+        if (maxAssumed >= DEDUP_MAX_OBJECTS)
+            return false;
+        POLYUNSIGNED newMax = maxAssumed == 0 ? 64 : maxAssumed * 2;
+        Assumption *newAssumed = (Assumption*)realloc(assumed, newMax * sizeof(Assumption));
+        if (newAssumed == 0)
+            return false;
+        assumed = newAssumed;
+        maxAssumed = newMax;
     }
+    Assumption *a = &assumed[nAssumed++];
+    a->obj = x;
+    a->lengthWord = lengthWord;
+    a->space = gMem.SpaceForAddress(x);
+    copyScan->SetForwarding(x, y, a->space);
+    return true;
+}
 
-    ASSERT(OBJ_IS_DATAPTR(val));
+// Remove the forwarding pointers after a comparison failed.
+void DedupTable::Undo()
+{
+    while (nAssumed > 0)
+    {
+        Assumption *a = &assumed[--nAssumed];
+        copyScan->ClearForwarding(a->obj, a->lengthWord, a->space);
+    }
+}
 
-    // Have we already scanned this?
-    PolyObject *obj = val.AsObjPtr();
-    if (obj->ContainsForwardingPtr())
+bool DedupTable::SameValue(PolyWord x, PolyWord y, unsigned depth)
+{
+    if (x == y)
+        return true;
+    if (IS_INT(x) || IS_INT(y) || x == PolyWord::FromUnsigned(0) || y == PolyWord::FromUnsigned(0))
+        return false;
+    if (x.IsCodePtr() || y.IsCodePtr())
     {
-        // Update the address to the new value.
-        PolyObject *newAddr = obj->GetForwardingPtr();
-        *pt = newAddr;
-        return 0; // No need to scan it again.
+        if (! x.IsCodePtr() || ! y.IsCodePtr())
+            return false;
+        PolyObject *xObj = ObjCodePtrToPtr(x.AsCodePtr()), *yObj = ObjCodePtrToPtr(y.AsCodePtr());
+        return x.AsCodePtr() - (byte*)xObj == y.AsCodePtr() - (byte*)yObj &&
+            SameObject(xObj, yObj, depth);
     }
-    else if (space->spaceType == ST_PERMANENT)
+    return SameObject(x.AsObjPtr(), y.AsObjPtr(), depth);
+}
+
+// Test whether x, which is not in the parents, is identical to y which is.
+bool DedupTable::SameObject(PolyObject *x, PolyObject *y, unsigned depth)
+{
+    if (x == y)
+        return true;
+    MemSpace *space = gMem.SpaceForAddress(x);
+    if (space == 0 || (space->spaceType != ST_LOCAL && space->spaceType != ST_PERMANENT) ||
+        InParents(space) || ! InParents(gMem.SpaceForAddress(y)))
+        return false;
+    // If it has already been copied, or assumed to be identical to something,
+    // it must be the same object.
+    PolyObject *newAddr = copyScan->NewAddress(x);
+    if (newAddr != 0)
+        return newAddr == y;
+    POLYUNSIGNED lengthWord = x->LengthWord();
+    if (lengthWord != y->LengthWord() || OBJ_IS_MUTABLE_OBJECT(lengthWord) || depth > DEDUP_MAX_DEPTH)
+        return false;
+    POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
+
+    if (OBJ_IS_BYTE_OBJECT(lengthWord))
+        return memcmp(x, y, words * sizeof(PolyWord)) == 0 && Assume(x, lengthWord, y);
+
+    if (OBJ_IS_CODE_OBJECT(lengthWord))
+    {
+        Normalised nx, ny;
+        if (! Normalise(x, lengthWord, &nx) || ! Normalise(y, lengthWord, &ny))
+            return false;
+        POLYUNSIGNED constCount = nx.buffer[words-1].AsUnsigned();
+        if (constCount >= words || nx.nConsts != ny.nConsts ||
+            nx.buffer[words-1] != ny.buffer[words-1] ||
+            memcmp(nx.buffer, ny.buffer, (words - constCount - 1) * sizeof(PolyWord)) != 0)
+            return false;
+        for (POLYUNSIGNED i = 0; i < nx.nConsts; i++)
+        {
+            if (nx.consts[i].offset != ny.consts[i].offset || nx.consts[i].code != ny.consts[i].code)
+                return false;
+        }
+        if (! Assume(x, lengthWord, y))
+            return false;
+        for (POLYUNSIGNED j = 0; j < nx.nConsts; j++)
+        {
+            if (! SameValue(nx.consts[j].value, ny.consts[j].value, depth+1))
+                return false;
+        }
+        for (POLYUNSIGNED k = words - constCount - 1; k < words - 1; k++)
+        {
+            if (! SameValue(x->Get(k), y->Get(k), depth+1))
+                return false;
+        }
+        return true;
+    }
+
+    // Ordinary immutable objects such as closures.
+    if (! Assume(x, lengthWord, y))
+        return false;
+    for (POLYUNSIGNED i = 0; i < words; i++)
     {
-        // See if we have this in the grave-yard.
-        for (unsigned i = 0; i < tombs; i++)
+        if (! SameValue(x->Get(i), y->Get(i), depth+1))
+            return false;
+    }
+    return true;
+}
+
+// Build the table from the immutable spaces in the parents.
+bool DedupTable::Create()
+{
+    POLYUNSIGNED count = 0;
+    Normalised n;
+    for (unsigned pass = 0; pass < 2; pass++)
+    {
+        for (unsigned i = 0; i < gMem.npSpaces; i++)
         {
-            GraveYard *g = &graveYard[i];
-            if (val.AsStackAddr() >= g->startAddr && val.AsStackAddr() < g->endAddr)
+            PermanentMemSpace *space = gMem.pSpaces[i];
+            if (! InParents(space) || space->isMutable)
+                continue;
+            for (PolyWord *pt = space->bottom; pt < space->topPointer; )
             {
-                PolyWord *tombAddr = g->graves + (val.AsStackAddr() - g->startAddr);
-                PolyObject *tombObject = (PolyObject*)tombAddr;
-                if (tombObject->ContainsForwardingPtr())
+                pt++;
+                PolyObject *obj = (PolyObject*)pt;
+                POLYUNSIGNED lengthWord = obj->LengthWord();
+                pt += OBJ_OBJECT_LENGTH(lengthWord);
+                if (! IsCandidate(lengthWord))
+                    continue;
+                if (pass == 0)
+                    count++;
+                else
                 {
-                    *pt = tombObject->GetForwardingPtr();;
-                    return 0;
+                    POLYUNSIGNED hash = Hash(obj, lengthWord, &n);
+                    if (hash == 0)
+                        continue; // Leave it out.
+                    POLYUNSIGNED index = hash & (tableSize-1);
+                    while (table[index].obj != 0)
+                        index = (index+1) & (tableSize-1);
+                    table[index].hash = hash;
+                    table[index].obj = obj;
                 }
-                break; // No need to look further
             }
         }
+        if (pass == 0)
+        {
+            // Keep the table no more than half full.
+            for (tableSize = 16; tableSize < count*2; tableSize *= 2) ;
+            table = (DedupEntry*)calloc(tableSize, sizeof(DedupEntry));
+            if (table == 0)
+                return false;
+        }
     }
+    return true;
+}
 
-    // No, we need to copy it.
-    ASSERT(space->spaceType == ST_LOCAL || space->spaceType == ST_PERMANENT);
-    POLYUNSIGNED lengthWord = obj->LengthWord();
+// Return an identical object in the parents or zero if there is none.  If there
+// is one, this object and any others it refers to that are identical to objects
+// in the parents are forwarded to them.
+PolyObject *DedupTable::FindDuplicate(PolyObject *obj)
+{
+    Normalised n;
+    POLYUNSIGNED hash = Hash(obj, obj->LengthWord(), &n);
+    if (hash == 0)
+        return 0;
+    unsigned tries = 0;
+    for (POLYUNSIGNED index = hash & (tableSize-1);
+         table[index].obj != 0 && tries < DEDUP_MAX_CANDIDATES; index = (index+1) & (tableSize-1))
+    {
+        if (table[index].hash != hash)
+            continue;
+        tries++;
+        if (SameObject(obj, table[index].obj, 0))
+        {
+            for (POLYUNSIGNED i = 0; i < nAssumed; i++)
+            {
+                copyScan->dedupObjects++;
+                copyScan->dedupWords += OBJ_OBJECT_LENGTH(assumed[i].lengthWord) + 1;
+            }
+            nAssumed = 0;
+            return table[index].obj;
+        }
+        Undo();
+    }
+    return 0;
+}
+
+CopyScan::~CopyScan()
+{
+    gMem.DeleteExportSpaces();
+    if (graveYard)
+        delete[](graveYard);
+    delete(dedupTable);
+}
+
+void CopyScan::EnableDeduplication()
+{
+    if (hierarchy == 0)
+        return; // Exporting: everything is copied.
+    dedupTable = new DedupTable(this);
+    // If we can't build the table just copy everything.
+    if (dedupTable != 0 && ! dedupTable->Create())
+    {
+        delete(dedupTable);
+        dedupTable = 0;
+    }
+}
+
+
+// Find the new address of an object that has been copied.
+PolyObject *CopyScan::NewAddress(PolyObject *obj)
+{
+    if (obj->ContainsForwardingPtr())
+        return obj->GetForwardingPtr();
+    // See if we have this in the grave-yard.
+    for (unsigned i = 0; i < tombs; i++)
+    {
+        GraveYard *g = &graveYard[i];
+        if ((PolyWord*)obj >= g->startAddr && (PolyWord*)obj < g->endAddr)
+        {
+            PolyObject *tombObject = (PolyObject*)(g->graves + ((PolyWord*)obj - g->startAddr));
+            if (tombObject->ContainsForwardingPtr())
+                return tombObject->GetForwardingPtr();
+            break; // No need to look further
+        }
+    }
+    return 0;
+}
+
+// Allocate space for an object in the export spaces and set the forwarding
+// pointer.  The contents are copied later by CopyObjects so the first word
+// holds the original address until then.
+PolyObject *CopyScan::AllocateObject(PolyObject *obj, POLYUNSIGNED lengthWord, MemSpace *space)
+{
     POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
 
     PolyObject *newObj = 0;
-    bool isMutableObj = obj->IsMutable();
+    bool isMutableObj = OBJ_IS_MUTABLE_OBJECT(lengthWord);
     bool isNoOverwrite = false;
     bool isByteObj = false;
     if (isMutableObj)
     {
         isNoOverwrite = obj->IsNoOverwriteObject();
-        isByteObj = obj->IsByteObject();
+        isByteObj = OBJ_IS_BYTE_OBJECT(lengthWord);
     }
     // Allocate a new address for the object.
     for (unsigned i = 0; i < gMem.neSpaces; i++)
@@ -287,31 +630,39 @@ POLYUNSIGNED CopyScan::ScanAddressAt(PolyWord *pt)
         if (spaceWords <= words)
             spaceWords = words+1; // Make sure there's space for this object.
         PermanentMemSpace *space = gMem.NewExportSpace(spaceWords, isMutableObj, isNoOverwrite);
-        if (isByteObj) space->byteOnly = true;
         if (space == 0)
         {
             // Unable to allocate this.
             throw MemoryException();
         }
+        if (isByteObj) space->byteOnly = true;
         newObj = (PolyObject*)(space->topPointer+1);
         space->topPointer += words+1;
         ASSERT(space->topPointer <= space->top && space->topPointer >= space->bottom);
     }
 
     newObj->SetLengthWord(lengthWord); // copy length word
+    if (words != 0)
+        newObj->Set(0, obj); // Remember where to copy it from.
 
-    memcpy(newObj, obj, words*sizeof(PolyWord));
+    SetForwarding(obj, newObj, space);
+    return newObj;
+}
 
-    if (space->spaceType == ST_PERMANENT && !space->isMutable && ((PermanentMemSpace*)space)->hierarchy == 0)
+// Set the forwarding pointer for an object that has been copied.
+void CopyScan::SetForwarding(PolyObject *obj, PolyObject *newObj, MemSpace *space)
+{
+    if (space->spaceType == ST_PERMANENT && !space->isMutable &&
+        (((PermanentMemSpace*)space)->hierarchy == 0 || ((PermanentMemSpace*)space)->isReadOnly))
     {
         // The immutable permanent areas are read-only.
         unsigned m;
         for (m = 0; m < tombs; m++)
         {
             GraveYard *g = &graveYard[m];
-            if (val.AsStackAddr() >= g->startAddr && val.AsStackAddr() < g->endAddr)
+            if ((PolyWord*)obj >= g->startAddr && (PolyWord*)obj < g->endAddr)
             {
-                PolyWord *tombAddr = g->graves + (val.AsStackAddr() - g->startAddr);
+                PolyWord *tombAddr = g->graves + ((PolyWord*)obj - g->startAddr);
                 PolyObject *tombObject = (PolyObject*)tombAddr;
                 tombObject->SetForwardingPtr(newObj);
                 break; // No need to look further
@@ -320,30 +671,309 @@ POLYUNSIGNED CopyScan::ScanAddressAt(PolyWord *pt)
         ASSERT(m < tombs); // Should be there.
     }
     else obj->SetForwardingPtr(newObj); // Put forwarding pointer in old object.
+}
+
+// Remove a forwarding pointer set by SetForwarding.
+void CopyScan::ClearForwarding(PolyObject *obj, POLYUNSIGNED lengthWord, MemSpace *space)
+{
+    if (space->spaceType == ST_PERMANENT && !space->isMutable &&
+        (((PermanentMemSpace*)space)->hierarchy == 0 || ((PermanentMemSpace*)space)->isReadOnly))
+    {
+        for (unsigned m = 0; m < tombs; m++)
+        {
+            GraveYard *g = &graveYard[m];
+            if ((PolyWord*)obj >= g->startAddr && (PolyWord*)obj < g->endAddr)
+            {
+                PolyObject *tombObject = (PolyObject*)(g->graves + ((PolyWord*)obj - g->startAddr));
+                tombObject->SetLengthWord(0);
+                break;
+            }
+        }
+    }
+    else obj->SetLengthWord(lengthWord);
+}
+
+// Find the new address for a value, allocating space for the object if this is
+// the first time we have seen it.  Returns the length word if the object has
+// been allocated and the addresses in the original still need to be scanned.
+POLYUNSIGNED CopyScan::LayoutAddress(PolyWord val, PolyWord &newVal)
+{
+    newVal = val;
+    // Ignore integers.
+    if (IS_INT(val) || val == PolyWord::FromUnsigned(0))
+        return 0;
+    // Ignore pointers to the IO area.  They will be relocated
+    // when we write out the memory
+    MemSpace *space = gMem.SpaceForAddress(val.AsAddress());
+    ASSERT(space != 0);
+    if (space->spaceType == ST_IO)
+        return 0;
+
+    // We may sometimes get addresses that have already been updated
+    // to point to the new area.  e.g. (only?) in the case of constants
+    // that have been updated in ScanConstantsWithinCode.
+    if (space->spaceType == ST_EXPORT)
+        return 0;
+
+    // If this is at a lower level than the hierarchy we are saving
+    // then leave it untouched.
+    if (space->spaceType == ST_PERMANENT)
+    {
+        PermanentMemSpace *pmSpace = (PermanentMemSpace*)space;
+        if (pmSpace->hierarchy < hierarchy)
+            return 0;
+    }
+
+    if (val.IsCodePtr())
+    {
+        // Find the start of the code segment
+        PolyObject *oldObject = ObjCodePtrToPtr(val.AsCodePtr());
+        // Calculate the byte offset of this value within the code object.
+        POLYUNSIGNED offset = val.AsCodePtr() - (byte*)oldObject;
+        PolyWord newObject;
+        POLYUNSIGNED lengthWord = LayoutAddress(oldObject, newObject);
+        if (lengthWord)
+        {
+            bool wasInLayout = inLayout;
+            inLayout = true;
+            ScanAddressesInObject(oldObject, lengthWord);
+            inLayout = wasInLayout;
+        }
+        newVal = PolyWord::FromCodePtr(newObject.AsCodePtr() + offset);
+        return 0;
+    }
+
+    ASSERT(OBJ_IS_DATAPTR(val));
+
+    // Have we already scanned this?
+    PolyObject *obj = val.AsObjPtr();
+    if (obj->ContainsForwardingPtr())
+    {
+        // Update the address to the new value.
+        newVal = obj->GetForwardingPtr();
+        return 0; // No need to scan it again.
+    }
+    else if (space->spaceType == ST_PERMANENT)
+    {
+        PolyObject *newAddr = NewAddress(obj);
+        if (newAddr != 0)
+        {
+            newVal = newAddr;
+            return 0;
+        }
+    }
+
+    // No, we need to copy it.
+    ASSERT(space->spaceType == ST_LOCAL || space->spaceType == ST_PERMANENT);
+    POLYUNSIGNED lengthWord = obj->LengthWord();
+    if (dedupTable != 0)
+    {
+        // Use an identical object in the parents if there is one.  It cannot
+        // refer to anything that is being copied so there's no need to scan it.
+        PolyObject *dup = 0;
+        if (DedupTable::IsCandidate(lengthWord))
+            dup = dedupTable->FindDuplicate(obj);
+        else if (! OBJ_IS_MUTABLE_OBJECT(lengthWord) && OBJ_IS_WORD_OBJECT(lengthWord) &&
+                 OBJ_OBJECT_LENGTH(lengthWord) != 0 && ! IS_INT(obj->Get(0)) &&
+                 obj->Get(0) != PolyWord::FromUnsigned(0))
+        {
+            // This may be a closure.  The code usually refers to the closure so
+            // try the code first.  If that is found the closure will have been forwarded.
+            PolyWord entry = obj->Get(0);
+            PolyObject *code = entry.IsCodePtr() ? ObjCodePtrToPtr(entry.AsCodePtr()) : entry.AsObjPtr();
+            MemSpace *codeSpace = gMem.SpaceForAddress(code);
+            if (codeSpace != 0 && (codeSpace->spaceType == ST_LOCAL ||
+                    (codeSpace->spaceType == ST_PERMANENT && ((PermanentMemSpace*)codeSpace)->hierarchy >= hierarchy)) &&
+                NewAddress(code) == 0 && DedupTable::IsCandidate(code->LengthWord()) &&
+                dedupTable->FindDuplicate(code) != 0)
+                dup = NewAddress(obj);
+        }
+        if (dup != 0)
+        {
+            newVal = dup;
+            return 0;
+        }
+    }
+    newVal = AllocateObject(obj, lengthWord, space);
+    return lengthWord;  // The original object needs to be scanned.
+}
+
+// This function is called for each address in an object.  While we are
+// scanning the roots the address is updated to the new location and the object
+// it refers to is scanned.  Within an object being copied we return the length
+// word and leave the address unchanged so that ScanAddressesInObject goes on to
+// scan the original object.  The copy is updated later.
+POLYUNSIGNED CopyScan::ScanAddressAt(PolyWord *pt)
+{
+    PolyWord newVal;
+    POLYUNSIGNED lengthWord = LayoutAddress(*pt, newVal);
+    if (inLayout)
+        return lengthWord;
+    if (lengthWord)
+    {
+        inLayout = true;
+        ScanAddressesInObject((*pt).AsObjPtr(), lengthWord);
+        inLayout = false;
+    }
+    if (newVal != *pt)
+        *pt = newVal;
+    return 0;
+}
+
+// Constants within code.  Within an object being copied these must not be
+// updated.
+void CopyScan::ScanConstant(byte *addressOfConstant, ScanRelocationKind code)
+{
+    if (! inLayout)
+    {
+        ScanAddress::ScanConstant(addressOfConstant, code);
+        return;
+    }
+    PolyWord p = GetConstantValue(addressOfConstant, code);
+    PolyWord newVal;
+    POLYUNSIGNED lengthWord = LayoutAddress(p, newVal);
+    if (lengthWord)
+        ScanAddressesInObject(p.AsObjPtr(), lengthWord);
+}
+
+PolyObject *CopyScan::ScanObjectAddress(PolyObject *base)
+{
+    PolyWord val = base;
+    // Scan this as an address. 
+    bool wasInLayout = inLayout;
+    inLayout = false;
+    CopyScan::ScanAddressAt(&val);
+    inLayout = wasInLayout;
+    return val.AsObjPtr();
+}
+
+// This is used when the objects are copied to update the addresses in the
+// copies.  All the objects have already been allocated.
+class CopyFixup: public ScanAddress
+{
+public:
+    CopyFixup(CopyScan *s): copyScan(s) {}
+    virtual PolyObject *ScanObjectAddress(PolyObject *base);
+    void CopyObject(PolyObject *newObj, POLYUNSIGNED lengthWord);
+protected:
+    virtual POLYUNSIGNED ScanAddressAt(PolyWord *pt);
+private:
+    CopyScan *copyScan;
+};
+
+PolyObject *CopyFixup::ScanObjectAddress(PolyObject *base)
+{
+    MemSpace *space = gMem.SpaceForAddress(base);
+    if (space == 0 || (space->spaceType != ST_LOCAL && space->spaceType != ST_PERMANENT))
+        return base;
+    PolyObject *newAddr = copyScan->NewAddress(base);
+    // If we ran out of memory some objects may not have been copied.
+    return newAddr == 0 ? base : newAddr;
+}
+
+POLYUNSIGNED CopyFixup::ScanAddressAt(PolyWord *pt)
+{
+    PolyWord val = *pt;
+    if (IS_INT(val) || val == PolyWord::FromUnsigned(0))
+        return 0;
+    if (val.IsCodePtr())
+    {
+        PolyObject *oldObject = ObjCodePtrToPtr(val.AsCodePtr());
+        POLYUNSIGNED offset = val.AsCodePtr() - (byte*)oldObject;
+        PolyObject *newObject = ScanObjectAddress(oldObject);
+        if (newObject != oldObject)
+            *pt = PolyWord::FromCodePtr((byte*)newObject + offset);
+    }
+    else
+    {
+        PolyObject *newObject = ScanObjectAddress(val.AsObjPtr());
+        if (newObject != val.AsObjPtr())
+            *pt = newObject;
+    }
+    return 0;
+}
 
+// Copy an object from its original location, which is held in the first word,
+// and update the addresses in it.
+void CopyFixup::CopyObject(PolyObject *newObj, POLYUNSIGNED lengthWord)
+{
+    POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
+    PolyObject *obj = newObj->Get(0).AsObjPtr();
+    memcpy(newObj, obj, words*sizeof(PolyWord));
     if (OBJ_IS_CODE_OBJECT(lengthWord))
     {
         // We don't need to worry about flushing the instruction cache
         // since we're not going to execute this code here.
         // We do have to update any relative addresses within the code
-        // to take account of its new position.  We have to do that now
-        // even though ScanAddressesInObject will do it again because this
-        // is the only point where we have both the old and the new addresses.
+        // to take account of its new position.  This is the only point
+        // where we have both the old and the new addresses.
         machineDependent->ScanConstantsWithinCode(newObj, obj, words, this);
     }
-    *pt = newObj; // Update it to the newly copied object.
-    return lengthWord;  // This new object needs to be scanned.
+    ScanAddressesInObject(newObj, lengthWord);
 }
 
+// The export spaces are split into chunks of about this many words to be copied in parallel.
+#define COPY_CHUNK_WORDS    (64*1024)
 
-PolyObject *CopyScan::ScanObjectAddress(PolyObject *base)
+typedef struct {
+    CopyScan    *copyScan;
+    PolyWord    *start, *end;
+} CopyChunk;
+
+static void copyChunk(GCTaskId *, void *arg1, void *)
 {
-    PolyWord val = base;
-    // Scan this as an address. 
-    POLYUNSIGNED lengthWord = CopyScan::ScanAddressAt(&val);
-    if (lengthWord)
-        ScanAddressesInObject(val.AsObjPtr(), lengthWord);
-    return val.AsObjPtr();
+    CopyChunk *chunk = (CopyChunk *)arg1;
+    CopyFixup fixup(chunk->copyScan);
+    for (PolyWord *p = chunk->start; p < chunk->end; )
+    {
+        p++;
+        PolyObject *newObj = (PolyObject*)p;
+        POLYUNSIGNED lengthWord = newObj->LengthWord();
+        POLYUNSIGNED words = OBJ_OBJECT_LENGTH(lengthWord);
+        p += words;
+        if (words != 0)
+            fixup.CopyObject(newObj, lengthWord);
+    }
+}
+
+// Copy the contents of the objects into the space allocated for them and
+// update the addresses.  The export spaces are split into chunks on object
+// boundaries and these are handled by the GC task farm threads.
+void CopyScan::CopyObjects(void)
+{
+    inLayout = false;
+    POLYUNSIGNED totalWords = 0;
+    for (unsigned i = 0; i < gMem.neSpaces; i++)
+        totalWords += gMem.eSpaces[i]->topPointer - gMem.eSpaces[i]->bottom;
+    size_t maxChunks = totalWords / COPY_CHUNK_WORDS + gMem.neSpaces;
+    CopyChunk *chunks = (CopyChunk*)malloc(maxChunks * sizeof(CopyChunk));
+    CopyChunk singleChunk;
+    size_t nChunks = 0;
+
+    for (unsigned j = 0; j < gMem.neSpaces; j++)
+    {
+        PermanentMemSpace *space = gMem.eSpaces[j];
+        PolyWord *chunkStart = space->bottom;
+        for (PolyWord *p = space->bottom; p < space->topPointer; )
+        {
+            p += ((PolyObject*)(p+1))->Length() + 1;
+            if (p - chunkStart >= COPY_CHUNK_WORDS || p >= space->topPointer)
+            {
+                // If we couldn't allocate the table just do it now.
+                CopyChunk *chunk = chunks == 0 ? &singleChunk : &chunks[nChunks++];
+                chunk->copyScan = this;
+                chunk->start = chunkStart;
+                chunk->end = p;
+                if (chunks == 0)
+                    copyChunk(0, chunk, 0);
+                else
+                    gpTaskFarm->AddWorkOrRunNow(copyChunk, chunk, 0);
+                chunkStart = p;
+            }
+        }
+    }
+    gpTaskFarm->WaitForCompletion();
+    free(chunks);
 }
 
 #define MAX_EXTENSION   4 // The longest extension we may need to add is ".obj"
@@ -442,6 +1072,7 @@ void Exporter::RunExport(PolyObject *rootFunction)
         // If we ran out of memory.
         copiedRoot = 0;
     }
+    copyScan.CopyObjects();
 
     // Fix the forwarding pointers.
     unsigned j;
@@ -531,6 +1162,8 @@ Handle exportNative(TaskData *taskData, Handle args)
     return taskData->saveVec.push(TAGGED(0));
 }
 
+// The binary and text portable formats use the same extension.  ImportPortable
+// recognises a binary file from its header.
 Handle exportPortable(TaskData *taskData, Handle args)
 {
     PExport exports;
@@ -538,6 +1171,13 @@ Handle exportPortable(TaskData *taskData, Handle args)
     return taskData->saveVec.push(TAGGED(0));
 }
 
+Handle exportPortableText(TaskData *taskData, Handle args)
+{
+    PExport exports(true);
+    exporter(taskData, args, ".txt", &exports);
+    return taskData->saveVec.push(TAGGED(0));
+}
+
 
 // Helper functions for exporting.  We need to produce relocation information
 // and this code is common to every method.
@@ -35,6 +35,7 @@ class TaskData;
 
 extern Handle exportNative(TaskData *mdTaskData, Handle args);
 extern Handle exportPortable(TaskData *mdTaskData, Handle args);
+extern Handle exportPortableText(TaskData *mdTaskData, Handle args);
 
 // This is the base class for the exporters for the various object-code formats.
 class Exporter
@@ -91,23 +92,53 @@ public:
     PolyWord *startAddr, *endAddr;
 };
 
+class MemSpace;
+class DedupTable;
+
+// Copy the objects reachable from the roots into export spaces.  This is done
+// in two passes.  Scanning the roots allocates space for every reachable object
+// in the export spaces and sets the forwarding pointers.  This is single-threaded
+// so that the layout of the export spaces is always the same.  CopyObjects then
+// copies the contents and updates the addresses in parallel.
 class CopyScan: public ScanAddress
 {
 public:
     CopyScan(unsigned h=0);
     void initialise(bool isExport=true);
     ~CopyScan();
+    // This must be called after the roots have been scanned, even if that
+    // raised MemoryException, before the export spaces are used.
+    void CopyObjects(void);
 protected:
     virtual POLYUNSIGNED ScanAddressAt(PolyWord *pt);
+    virtual void ScanConstant(byte *addressOfConstant, ScanRelocationKind code);
 public:
     virtual PolyObject *ScanObjectAddress(PolyObject *base);
 
+    // Return the new address of an object that has been copied or zero if it has not.
+    PolyObject *NewAddress(PolyObject *obj);
+
+    // When saving a state, use identical code and immutable byte objects in
+    // the parents, along with the closures and other immutable data the code
+    // refers to, rather than copying them.  This must be called after initialise.
+    void EnableDeduplication(void);
+    POLYUNSIGNED dedupObjects, dedupWords; // Number of objects not copied.
+
     // Default sizes of the segments.
     POLYUNSIGNED defaultImmSize, defaultMutSize, defaultNoOverSize;
     unsigned hierarchy;
 
     GraveYard *graveYard;
     unsigned tombs;
+
+private:
+    POLYUNSIGNED LayoutAddress(PolyWord val, PolyWord &newVal);
+    PolyObject *AllocateObject(PolyObject *obj, POLYUNSIGNED lengthWord, MemSpace *space);
+    void SetForwarding(PolyObject *obj, PolyObject *newObj, MemSpace *space);
+    void ClearForwarding(PolyObject *obj, POLYUNSIGNED lengthWord, MemSpace *space);
+    bool inLayout; // True while we are scanning objects that are being copied.
+    DedupTable *dedupTable;
+    friend class DedupTable;
 };
 
 #endif
@@ -104,6 +104,7 @@ typedef char TCHAR;
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "locking.h"
 
 
@@ -249,7 +250,7 @@ typedef struct {
 
 
 static Volatile *vols;
-static PLock volLock; // Mutex to protect vols.
+static PLock volLock("Foreign vols"); // Mutex to protect vols.
 
 #define FIRST_VOL 0
 
@@ -265,7 +266,7 @@ static struct _cbStructEntry {
     unsigned char *cFunction;       /* The C function "stub" code. */
 } *callbackTable;
 static unsigned callBackEntries = 0;
-static PLock callbackTableLock; // Mutex to protect table.
+static PLock callbackTableLock("Callback table"); // Mutex to protect table.
 
 
 /**********************************************************************
@@ -1693,6 +1694,7 @@ static type_hh_fun handlers[] =
 Handle foreign_dispatch_c (TaskData *taskData, Handle args, Handle fcode_h)
 {
     int fcode = get_C_int(taskData, DEREFWORD(fcode_h));
+    RtsTraceSubCode(taskData, fcode);
     
     if (fcode < 0 || fcode >= NUM_HANDLERS) {
         char buf[100];
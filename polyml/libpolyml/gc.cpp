@@ -55,6 +55,7 @@
 #include "statistics.h"
 #include "profiling.h"
 #include "heapsizing.h"
+#include "perfmap.h"
 
 static GCTaskFarm gTaskFarm; // Global task farm.
 GCTaskFarm *gpTaskFarm = &gTaskFarm;
@@ -111,6 +112,9 @@ static bool doGC(const POLYUNSIGNED wordsRequiredToAllocate)
     // out areas that are now empty.
     gMem.RemoveEmptyLocals();
 
+    // The objects in the minor GC intern table may be moved or freed.
+    ClearInternTable();
+
     if (debugOptions & DEBUG_GC)
         Log("GC: Full GC, %lu words required %u spaces\n", wordsRequiredToAllocate, gMem.nlSpaces);
 
@@ -230,6 +234,10 @@ static bool doGC(const POLYUNSIGNED wordsRequiredToAllocate)
 
     gHeapSizeParameters.RecordGCTime(HeapSizeParameters::GCTimeIntermediate, "Update");
 
+    // Record the new addresses of any code we've moved.
+    if (perfMapEnabled)
+        PerfMapFlushMoved();
+
     {
         POLYUNSIGNED iUpdated = 0, mUpdated = 0, iMarked = 0, mMarked = 0;
         for(j = 0; j < gMem.nlSpaces; j++)
@@ -50,6 +50,10 @@ extern void CopyObjectToNewAddress(PolyObject *srcAddress, PolyObject *destAddre
 
 extern bool RunQuickGC(const POLYUNSIGNED wordsRequiredToAllocate);
 
+// Share small immutable objects with existing copies during the minor GC.
+extern bool internInMinorGC;
+extern void ClearInternTable(void);
+
 // GC Phases.
 extern void GCSharingPhase(void);
 extern void GCMarkPhase(void);
@@ -83,6 +83,7 @@ avoids
 #include "gctaskfarm.h"
 #include "locking.h"
 #include "diagnostics.h"
+#include "perfmap.h"
 
 static PLock copyLock("Copy");
 
@@ -179,6 +180,8 @@ void CopyObjectToNewAddress(PolyObject *srcAddress, PolyObject *destAddress, POL
         machineDependent->FlushInstructionCache(destAddress, n * sizeof(PolyWord));
         // We have to update any relative addresses in the code.
         machineDependent->ScanConstantsWithinCode(destAddress, srcAddress, OBJ_OBJECT_LENGTH(L), &identity);
+        if (perfMapEnabled && ! OBJ_IS_MUTABLE_OBJECT(L))
+            PerfMapCodeMoved(destAddress);
     }
 }
 
@@ -36,31 +36,27 @@
     consequence of this is that positive long precision values can be
     shared but negative values cannot.  
 
-    There is a sharing function that first distributes items into a
-    hash table.  Then each hash table is sorted and as part of the
-    sorting process cells with the same contents are merged.  One
-    cell is chosen and the length words on the others are set to be
-    forwarding pointers to the chosen cell.  Hashing allows for easy
-    parallel processing.
-
-    The structure sharing code works by first sharing the byte
-    data which cannot contain pointers.  Then the word data is processed
-    to separate out "tail" cells that contain only tagged integers or
-    pointers to cells that either cannot be merged, such as mutables,
-    or those that have already been processed, such as the byte data.
-    Any pointers to shared data are updated to point to the merged cell.
-    The tail cells are then sorted and shared using the sharing function
-    and become part of the "processed" set.  This process is repeated to
-    find cells that are now tails and so on.
-
-    Compared with the full sharing code this is expensive since it
-    requires repeated scans of the list of unprocessed cells.  In
-    particular there may be cells that form loops (basically closures
-    for mutually recusive functions) and if they are present they and
-    anything that points directly or indirectly at them will never
-    be removed from the list.  We stop when it appears that we are
-    not making progress and simply do a final bit-wise share of the
-    remainder.
+    The byte data cannot contain pointers so it is shared first.  Each
+    list is distributed into a hash table and then each hash table is
+    sorted and as part of the sorting process cells with the same contents
+    are merged.  One cell is chosen and the length words on the others are
+    set to be forwarding pointers to the chosen cell.  Hashing allows for
+    easy parallel processing.
+
+    The word data is then treated as a graph.  A single depth-first scan
+    finds the strongly connected components using Tarjan's algorithm.
+    These are found in reverse topological order so when a component is
+    processed every cell it points to outside the component has already
+    been processed and any pointers to merged cells can be updated.  Most
+    components are single cells and these are merged with any retained
+    cell with the same contents using a hash table.  Components that form
+    loops, typically the closures of mutually recursive functions, are
+    first minimised by partition refinement in the same way as a finite
+    automaton.  The cells start in a single class and the classes are
+    split until cells in the same class have the same contents and point
+    to cells in the same class.  The minimised component is then compared
+    with those already retained using a canonical form and merged if it is
+    the same.  Very large loops are not minimised and are simply retained.
 */
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -109,7 +105,7 @@ public:
 class SortVector
 {
 public:
-    SortVector(): totalCount(0), carryOver(0) {}
+    SortVector(): totalCount(0) {}
 
     void AddToVector(PolyObject *obj, POLYUNSIGNED length);
 
@@ -118,11 +114,11 @@ public:
     POLYUNSIGNED CurrentCount() const { return baseObject.objCount; }
     POLYUNSIGNED Shared() const;
     void SetLengthWord(POLYUNSIGNED l) { lengthWord = l; }
-    POLYUNSIGNED CarryOver() const { return carryOver; }
+    PolyObject *TakeList(void);
+    void AddShared(POLYUNSIGNED n) { baseObject.shareCount += n; }
 
     static void hashAndSortAllTask(GCTaskId*, void *a, void *b);
     static void sharingTask(GCTaskId*, void *a, void *b);
-    static void wordDataTask(GCTaskId*, void *a, void *b);
 
 private:
     void sortList(PolyObject *head, POLYUNSIGNED nItems, POLYUNSIGNED &count);
@@ -130,7 +126,6 @@ private:
     ObjEntry baseObject, processObjects[256];
     POLYUNSIGNED totalCount;
     POLYUNSIGNED lengthWord;
-    POLYUNSIGNED carryOver;
 };
 
 POLYUNSIGNED SortVector::Shared() const
@@ -150,6 +145,15 @@ void SortVector::AddToVector(PolyObject *obj, POLYUNSIGNED length)
     totalCount++;
 }
 
+// Remove the list of objects.  The objects are still chained together.
+PolyObject *SortVector::TakeList()
+{
+    PolyObject *list = baseObject.objList;
+    baseObject.objList = 0;
+    baseObject.objCount = 0;
+    return list;
+}
+
 // The number of byte and word entries.
 // Objects of up to and including this size are shared.
 // Byte objects include strings so it is more likely that
@@ -164,8 +168,6 @@ public:
     GetSharing();
     void SortData(void);
     static void shareByteData(GCTaskId *, void *, void *);
-    static void shareWordData(GCTaskId *, void *, void *);
-    static void shareRemainingWordData(GCTaskId *, void *, void *);
 
 protected:
     virtual bool TestForScan(PolyWord *);
@@ -324,83 +326,6 @@ void SortVector::sharingTask(GCTaskId*, void *a, void *b)
     s->sortList(o->objList, o->objCount, o->shareCount);
 }
 
-// Process one level of the word data.
-// N.B.  The length words are updated without any locking.  This is safe
-// because all length words are initially chain entries and a chain entry
-// can be replaced by another chain entry, a forwarding pointer or a normal
-// length word.  Forwarding pointers and normal length words are only ever
-// set once.  There is a small chance that we could lose some sharing as a
-// result of a race condition if a thread defers an object because it
-// contains a pointer with a chain entry and later sees an otherwise
-// equal object where another thread has replaced the chain with a
-// normal address, adds it to the list for immediate processing and
-// so never compares the two.
-void SortVector::wordDataTask(GCTaskId*, void *a, void *)
-{
-    SortVector *s = (SortVector*)a;
-    // Partition the objects between those that have pointers to objects that are
-    // still to be processed and those that have been processed.
-    if (s->baseObject.objList == 0)
-        return;
-    PolyObject *h = s->baseObject.objList;
-    s->baseObject.objList = 0;
-    s->baseObject.objCount = 0;
-    POLYUNSIGNED words = OBJ_OBJECT_LENGTH(s->lengthWord);
-    s->carryOver = 0;
-
-    for (unsigned i = 0; i < 256; i++)
-    {
-        // Clear the entries in the hash table but not the sharing count.
-        s->processObjects[i].objList = 0;
-        s->processObjects[i].objCount = 0;
-    }
-
-    while (h != 0)
-    {
-        PolyObject *next = h->GetShareChain();
-        bool deferred = false;
-        for (POLYUNSIGNED i = 0; i < words; i++)
-        {
-            PolyWord w = h->Get(i);
-            if (w.IsDataPtr())
-            {
-                PolyObject *p = w.AsObjPtr();
-                // Update the addresses of objects that have been merged
-                if (p->ContainsForwardingPtr())
-                {
-                    h->Set(i, p->GetForwardingPtr());
-                    s->carryOver++;
-                }
-                else if (p->ContainsShareChain())
-                {
-                    // If it is still to be shared leave it
-                    deferred = true;
-                    break;
-                }
-            }
-        }
-        if (deferred)
-        {
-            // We can't do it yet: add it back to the list
-            h->SetShareChain(s->baseObject.objList);
-            s->baseObject.objList = h;
-            s->baseObject.objCount++;
-        }
-        else
-        {
-            // Add it to the hash table.
-            unsigned char hash = 0;
-            for (POLYUNSIGNED i = 0; i < words*sizeof(PolyWord); i++)
-                hash += h->AsBytePtr()[i];
-            h->SetShareChain(s->processObjects[hash].objList);
-            s->processObjects[hash].objList = h;
-            s->processObjects[hash].objCount++;
-        }
-        h = next;
-    }
-    s->SortData();
-}
-
 // Sort the entries in the hash table.
 void SortVector::SortData()
 {
@@ -475,25 +400,568 @@ void GetSharing::shareByteData(GCTaskId *, void *a, void *)
     }
 }
 
-// Process word data at this particular level
-void GetSharing::shareWordData(GCTaskId *, void *a, void *)
+// Word objects are processed as a graph.  Each cell is given an entry in a
+// vector and the length word of the cell is set to the index of the entry.
+// The length word still looks like a share chain so a cell is still to be
+// processed if ContainsShareChain is true.
+typedef struct
+{
+    PolyObject      *obj;
+    POLYUNSIGNED    index;      // Depth-first number.  Zero if not yet visited.
+    POLYUNSIGNED    lowLink;    // Used to find components.  Later the position within the component.
+    unsigned        length;
+    unsigned        next;       // Next word to scan in the depth-first search
+} ShareCell;
+
+// A strongly connected component that has been retained.  The form is the
+// contents of the cells in breadth-first order starting from the cell that gives
+// the smallest form with the addresses of the cells replaced by their positions.
+// Two components with the same form can be merged.
+typedef struct
+{
+    POLYUNSIGNED    hash;
+    POLYUNSIGNED    formSize;
+    POLYUNSIGNED    cellCount;
+    POLYUNSIGNED    *form;
+    PolyObject      **objs;
+} ShareComponent;
+
+// Components larger than this are not minimised.
+#define SHARE_MAX_COMPONENT     1024
+// Minimised components larger than this are not merged with other components.
+#define SHARE_MAX_CANONICAL     64
+// Each row of the table used to minimise components holds the current class,
+// the length and the words of the cell.
+#define SHARE_KEY_WIDTH         (NUM_WORD_VECTORS+2)
+
+class WordSharing
+{
+public:
+    WordSharing();
+    ~WordSharing();
+
+    bool Initialise(POLYUNSIGNED nCells);
+    void AddCell(PolyObject *obj, unsigned length);
+    void Run(void);
+
+    POLYUNSIGNED Shared(unsigned length) const { return shareCount[length-1]; }
+    POLYUNSIGNED Components() const { return componentCount; }
+    POLYUNSIGNED ComponentCells() const { return componentCells; }
+
+private:
+    void ProcessSingleton(ShareCell *cell);
+    void ProcessComponent(POLYUNSIGNED *members, POLYUNSIGNED k);
+    POLYUNSIGNED Minimise(POLYUNSIGNED *members, POLYUNSIGNED k);
+    POLYUNSIGNED CanonicalForm(POLYUNSIGNED m);
+    ShareComponent *FindComponent(POLYUNSIGNED hash, POLYUNSIGNED formSize);
+    void AddComponent(POLYUNSIGNED hash, POLYUNSIGNED formSize, POLYUNSIGNED m);
+
+    void ResolveForwarding(ShareCell *cell);
+    void Retain(ShareCell *cell);
+    void Merge(ShareCell *cell, PolyObject *shareWith);
+    PolyObject *FindContents(PolyObject *obj, unsigned length);
+    void AddContents(PolyObject *obj, unsigned length);
+    bool GrowContents(void);
+
+    ShareCell *CellFor(PolyWord w) const
+    {
+        if (! w.IsDataPtr() || ! w.AsObjPtr()->ContainsShareChain())
+            return 0;
+        return &cells[OBJ_GET_DEPTH(w.AsObjPtr()->LengthWord())];
+    }
+
+    ShareCell *cells;
+    POLYUNSIGNED cellCount, maxCells;
+    POLYUNSIGNED *callStack, *componentStack;
+
+    // Hash table of the retained cells.
+    PolyObject **contents;
+    POLYUNSIGNED contentsSize, contentsCount;
+
+    // Hash table of the retained components.
+    ShareComponent **components;
+    POLYUNSIGNED componentsSize, componentsCount;
+
+    // Work space for minimising components.
+    POLYUNSIGNED *keys, *classes, *newClasses, *keyTable, *reps;
+    // Work space for the canonical form.
+    POLYUNSIGNED *form, *bestForm, *order, *bestOrder, *position;
+    PolyObject **repObjs;
+
+    POLYUNSIGNED shareCount[NUM_WORD_VECTORS];
+    POLYUNSIGNED componentCount, componentCells;
+};
+
+WordSharing::WordSharing(): cells(0), cellCount(0), maxCells(0), callStack(0), componentStack(0),
+    contents(0), contentsSize(0), contentsCount(0), components(0), componentsSize(0), componentsCount(0),
+    keys(0), classes(0), newClasses(0), keyTable(0), reps(0),
+    form(0), bestForm(0), order(0), bestOrder(0), position(0), repObjs(0),
+    componentCount(0), componentCells(0)
 {
-    GetSharing *s = (GetSharing*)a;
     for (unsigned i = 0; i < NUM_WORD_VECTORS; i++)
+        shareCount[i] = 0;
+}
+
+WordSharing::~WordSharing()
+{
+    free(cells); free(callStack); free(componentStack); free(contents);
+    for (POLYUNSIGNED i = 0; i < componentsSize; i++)
+        free(components[i]);
+    free(components);
+    free(keys); free(classes); free(newClasses); free(keyTable); free(reps);
+    free(form); free(bestForm); free(order); free(bestOrder); free(position); free(repObjs);
+}
+
+bool WordSharing::Initialise(POLYUNSIGNED nCells)
+{
+    maxCells = nCells;
+    POLYUNSIGNED formWords = SHARE_MAX_CANONICAL * (NUM_WORD_VECTORS+1);
+    cells = (ShareCell*)malloc(nCells * sizeof(ShareCell));
+    callStack = (POLYUNSIGNED*)malloc(nCells * sizeof(POLYUNSIGNED));
+    componentStack = (POLYUNSIGNED*)malloc(nCells * sizeof(POLYUNSIGNED));
+    keys = (POLYUNSIGNED*)malloc(SHARE_MAX_COMPONENT * SHARE_KEY_WIDTH * sizeof(POLYUNSIGNED));
+    classes = (POLYUNSIGNED*)malloc(SHARE_MAX_COMPONENT * sizeof(POLYUNSIGNED));
+    newClasses = (POLYUNSIGNED*)malloc(SHARE_MAX_COMPONENT * sizeof(POLYUNSIGNED));
+    keyTable = (POLYUNSIGNED*)malloc(SHARE_MAX_COMPONENT * 2 * sizeof(POLYUNSIGNED));
+    reps = (POLYUNSIGNED*)malloc(SHARE_MAX_COMPONENT * sizeof(POLYUNSIGNED));
+    form = (POLYUNSIGNED*)malloc(formWords * sizeof(POLYUNSIGNED));
+    bestForm = (POLYUNSIGNED*)malloc(formWords * sizeof(POLYUNSIGNED));
+    order = (POLYUNSIGNED*)malloc(SHARE_MAX_CANONICAL * sizeof(POLYUNSIGNED));
+    bestOrder = (POLYUNSIGNED*)malloc(SHARE_MAX_CANONICAL * sizeof(POLYUNSIGNED));
+    position = (POLYUNSIGNED*)malloc(SHARE_MAX_CANONICAL * sizeof(POLYUNSIGNED));
+    repObjs = (PolyObject**)malloc(SHARE_MAX_COMPONENT * sizeof(PolyObject*));
+    return cells != 0 && callStack != 0 && componentStack != 0 && keys != 0 && classes != 0 &&
+        newClasses != 0 && keyTable != 0 && reps != 0 && form != 0 && bestForm != 0 &&
+        order != 0 && bestOrder != 0 && position != 0 && repObjs != 0;
+}
+
+void WordSharing::AddCell(PolyObject *obj, unsigned length)
+{
+    ASSERT(cellCount < maxCells);
+    ShareCell *cell = &cells[cellCount];
+    cell->obj = obj;
+    cell->index = 0;
+    cell->lowLink = 0;
+    cell->length = length;
+    cell->next = 0;
+    obj->SetLengthWord(OBJ_SET_DEPTH(cellCount));
+    cellCount++;
+}
+
+static POLYUNSIGNED hashWords(const POLYUNSIGNED *p, POLYUNSIGNED length)
+{
+    const POLYUNSIGNED mult = (POLYUNSIGNED)0x9E3779B97F4A7C15ULL;
+    POLYUNSIGNED h = length;
+    for (POLYUNSIGNED i = 0; i < length; i++)
+        h = (h ^ p[i]) * mult;
+    h ^= h >> (sizeof(POLYUNSIGNED)*4);
+    return h * mult;
+}
+
+// Update any addresses of cells that have been merged.
+void WordSharing::ResolveForwarding(ShareCell *cell)
+{
+    for (unsigned i = 0; i < cell->length; i++)
     {
-        if (s->wordVectors[i].CurrentCount() != 0)
-            gpTaskFarm->AddWorkOrRunNow(SortVector::wordDataTask, &(s->wordVectors[i]), 0);
+        PolyWord w = cell->obj->Get(i);
+        if (w.IsDataPtr() && w.AsObjPtr()->ContainsForwardingPtr())
+        {
+            PolyObject *p = w.AsObjPtr();
+            while (p->ContainsForwardingPtr())
+                p = p->GetForwardingPtr();
+            cell->obj->Set(i, p);
+        }
     }
 }
 
-// Share any entries left.
-void GetSharing::shareRemainingWordData(GCTaskId *, void *a, void *)
+// This cell is not merged with any other.
+void WordSharing::Retain(ShareCell *cell)
 {
-    GetSharing *s = (GetSharing*)a;
-    for (unsigned i = 0; i < NUM_WORD_VECTORS; i++)
+    cell->obj->SetLengthWord(cell->length);
+    AddContents(cell->obj, cell->length);
+}
+
+void WordSharing::Merge(ShareCell *cell, PolyObject *shareWith)
+{
+    cell->obj->SetForwardingPtr(shareWith);
+    shareCount[cell->length-1]++;
+}
+
+PolyObject *WordSharing::FindContents(PolyObject *obj, unsigned length)
+{
+    if (contentsSize == 0)
+        return 0;
+    POLYUNSIGNED slot = hashWords((POLYUNSIGNED*)obj, length) & (contentsSize-1);
+    for (;;)
+    {
+        PolyObject *entry = contents[slot];
+        if (entry == 0)
+            return 0;
+        if (entry->Length() == length && memcmp(entry, obj, length*sizeof(PolyWord)) == 0)
+            return entry;
+        slot = (slot+1) & (contentsSize-1);
+    }
+}
+
+bool WordSharing::GrowContents()
+{
+    POLYUNSIGNED newSize = contentsSize == 0 ? 1024 : contentsSize * 2;
+    PolyObject **newTable = (PolyObject**)calloc(newSize, sizeof(PolyObject*));
+    if (newTable == 0)
+        return false;
+    for (POLYUNSIGNED i = 0; i < contentsSize; i++)
     {
-        if (s->wordVectors[i].CurrentCount() != 0)
-            gpTaskFarm->AddWorkOrRunNow(SortVector::hashAndSortAllTask, &(s->wordVectors[i]), 0);
+        PolyObject *entry = contents[i];
+        if (entry == 0) continue;
+        POLYUNSIGNED slot = hashWords((POLYUNSIGNED*)entry, entry->Length()) & (newSize-1);
+        while (newTable[slot] != 0)
+            slot = (slot+1) & (newSize-1);
+        newTable[slot] = entry;
+    }
+    free(contents);
+    contents = newTable;
+    contentsSize = newSize;
+    return true;
+}
+
+// Add a retained cell to the table.  If we can't grow the table we just
+// lose the chance to share with this cell.
+void WordSharing::AddContents(PolyObject *obj, unsigned length)
+{
+    if ((contentsCount+1) * 2 > contentsSize && ! GrowContents() && contentsCount+1 >= contentsSize)
+        return;
+    POLYUNSIGNED slot = hashWords((POLYUNSIGNED*)obj, length) & (contentsSize-1);
+    while (contents[slot] != 0)
+        slot = (slot+1) & (contentsSize-1);
+    contents[slot] = obj;
+    contentsCount++;
+}
+
+// A cell that is not part of a loop.  Every cell it points to has been
+// processed so it can share with any retained cell with the same contents.
+void WordSharing::ProcessSingleton(ShareCell *cell)
+{
+    ResolveForwarding(cell);
+    PolyObject *shareWith = FindContents(cell->obj, cell->length);
+    if (shareWith != 0)
+        Merge(cell, shareWith);
+    else Retain(cell);
+}
+
+// Find the coarsest partition of the cells of a component such that cells in
+// the same class have the same contents apart from addresses of cells in
+// the component and those addresses are of cells in the same class.  Starting
+// with a single class the classes are refined until the number of classes
+// stops changing.  Returns the number of classes.
+POLYUNSIGNED WordSharing::Minimise(POLYUNSIGNED *members, POLYUNSIGNED k)
+{
+    POLYUNSIGNED tableSize = 4;
+    while (tableSize < k * 2)
+        tableSize *= 2;
+    for (POLYUNSIGNED i = 0; i < k; i++)
+        classes[i] = 0;
+    POLYUNSIGNED nClasses = 1;
+
+    for (;;)
+    {
+        for (POLYUNSIGNED i = 0; i < k; i++)
+        {
+            ShareCell *cell = &cells[members[i]];
+            POLYUNSIGNED *key = keys + i * SHARE_KEY_WIDTH;
+            key[0] = classes[i];
+            key[1] = cell->length;
+            for (unsigned j = 0; j < NUM_WORD_VECTORS; j++)
+            {
+                if (j >= cell->length)
+                    key[j+2] = 0;
+                else
+                {
+                    PolyWord w = cell->obj->Get(j);
+                    ShareCell *target = CellFor(w);
+                    // Addresses of cells within the component are replaced by their class.
+                    // The result cannot be the same as a tagged value or an address.
+                    if (target != 0)
+                        key[j+2] = (classes[target->lowLink] << 2) | 2;
+                    else key[j+2] = w.AsUnsigned();
+                }
+            }
+        }
+
+        for (POLYUNSIGNED t = 0; t < tableSize; t++)
+            keyTable[t] = 0;
+        POLYUNSIGNED newCount = 0;
+        for (POLYUNSIGNED i = 0; i < k; i++)
+        {
+            POLYUNSIGNED *key = keys + i * SHARE_KEY_WIDTH;
+            POLYUNSIGNED slot = hashWords(key, SHARE_KEY_WIDTH) & (tableSize-1);
+            for (;;)
+            {
+                POLYUNSIGNED entry = keyTable[slot];
+                if (entry == 0)
+                {
+                    keyTable[slot] = i+1;
+                    newClasses[i] = newCount++;
+                    break;
+                }
+                if (memcmp(keys + (entry-1) * SHARE_KEY_WIDTH, key, SHARE_KEY_WIDTH*sizeof(POLYUNSIGNED)) == 0)
+                {
+                    newClasses[i] = newClasses[entry-1];
+                    break;
+                }
+                slot = (slot+1) & (tableSize-1);
+            }
+        }
+
+        // Each pass can only split classes so if the number is unchanged so is the partition.
+        if (newCount == nClasses)
+            return nClasses;
+        for (POLYUNSIGNED i = 0; i < k; i++)
+            classes[i] = newClasses[i];
+        nClasses = newCount;
+    }
+}
+
+// Compute the canonical form of a minimised component.  The form is built
+// from each cell in turn by a breadth-first scan and the smallest is chosen.
+// The minimised component has no automorphisms other than the identity so
+// two components are the same if and only if their forms are the same.
+// The cells are the representatives in repObjs and the lowLink field holds
+// the class.  Returns the size of the form and leaves the form in bestForm
+// and the order of the classes in bestOrder.
+POLYUNSIGNED WordSharing::CanonicalForm(POLYUNSIGNED m)
+{
+    POLYUNSIGNED bestSize = 0;
+    for (POLYUNSIGNED start = 0; start < m; start++)
+    {
+        for (POLYUNSIGNED i = 0; i < m; i++)
+            position[i] = m;
+        order[0] = start;
+        position[start] = 0;
+        POLYUNSIGNED ordered = 1, formSize = 0;
+        for (POLYUNSIGNED n = 0; n < ordered; n++)
+        {
+            ShareCell *cell = &cells[OBJ_GET_DEPTH(repObjs[order[n]]->LengthWord())];
+            form[formSize++] = cell->length;
+            for (unsigned j = 0; j < cell->length; j++)
+            {
+                PolyWord w = cell->obj->Get(j);
+                ShareCell *target = CellFor(w);
+                if (target != 0)
+                {
+                    POLYUNSIGNED c = target->lowLink;
+                    if (position[c] == m)
+                    {
+                        position[c] = ordered;
+                        order[ordered++] = c;
+                    }
+                    form[formSize++] = (position[c] << 2) | 2;
+                }
+                else form[formSize++] = w.AsUnsigned();
+            }
+        }
+        ASSERT(ordered == m);
+        if (start == 0 || formSize < bestSize ||
+            (formSize == bestSize && memcmp(form, bestForm, formSize*sizeof(POLYUNSIGNED)) < 0))
+        {
+            memcpy(bestForm, form, formSize*sizeof(POLYUNSIGNED));
+            memcpy(bestOrder, order, m*sizeof(POLYUNSIGNED));
+            bestSize = formSize;
+        }
+    }
+    return bestSize;
+}
+
+ShareComponent *WordSharing::FindComponent(POLYUNSIGNED hash, POLYUNSIGNED formSize)
+{
+    if (componentsSize == 0)
+        return 0;
+    POLYUNSIGNED slot = hash & (componentsSize-1);
+    for (;;)
+    {
+        ShareComponent *entry = components[slot];
+        if (entry == 0)
+            return 0;
+        if (entry->hash == hash && entry->formSize == formSize &&
+                memcmp(entry->form, bestForm, formSize*sizeof(POLYUNSIGNED)) == 0)
+            return entry;
+        slot = (slot+1) & (componentsSize-1);
+    }
+}
+
+// Record a retained component.  If there's insufficient memory we just
+// lose the chance to share with it.
+void WordSharing::AddComponent(POLYUNSIGNED hash, POLYUNSIGNED formSize, POLYUNSIGNED m)
+{
+    if ((componentsCount+1) * 2 > componentsSize)
+    {
+        POLYUNSIGNED newSize = componentsSize == 0 ? 64 : componentsSize * 2;
+        ShareComponent **newTable = (ShareComponent**)calloc(newSize, sizeof(ShareComponent*));
+        if (newTable == 0)
+            return;
+        for (POLYUNSIGNED i = 0; i < componentsSize; i++)
+        {
+            ShareComponent *entry = components[i];
+            if (entry == 0) continue;
+            POLYUNSIGNED slot = entry->hash & (newSize-1);
+            while (newTable[slot] != 0)
+                slot = (slot+1) & (newSize-1);
+            newTable[slot] = entry;
+        }
+        free(components);
+        components = newTable;
+        componentsSize = newSize;
+    }
+    ShareComponent *entry =
+        (ShareComponent*)malloc(sizeof(ShareComponent) + formSize*sizeof(POLYUNSIGNED) + m*sizeof(PolyObject*));
+    if (entry == 0)
+        return;
+    entry->hash = hash;
+    entry->formSize = formSize;
+    entry->cellCount = m;
+    entry->form = (POLYUNSIGNED*)(entry+1);
+    entry->objs = (PolyObject**)(entry->form + formSize);
+    memcpy(entry->form, bestForm, formSize*sizeof(POLYUNSIGNED));
+    for (POLYUNSIGNED i = 0; i < m; i++)
+        entry->objs[i] = repObjs[bestOrder[i]];
+    POLYUNSIGNED slot = hash & (componentsSize-1);
+    while (components[slot] != 0)
+        slot = (slot+1) & (componentsSize-1);
+    components[slot] = entry;
+    componentsCount++;
+}
+
+// Process a strongly connected component i.e. a group of cells that form a loop.
+// Every cell outside the component that these cells point to has already been
+// processed.  First the component is minimised by merging equivalent cells
+// within it and then, if it is the same as a component we have already retained,
+// the cells are merged with that.
+void WordSharing::ProcessComponent(POLYUNSIGNED *members, POLYUNSIGNED k)
+{
+    componentCount++;
+    componentCells += k;
+    for (POLYUNSIGNED i = 0; i < k; i++)
+        ResolveForwarding(&cells[members[i]]);
+
+    if (k > SHARE_MAX_COMPONENT)
+    {
+        for (POLYUNSIGNED i = 0; i < k; i++)
+            Retain(&cells[members[i]]);
+        return;
+    }
+
+    for (POLYUNSIGNED i = 0; i < k; i++)
+        cells[members[i]].lowLink = i;
+
+    POLYUNSIGNED m = Minimise(members, k);
+
+    // Choose the first cell in each class as its representative.
+    for (POLYUNSIGNED c = 0; c < m; c++)
+        reps[c] = k;
+    for (POLYUNSIGNED i = 0; i < k; i++)
+    {
+        if (reps[classes[i]] == k)
+        {
+            reps[classes[i]] = i;
+            repObjs[classes[i]] = cells[members[i]].obj;
+        }
+    }
+    // Make the representatives point to each other.  This must be done before
+    // any of the cells are merged because that overwrites the length word.
+    for (POLYUNSIGNED c = 0; c < m; c++)
+    {
+        ShareCell *cell = &cells[members[reps[c]]];
+        for (unsigned j = 0; j < cell->length; j++)
+        {
+            ShareCell *target = CellFor(cell->obj->Get(j));
+            if (target != 0)
+                cell->obj->Set(j, repObjs[classes[target->lowLink]]);
+        }
+    }
+    for (POLYUNSIGNED i = 0; i < k; i++)
+    {
+        if (reps[classes[i]] != i)
+            Merge(&cells[members[i]], repObjs[classes[i]]);
+    }
+    for (POLYUNSIGNED c = 0; c < m; c++)
+        cells[members[reps[c]]].lowLink = c;
+
+    if (m <= SHARE_MAX_CANONICAL)
+    {
+        POLYUNSIGNED formSize = CanonicalForm(m);
+        POLYUNSIGNED hash = hashWords(bestForm, formSize);
+        ShareComponent *existing = FindComponent(hash, formSize);
+        if (existing != 0)
+        {
+            ASSERT(existing->cellCount == m);
+            for (POLYUNSIGNED i = 0; i < m; i++)
+                Merge(&cells[OBJ_GET_DEPTH(repObjs[bestOrder[i]]->LengthWord())], existing->objs[i]);
+            return;
+        }
+        AddComponent(hash, formSize, m);
+    }
+
+    for (POLYUNSIGNED c = 0; c < m; c++)
+        Retain(&cells[members[reps[c]]]);
+}
+
+// Find the strongly connected components using Tarjan's algorithm.  The
+// components are found in reverse topological order so that when we process
+// a component every cell it points to outside the component has already been
+// processed.
+void WordSharing::Run()
+{
+    POLYUNSIGNED dfsNumber = 0, csp = 0, tsp = 0;
+
+    for (POLYUNSIGNED root = 0; root < cellCount; root++)
+    {
+        if (cells[root].index != 0)
+            continue;
+        cells[root].index = cells[root].lowLink = ++dfsNumber;
+        callStack[csp++] = root;
+        componentStack[tsp++] = root;
+
+        while (csp != 0)
+        {
+            POLYUNSIGNED v = callStack[csp-1];
+            ShareCell *cell = &cells[v];
+            if (cell->next < cell->length)
+            {
+                ShareCell *target = CellFor(cell->obj->Get(cell->next++));
+                // Cells in components already processed are no longer share chains
+                // so a target that has been visited is still on the component stack.
+                if (target == 0)
+                    continue;
+                if (target->index == 0)
+                {
+                    target->index = target->lowLink = ++dfsNumber;
+                    callStack[csp++] = target - cells;
+                    componentStack[tsp++] = target - cells;
+                }
+                else if (target->index < cell->lowLink)
+                    cell->lowLink = target->index;
+                continue;
+            }
+
+            // Finished this cell.
+            csp--;
+            if (csp != 0 && cell->lowLink < cells[callStack[csp-1]].lowLink)
+                cells[callStack[csp-1]].lowLink = cell->lowLink;
+
+            if (cell->lowLink == cell->index)
+            {
+                // This is the root of a component.  The cells are at the top of the stack.
+                POLYUNSIGNED base = tsp;
+                do base--; while (componentStack[base] != v);
+                POLYUNSIGNED k = tsp - base;
+                tsp = base;
+                bool isLoop = k > 1;
+                for (unsigned j = 0; j < cell->length && ! isLoop; j++)
+                    isLoop = CellFor(cell->obj->Get(j)) == cell;
+                if (isLoop)
+                    ProcessComponent(componentStack + base, k);
+                else ProcessSingleton(cell);
+            }
+        }
     }
 }
 
@@ -505,70 +973,35 @@ void GetSharing::SortData()
     gpTaskFarm->AddWorkOrRunNow(shareByteData, this, 0);
     gpTaskFarm->WaitForCompletion();
 
-    // Word data may contain pointers to other objects.  If an object
-    // has been processed its header will contain either a normal length
-    // word or a forwarding pointer if it shares.  We can process an
-    // object if every word in it is either a tagged integer or an
-    // address we have already processed.  This works provided there
-    // are no loops so when we reach a stage where we are unable to
-    // process anything we simply run a final scan on the remainder.
-    // Loops can arise from the closures of mutually recursive functions.
-
-    // Now process the word entries until we have nothing left apart from loops.
-    POLYUNSIGNED lastCount = 0, lastShared = 0;
+    // Word data may contain pointers to other objects including loops.
+    // The cells are processed as a graph in a single scan.
+    POLYUNSIGNED wordCount = 0;
     for (unsigned n = 0; n < NUM_WORD_VECTORS; n++)
-        lastCount += wordVectors[n].CurrentCount();
+        wordCount += wordVectors[n].CurrentCount();
 
-    for(unsigned pass = 1; lastCount != 0; pass++)
+    WordSharing wordSharing;
+    bool canShare = wordSharing.Initialise(wordCount);
+    for (unsigned i = 0; i < NUM_WORD_VECTORS; i++)
     {
-        gpTaskFarm->AddWorkOrRunNow(shareWordData, this, 0);
-        gpTaskFarm->WaitForCompletion();
-
-        // At each stage check that we have removed some items
-        // from the lists.
-        POLYUNSIGNED postCount = 0, postShared = 0, carryOver = 0;
-        for (unsigned i = 0; i < NUM_WORD_VECTORS; i++)
+        PolyObject *h = wordVectors[i].TakeList();
+        while (h != 0)
         {
-            postCount += wordVectors[i].CurrentCount();
-            postShared += wordVectors[i].Shared();
-            carryOver += wordVectors[i].CarryOver();
+            PolyObject *next = h->GetShareChain();
+            if (canShare)
+                wordSharing.AddCell(h, i+1);
+            else h->SetLengthWord(i+1); // Insufficient memory: just restore the length word
+            h = next;
         }
-
-        if (debugOptions & DEBUG_GC)
-            Log("GC: Share: Pass %u: %" POLYUFMT " removed (%1.1f%%) %" POLYUFMT " shared (%1.1f%%) %" POLYUFMT " remain. %"POLYUFMT" entries updated (%1.1f%%).\n",
-                pass, lastCount-postCount, (double)(lastCount-postCount) / (double) lastCount * 100.0,
-                postShared - lastShared, (double)(postShared - lastShared) / (double) (lastCount-postCount) * 100.0,
-                postCount, carryOver, (double)carryOver / (double)(lastCount-postCount) * 100.0);
-
-        // Condition for exiting the loop.  There are some heuristics here.
-        // If we remove less than 10% in a pass it's probably not worth continuing
-        // unless the carry over is large.  The "carry over" is the number of words updated as
-        // a result of the last pass.  It represents the extra sharing we gained in this pass
-        // as a result of the last pass.  If there are deep data structures that can be shared
-        // we get better sharing with more passes.  If the data structures are shallow we will
-        // get as much sharing by just running the final pass.  The first pass only carries
-        // over any sharing from the byte objects so we need to run at least one more before
-        // checking the carry over.
-        if (pass > 1 && (lastCount - postCount) * 10 < lastCount && carryOver*2 < (lastCount-postCount))
-            break;
-
-        lastCount = postCount;
-        lastShared = postShared;
     }
 
-    // Process any remaining entries.  There may be loops.
-    gpTaskFarm->AddWorkOrRunNow(shareRemainingWordData, this, 0);
-    gpTaskFarm->WaitForCompletion();
-
-    if (debugOptions & DEBUG_GC)
+    if (canShare)
     {
-        POLYUNSIGNED postShared = 0;
-        for (unsigned i = 0; i < NUM_WORD_VECTORS; i++)
-            postShared += wordVectors[i].Shared();
+        wordSharing.Run();
+        for (unsigned j = 0; j < NUM_WORD_VECTORS; j++)
+            wordVectors[j].AddShared(wordSharing.Shared(j+1));
         if (debugOptions & DEBUG_GC)
-            Log("GC: Share: Final pass %" POLYUFMT " removed %" POLYUFMT " shared (%1.1f%%).\n",
-                lastCount, postShared - lastShared,
-                (double)(postShared - lastShared) / (double) lastCount * 100.0);
+            Log("GC: Share: %" POLYUFMT " loops containing %" POLYUFMT " word objects.\n",
+                wordSharing.Components(), wordSharing.ComponentCells());
     }
 
     // Calculate the totals.
@@ -59,6 +59,8 @@ GCTaskFarm::GCTaskFarm(): workLock("GC task farm work")
     workQueue = 0;
     terminate = false;
     threadCount = activeThreadCount = 0;
+    requestedThreads = 0;
+    threadsStarted = false;
 #if (defined(HAVE_PTHREAD_H) || defined(HAVE_WINDOWS_H))
     threadHandles = 0;
 #endif
@@ -91,8 +93,20 @@ bool GCTaskFarm::Initialise(unsigned thrdCount, unsigned qSize)
 #else
     queueSize = 0;
 #endif
-    // Create the worker threads.
-    for (unsigned i = 0; i < thrdCount; i++) {
+    // The worker threads are not created until there is some work for them.
+    // Many programs, particularly short-running exported ones, finish before
+    // the first GC and creating a thread for each processor would be a
+    // significant part of their start-up time.
+    requestedThreads = thrdCount;
+    return true;
+}
+
+// Create the worker threads.  Called with workLock held when the first work
+// is added.
+void GCTaskFarm::StartThreads()
+{
+    threadsStarted = true;
+    for (unsigned i = 0; i < requestedThreads; i++) {
         // Fork a thread
 #if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
         // Create a thread that isn't joinable since we don't want to wait
@@ -109,8 +123,6 @@ bool GCTaskFarm::Initialise(unsigned thrdCount, unsigned qSize)
         threadHandles[threadCount++] = threadHandle;
 #endif
     }
-
-    return true;
 }
 
 void GCTaskFarm::Terminate()
@@ -138,6 +150,7 @@ bool GCTaskFarm::AddWork(gctask work, void *arg1, void *arg2)
     {
         PLocker l(&workLock);
         if (queuedItems == queueSize) return false; // Queue is full
+        if (! threadsStarted) StartThreads();
         workQueue[queueIn].task = work;
         workQueue[queueIn].arg1 = arg1;
         workQueue[queueIn].arg2 = arg2;
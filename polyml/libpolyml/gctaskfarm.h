@@ -57,7 +57,9 @@ public:
     // it's worth sparking off some new work.
     bool Draining(void) const { return queuedItems == 0; }
 
-    unsigned ThreadCount(void) const { return threadCount; }
+    // The number of workers.  This is the number requested until the
+    // threads have actually been created.
+    unsigned ThreadCount(void) const { return threadsStarted ? threadCount : requestedThreads; }
 
 private:
     // The semaphore is zero if there is no work or some value up to
@@ -74,7 +76,10 @@ private:
     bool terminate; // Set to true to kill all workers.
     unsigned threadCount; // Count of workers.
     unsigned activeThreadCount; // Count of workers doing work.
+    unsigned requestedThreads; // Number of workers to create.
+    bool threadsStarted; // Set once the workers have been created.
 
+    void StartThreads(void);
     void ThreadFunction(void);
 
 #if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
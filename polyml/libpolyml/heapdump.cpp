@@ -0,0 +1,235 @@
+/*
+    Title:  heapdump.cpp - Write the heap graph to a file
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+This writes every object in the local and permanent areas together with the
+addresses it contains and the roots held by the run-time system and the
+thread stacks.  The file is intended to be processed off-line, for example by
+polyheap which computes the retained size of each object from the dominator
+tree.  A full GC is run first so that the local areas contain only live data.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#include "globals.h"
+#include "heapdump.h"
+#include "processes.h"
+#include "run_time.h"
+#include "polystring.h"
+#include "scanaddrs.h"
+#include "memmgr.h"
+#include "rts_module.h"
+#include "gc.h"
+#include "machine_dep.h"
+#include "diagnostics.h"
+
+#define SAVE(x) taskData->saveVec.push(x)
+
+#define HEAPDUMP_EDGE_BUFFER    1024    // Initial size of the buffer for the addresses in an object
+
+class HeapDumper: public ScanAddress
+{
+public:
+    HeapDumper(FILE *f): dumpFile(f), nEdges(0), maxEdges(0), edges(0), recordingRoots(false) {}
+    ~HeapDumper() { free(edges); }
+
+    void WriteNumber(POLYUNSIGNED n);
+    void WriteAddress(const void *p) { WriteNumber((POLYUNSIGNED)p / sizeof(PolyWord)); }
+
+    void DumpSpace(unsigned kind, bool isMutable, PolyWord *bottom, PolyWord *top);
+    void DumpArea(PolyWord *bottom, PolyWord *top);
+    void DumpRoots(void);
+
+    virtual PolyObject *ScanObjectAddress(PolyObject *base);
+    // Weak references do not keep anything live.
+    virtual void ScanRuntimeAddress(PolyObject **pt, RtsStrength weak)
+        { if (weak == STRENGTH_STRONG) (void)ScanObjectAddress(*pt); }
+
+    FILE *dumpFile;
+    POLYUNSIGNED nEdges, maxEdges;
+    PolyObject **edges;
+    bool recordingRoots;
+};
+
+void HeapDumper::WriteNumber(POLYUNSIGNED n)
+{
+    while (n >= 0x80)
+    {
+        putc((int)(n & 0x7f) | 0x80, dumpFile);
+        n >>= 7;
+    }
+    putc((int)n, dumpFile);
+}
+
+// Called for each address in an object or held by the RTS.
+PolyObject *HeapDumper::ScanObjectAddress(PolyObject *base)
+{
+    if (gMem.IsIOPointer(base))
+        return base; // Ignore references to the IO area.
+    if (recordingRoots)
+    {
+        putc('R', dumpFile);
+        WriteAddress(base);
+    }
+    else
+    {
+        if (nEdges == maxEdges)
+        {
+            POLYUNSIGNED newMax = maxEdges == 0 ? HEAPDUMP_EDGE_BUFFER : maxEdges * 2;
+            PolyObject **newEdges = (PolyObject**)realloc(edges, newMax * sizeof(PolyObject*));
+            if (newEdges == 0)
+                return base; // Just lose this edge.
+            edges = newEdges;
+            maxEdges = newMax;
+        }
+        edges[nEdges++] = base;
+    }
+    return base;
+}
+
+void HeapDumper::DumpArea(PolyWord *bottom, PolyWord *top)
+{
+    for (PolyWord *p = bottom; p < top; )
+    {
+        p++;
+        PolyObject *obj = (PolyObject*)p;
+        POLYUNSIGNED L = obj->LengthWord();
+        POLYUNSIGNED length = OBJ_OBJECT_LENGTH(L);
+        nEdges = 0;
+        ScanAddressesInObject(obj, L);
+        putc('O', dumpFile);
+        WriteAddress(obj);
+        WriteNumber(length);
+        WriteNumber(L >> OBJ_PRIVATE_FLAGS_SHIFT);
+        WriteNumber(nEdges);
+        for (POLYUNSIGNED i = 0; i < nEdges; i++)
+            WriteAddress(edges[i]);
+        p += length;
+    }
+}
+
+void HeapDumper::DumpSpace(unsigned kind, bool isMutable, PolyWord *bottom, PolyWord *top)
+{
+    putc('S', dumpFile);
+    WriteNumber(kind);
+    WriteNumber(isMutable ? 1 : 0);
+    WriteAddress(bottom);
+    WriteAddress(top);
+}
+
+void HeapDumper::DumpRoots(void)
+{
+    recordingRoots = true;
+    GCModules(this);
+    recordingRoots = false;
+}
+
+class HeapDumpRequest: public MainThreadRequest
+{
+public:
+    HeapDumpRequest(const char *name): MainThreadRequest(MTP_HEAPDUMP),
+        fileName(name), errorMessage(0), errCode(0) {}
+
+    virtual void Perform();
+    const char *fileName;
+    const char *errorMessage;
+    int errCode;
+};
+
+void HeapDumpRequest::Perform()
+{
+    FILE *dumpFile = fopen(fileName, "wb");
+    if (dumpFile == 0)
+    {
+        errorMessage = "Cannot open heap dump file";
+        errCode = errno;
+        return;
+    }
+    HeapDumper dumper(dumpFile);
+
+    fputs(HEAPDUMP_MAGIC, dumpFile);
+    dumper.WriteNumber(HEAPDUMP_VERSION);
+    dumper.WriteNumber(sizeof(PolyWord));
+
+    for (unsigned i = 0; i < gMem.npSpaces; i++)
+    {
+        PermanentMemSpace *space = gMem.pSpaces[i];
+        dumper.DumpSpace(HEAPDUMP_SPACE_PERMANENT, space->isMutable, space->bottom, space->top);
+        dumper.DumpArea(space->bottom, space->top);
+    }
+
+    for (unsigned j = 0; j < gMem.nlSpaces; j++)
+    {
+        LocalMemSpace *space = gMem.lSpaces[j];
+        dumper.DumpSpace(HEAPDUMP_SPACE_LOCAL, space->isMutable, space->bottom, space->top);
+        dumper.DumpArea(space->bottom, space->lowerAllocPtr);
+        dumper.DumpArea(space->upperAllocPtr, space->top);
+    }
+
+    dumper.DumpRoots();
+    putc('E', dumpFile);
+
+    if (ferror(dumpFile))
+    {
+        errorMessage = "Error while writing heap dump file";
+        errCode = errno;
+    }
+    fclose(dumpFile);
+}
+
+// Write the heap graph to the file.
+Handle HeapDump(TaskData *taskData, Handle fileName)
+{
+    char *name = Poly_string_to_C_alloc(DEREFHANDLE(fileName));
+    if (name == 0)
+        raise_syscall(taskData, "Insufficient memory", ENOMEM);
+    // Run a full GC first so that only live data is written.
+    FullGC(taskData);
+
+    HeapDumpRequest request(name);
+    processes->MakeRootRequest(taskData, &request);
+    free(name);
+    if (request.errorMessage)
+        raise_syscall(taskData, request.errorMessage, request.errCode);
+    return SAVE(TAGGED(0));
+}
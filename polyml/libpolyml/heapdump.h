@@ -0,0 +1,55 @@
+/*
+    Title:  heapdump.h - Write the heap graph to a file
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef HEAPDUMP_H_INCLUDED
+#define HEAPDUMP_H_INCLUDED
+
+/*
+Format of the heap dump file.  This is read by polyheap.
+All numbers are unsigned LEB128 values i.e. seven bits per byte, least
+significant group first, with the top bit set on all but the last byte.
+Addresses are written as word numbers i.e. the byte address divided by
+the word size.
+
+Header:     "POLYHEAP", version, bytes per word.
+Then a sequence of records each beginning with a single tag byte:
+'S'         Start of a memory space: kind (HEAPDUMP_SPACE_LOCAL or
+            HEAPDUMP_SPACE_PERMANENT), 1 if mutable else 0, bottom, top.
+            The objects that follow are in this space.
+'O'         Object: address, length in words, flags (the top byte of the
+            length word), number of addresses, the addresses.
+'R'         Root: an address held by the run-time system or a thread stack.
+'E'         End of the file.
+*/
+
+#define HEAPDUMP_MAGIC          "POLYHEAP"
+#define HEAPDUMP_VERSION        1
+
+#define HEAPDUMP_SPACE_LOCAL        0
+#define HEAPDUMP_SPACE_PERMANENT    1
+
+class SaveVecEntry;
+typedef SaveVecEntry *Handle;
+class TaskData;
+
+extern Handle HeapDump(TaskData *taskData, Handle fileName);
+
+#endif
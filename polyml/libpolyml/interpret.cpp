@@ -232,6 +232,10 @@ int Interpreter::SwitchToPoly(TaskData *taskData)
     IntTaskData *itd = (IntTaskData *)taskData->mdTaskData;
 
     if (li != 256) goto RETRY; /* Re-execute instruction if necessary. */
+    /* A tail call to the RTS from the outermost function of a thread
+       returns to the end-of-thread address. */
+    if (pc == (SPECIAL_PC_END_THREAD).AsCodePtr())
+        exitThread(taskData);
 
     for(;;){ /* Each instruction */
 
@@ -763,6 +767,9 @@ int Interpreter::SwitchToPoly(TaskData *taskData)
                         taskData->stack->stack()->p_sp = sp-1; /* Include the closure address. */
                         return (int)uu;
                     }
+                    /* As above if this was a tail call. */
+                    if (pc == (SPECIAL_PC_END_THREAD).AsCodePtr())
+                        exitThread(taskData);
                 } /* End of system calls. */
                 else {
                     sp--;
@@ -1484,7 +1491,7 @@ void Interpreter::InitInterfaceVector(void)
 
 // Increment the value contained in the first word of the mutex.
 // On most platforms this code will be done with a piece of assembly code.
-static PLock mutexLock;
+static PLock mutexLock("Interpreter mutex");
 
 Handle Interpreter::AtomicIncrement(TaskData *taskData, Handle mutexp)
 {
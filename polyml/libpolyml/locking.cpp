@@ -74,13 +74,57 @@
 #include <stdio.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
 #include "locking.h"
 #include "diagnostics.h"
+#include "rts_module.h"
+#include "sighandler.h"
 
 // Report contended locks after this many attempts
 #define LOCK_REPORT_COUNT   50
 
-PLock::PLock(const char *n): lockName(n), lockCount(0)
+// Lock profiling.  Each named lock is added to the list the first time it is
+// locked after profiling has started.  When a lock is deleted its counts are
+// added to the totals for locks with that name so that the counts for locks
+// in, for example, memory spaces that have since been freed are not lost.
+typedef struct _retiredLock {
+    const char *name;
+    unsigned long acquisitions, contended;
+    unsigned long long waitTime;
+    struct _retiredLock *next;
+} RetiredLock;
+
+static bool lockProfiling = false;
+static PLock *profiledLocks = 0; // List of locks that have been used.
+static RetiredLock *retiredLocks = 0;
+static PLock profileListLock; // Protects the lists.  Must not be named.
+static volatile bool lockProfileRequested = false; // Set by the signal handler
+
+static unsigned long long LockTimeNow(void)
+{
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULARGE_INTEGER li;
+    li.LowPart = ft.dwLowDateTime;
+    li.HighPart = ft.dwHighDateTime;
+    return li.QuadPart / 10;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+PLock::PLock(const char *n): lockName(n), lockCount(0), acquisitions(0), contended(0),
+    waitTime(0), isProfiled(false), nextProfiled(0)
 {
 #ifdef HAVE_PTHREAD
     pthread_mutex_init(&lock, 0);
@@ -91,6 +135,33 @@ PLock::PLock(const char *n): lockName(n), lockCount(0)
 
 PLock::~PLock()
 {
+    if (isProfiled && lockProfiling)
+    {
+        PLocker lock(&profileListLock);
+        for (PLock **p = &profiledLocks; *p != 0; p = &(*p)->nextProfiled)
+        {
+            if (*p == this)
+            {
+                *p = nextProfiled;
+                break;
+            }
+        }
+        RetiredLock *r = retiredLocks;
+        while (r != 0 && strcmp(r->name, lockName) != 0)
+            r = r->next;
+        if (r == 0 && (r = (RetiredLock*)calloc(1, sizeof(RetiredLock))) != 0)
+        {
+            r->name = lockName;
+            r->next = retiredLocks;
+            retiredLocks = r;
+        }
+        if (r != 0)
+        {
+            r->acquisitions += acquisitions;
+            r->contended += contended;
+            r->waitTime += waitTime;
+        }
+    }
 #ifdef HAVE_PTHREAD
     pthread_mutex_destroy(&lock);
 #elif defined(HAVE_WINDOWS_H)
@@ -101,6 +172,11 @@ PLock::~PLock()
 void PLock::Lock(void)
 {
 #if (defined(HAVE_PTHREAD) || defined(HAVE_WINDOWS_H))
+    if (lockProfiling && lockName != 0)
+    {
+        ProfiledLock();
+        return;
+    }
     if (debugOptions & DEBUG_CONTENTION)
     {
         // Report a heavily contended lock.
@@ -134,6 +210,30 @@ void PLock::Unlock(void)
 #endif
 }
 
+// Lock the mutex and record whether we had to wait and for how long.
+void PLock::ProfiledLock(void)
+{
+    if (! Trylock())
+    {
+        unsigned long long startWait = LockTimeNow();
+#ifdef HAVE_PTHREAD
+        pthread_mutex_lock(&lock);
+#elif defined(HAVE_WINDOWS_H)
+        EnterCriticalSection(&lock);
+#endif
+        waitTime += LockTimeNow() - startWait;
+        contended++;
+    }
+    acquisitions++;
+    if (! isProfiled)
+    {
+        PLocker lock(&profileListLock);
+        nextProfiled = profiledLocks;
+        profiledLocks = this;
+        isProfiled = true;
+    }
+}
+
 bool PLock::Trylock(void)
 {
 #ifdef HAVE_PTHREAD
@@ -349,3 +449,122 @@ void PSemaphore::Signal(void)
 
 
 
+
+class LockProfiler: public RtsModule
+{
+public:
+    virtual void Init(void);
+    virtual void Stop(void);
+};
+
+// Declare this.  It will be automatically added to the table.
+static LockProfiler lockProfilerModule;
+
+#if (!defined(_WIN32) || defined(__CYGWIN__))
+// SIGUSR2 requests a report.  We can't do very much in a signal
+// handler so the report is written by the root thread.
+static void lockProfileSignal(SIG_HANDLER_ARGS(s, c))
+{
+    lockProfileRequested = true;
+}
+#endif
+
+void LockProfiler::Init(void)
+{
+    if ((debugOptions & DEBUG_LOCKPROFILE) == 0) return;
+#if (!defined(_WIN32) || defined(__CYGWIN__))
+    setSignalHandler(SIGUSR2, lockProfileSignal);
+    markSignalInuse(SIGUSR2);
+#endif
+    lockProfiling = true;
+}
+
+void LockProfiler::Stop(void)
+{
+    if (! lockProfiling) return;
+    ReportLockProfile();
+    // Stop profiling.  Locks that are deleted from now on, including the
+    // static locks, are not removed from the list.
+    lockProfiling = false;
+}
+
+typedef struct {
+    const char *name;
+    unsigned count; // Number of locks with this name
+    unsigned long acquisitions, contended;
+    unsigned long long waitTime;
+} LockProfileEntry;
+
+static LockProfileEntry *FindProfileEntry(LockProfileEntry *table, unsigned &entries, const char *name)
+{
+    for (unsigned i = 0; i < entries; i++)
+    {
+        if (strcmp(table[i].name, name) == 0)
+            return &table[i];
+    }
+    LockProfileEntry *entry = &table[entries++];
+    memset(entry, 0, sizeof(LockProfileEntry));
+    entry->name = name;
+    return entry;
+}
+
+// Sort with the longest waiting time first.
+static int compareProfileEntries(const void *a, const void *b)
+{
+    const LockProfileEntry *x = (const LockProfileEntry *)a, *y = (const LockProfileEntry *)b;
+    if (x->waitTime > y->waitTime) return -1;
+    if (x->waitTime < y->waitTime) return 1;
+    if (x->contended > y->contended) return -1;
+    if (x->contended < y->contended) return 1;
+    return 0;
+}
+
+// Write the profile.  The counts for each lock are read without holding the
+// lock so they may be slightly out of date.
+void ReportLockProfile(void)
+{
+    if (! lockProfiling) return;
+    PLocker lock(&profileListLock);
+    unsigned maxEntries = 0, entries = 0;
+    for (PLock *p = profiledLocks; p != 0; p = p->nextProfiled) maxEntries++;
+    for (RetiredLock *r = retiredLocks; r != 0; r = r->next) maxEntries++;
+    if (maxEntries == 0) return;
+    LockProfileEntry *table = (LockProfileEntry *)malloc(maxEntries * sizeof(LockProfileEntry));
+    if (table == 0) return;
+    for (PLock *p = profiledLocks; p != 0; p = p->nextProfiled)
+    {
+        LockProfileEntry *entry = FindProfileEntry(table, entries, p->lockName);
+        entry->count++;
+        entry->acquisitions += p->acquisitions;
+        entry->contended += p->contended;
+        entry->waitTime += p->waitTime;
+    }
+    for (RetiredLock *r = retiredLocks; r != 0; r = r->next)
+    {
+        LockProfileEntry *entry = FindProfileEntry(table, entries, r->name);
+        entry->acquisitions += r->acquisitions;
+        entry->contended += r->contended;
+        entry->waitTime += r->waitTime;
+    }
+    qsort(table, entries, sizeof(LockProfileEntry), compareProfileEntries);
+
+    Log("Lock profile:\n");
+    Log("%-24s %6s %12s %12s %8s %14s\n", "Lock", "Number", "Acquired", "Contended", "%", "Wait (us)");
+    for (unsigned i = 0; i < entries; i++)
+    {
+        LockProfileEntry *entry = &table[i];
+        double percent = entry->acquisitions == 0 ? 0.0 : (double)entry->contended * 100.0 / (double)entry->acquisitions;
+        Log("%-24s %6u %12lu %12lu %8.2f %14llu\n", entry->name, entry->count,
+            entry->acquisitions, entry->contended, percent, entry->waitTime);
+    }
+    free(table);
+}
+
+void CheckLockProfileRequest(void)
+{
+    if (lockProfileRequested)
+    {
+        lockProfileRequested = false;
+        ReportLockProfile();
+    }
+}
@@ -63,9 +63,25 @@ private:
     const char *lockName;
     unsigned lockCount;
 
+    // Profiling info.  Only named locks are profiled and only if
+    // --debug lockprofile is given.  These are updated with the lock held.
+    void ProfiledLock(void);
+    unsigned long acquisitions; // Total number of times the lock was acquired
+    unsigned long contended; // Number of times a thread had to wait
+    unsigned long long waitTime; // Total time spent waiting in microseconds
+    bool isProfiled; // True if this is on the list of profiled locks
+    PLock *nextProfiled;
+
     friend class PCondVar;
+    friend void ReportLockProfile(void);
 };
 
+// Write a summary of the lock profile to the log.
+extern void ReportLockProfile(void);
+// Called periodically by the root thread to write the profile if it has
+// been requested by a signal.
+extern void CheckLockProfileRequest(void);
+
 // Lock a mutex and automatically unlock it in the destructor.
 // This can be used in a function to lock a mutex and unlock it
 // when the function either returns normally or raises an exception.
@@ -102,7 +102,7 @@ bool LocalMemSpace::InitSpace(POLYUNSIGNED size, bool mut)
     return bitmap.Create(size);
 }
 
-MemMgr::MemMgr(): allocLock("Memmgr alloc")
+MemMgr::MemMgr(): stackSpaceLock("Memmgr stack"), allocLock("Memmgr alloc"), spaceTreeLock("Memmgr space tree")
 {
     npSpaces = nlSpaces = nsSpaces = 0;
     pSpaces = 0;
@@ -419,6 +419,9 @@ bool MemMgr::PromoteExportSpaces(unsigned hierarchy)
                 // Turn this into a local space.
                 // Remove this from the tree - AddLocalSpace will make an entry for the local version.
                 RemoveTree(pSpace);
+                if (pSpace->isReadOnly)
+                    osMemoryManager->SetPermissions(pSpace->bottom, (char*)pSpace->top - (char*)pSpace->bottom,
+                        PERMISSION_READ|PERMISSION_WRITE|PERMISSION_EXEC);
                 LocalMemSpace *space = new LocalMemSpace;
                 space->top = space->fullGCLowerLimit = pSpace->top;
                 space->bottom = space->upperAllocPtr = space->lowerAllocPtr = pSpace->bottom;
@@ -475,6 +478,9 @@ bool MemMgr::DemoteImportSpaces()
                 // Turn this into a local space.
                 // Remove this from the tree - AddLocalSpace will make an entry for the local version.
                 RemoveTree(pSpace);
+                if (pSpace->isReadOnly)
+                    osMemoryManager->SetPermissions(pSpace->bottom, (char*)pSpace->top - (char*)pSpace->bottom,
+                        PERMISSION_READ|PERMISSION_WRITE|PERMISSION_EXEC);
                 LocalMemSpace *space = new LocalMemSpace;
                 space->top = pSpace->top;
                 // Space is allocated in local areas from the top down.  This area is full and
@@ -96,12 +96,13 @@ class PermanentMemSpace: public MemSpace
 {
 protected:
     PermanentMemSpace(): index(0), hierarchy(0), noOverwrite(false),
-        byteOnly(false), topPointer(0) {}
+        byteOnly(false), isReadOnly(false), topPointer(0) {}
 public:
     unsigned    index;      // An identifier for the space.  Used when saving and loading.
     unsigned    hierarchy;  // The hierarchy number: 0=from executable, 1=top level saved state, ...
     bool        noOverwrite; // Don't save this in deeper hierarchies.
     bool        byteOnly; // Only contains byte data - no need to scan for addresses.
+    bool        isReadOnly; // Write access has been removed.  Restored if this becomes local.
 
     // When exporting or saving state we copy data into a new area.
     // This area grows upwards unlike the local areas that grow down.
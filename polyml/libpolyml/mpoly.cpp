@@ -72,6 +72,10 @@
 #include "../polyexports.h"
 #include "memmgr.h"
 #include "pexport.h"
+#include "rtstrace.h"
+#include "perfmap.h"
+#include "statserver.h"
+#include "savestate.h"
 
 #if (defined(_WIN32) && ! defined(__CYGWIN__))
 #include "Console.h"
@@ -98,7 +102,14 @@ enum {
     OPT_RESERVE,
     OPT_GCTHREADS,
     OPT_DEBUGOPTS,
-    OPT_DEBUGFILE
+    OPT_DEBUGFILE,
+    OPT_RTSTRACE,
+    OPT_PERFMAP,
+    OPT_STATSSERVER,
+    OPT_COMPRESSSTATE,
+    OPT_DELTASTATE,
+    OPT_DEDUPSTATE,
+    OPT_GCINTERN
 };
 
 static struct __argtab {
@@ -113,7 +124,14 @@ static struct __argtab {
     { "--stackspace",   "Space to reserve for thread stacks and C++ heap(MB)",  OPT_RESERVE },
     { "--gcthreads",    "Number of threads to use for garbage collection",      OPT_GCTHREADS },
     { "--debug",        "Debug options: checkmem, gc, x",                       OPT_DEBUGOPTS },
-    { "--logfile",      "Logging file (default is to log to stdout)",           OPT_DEBUGFILE }
+    { "--logfile",      "Logging file (default is to log to stdout)",           OPT_DEBUGFILE },
+    { "--rtstrace",     "Trace run-time system calls to this file",             OPT_RTSTRACE },
+    { "--perfmap",      "Write a perf symbol map for ML code to this directory", OPT_PERFMAP },
+    { "--statsserver",  "Serve statistics on this local TCP port or socket path", OPT_STATSSERVER },
+    { "--compressstate", "Compression level (0-9) for saved states",             OPT_COMPRESSSTATE },
+    { "--deltastate",   "Save only changed pages of parent states: on or off",  OPT_DELTASTATE },
+    { "--dedupstate",   "Share identical code with parent states: on or off",   OPT_DEDUPSTATE },
+    { "--gcintern",     "Share small immutable objects in minor GCs: on or off", OPT_GCINTERN }
 };
 
 static struct __debugOpts {
@@ -131,7 +149,8 @@ static struct __debugOpts {
     { "x",                  "Log X-windows information",                        DEBUG_X},
     { "sharing",            "Information from PolyML.shareCommonData",          DEBUG_SHARING},
     { "locks",              "Information about contended locks",                DEBUG_CONTENTION},
-    { "rts",                "General run-time system calls",                    DEBUG_RTSCALLS}
+    { "rts",                "General run-time system calls",                    DEBUG_RTSCALLS},
+    { "lockprofile",        "Profile contention on run-time system locks",      DEBUG_LOCKPROFILE}
 };
 
 // Parse a parameter that is meant to be a size.  Returns the value as a number
@@ -276,6 +295,46 @@ int polymain(int argc, char **argv, exportDescription *exports)
                     case OPT_DEBUGFILE:
                         SetLogFile(p);
                         break;
+                    case OPT_RTSTRACE:
+                        SetRtsTraceFile(p);
+                        break;
+                    case OPT_PERFMAP:
+                        SetPerfMapDirectory(p);
+                        break;
+                    case OPT_STATSSERVER:
+                        SetStatsServerAddress(p);
+                        break;
+                    case OPT_COMPRESSSTATE:
+                        savedStateCompression = strtol(p, &endp, 10);
+                        if (*endp != '\0')
+                            Usage("Malformed %s option\n", argTable[j].argName);
+                        if (savedStateCompression > 9)
+                            Usage("%s argument must be between 0 and 9\n", argTable[j].argName);
+                        break;
+                    case OPT_DELTASTATE:
+                        if (strcmp(p, "on") == 0)
+                            deltaSavedStates = true;
+                        else if (strcmp(p, "off") == 0)
+                            deltaSavedStates = false;
+                        else
+                            Usage("%s argument must be on or off\n", argTable[j].argName);
+                        break;
+                    case OPT_DEDUPSTATE:
+                        if (strcmp(p, "on") == 0)
+                            dedupSavedStates = true;
+                        else if (strcmp(p, "off") == 0)
+                            dedupSavedStates = false;
+                        else
+                            Usage("%s argument must be on or off\n", argTable[j].argName);
+                        break;
+                    case OPT_GCINTERN:
+                        if (strcmp(p, "on") == 0)
+                            internInMinorGC = true;
+                        else if (strcmp(p, "off") == 0)
+                            internInMinorGC = false;
+                        else
+                            Usage("%s argument must be on or off\n", argTable[j].argName);
+                        break;
                     }
                     argUsed = true;
                     break;
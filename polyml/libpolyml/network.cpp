@@ -126,6 +126,7 @@ typedef int socklen_t;
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "machine_dep.h"
 #include "errors.h"
 
@@ -384,6 +385,7 @@ void WaitNet::Wait(unsigned maxMillisecs)
 Handle Net_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
 TryAgain:
     switch (c)
     {
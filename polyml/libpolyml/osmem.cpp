@@ -121,6 +121,32 @@ bool OSMem::SetPermissions(void *p, size_t space, unsigned permissions)
     return res != -1;
 }
 
+// Map part of a file.  The pages are read from the file when they are
+// first used.
+void *OSMem::MapFile(int fd, off_t offset, size_t &space, void *address, unsigned permissions)
+{
+    int prot = ConvertPermissions(permissions);
+    int pageSize = getpagesize();
+    if (offset % pageSize != 0)
+        return 0;
+    space = (space + pageSize-1) & ~(pageSize-1);
+    void *result = MAP_FAILED;
+#ifdef MAP_FIXED_NOREPLACE
+    // Ask for exactly the address if the range is free.  Linux does not take
+    // a hint for a large file mapping if the range is adjacent to another
+    // mapping because it pads the length to align huge pages.  Kernels
+    // before 4.17 ignore the flag and treat the address as a hint.
+    if (address != 0)
+        result = mmap(FIXTYPE address, space, prot, MAP_PRIVATE|MAP_FIXED_NOREPLACE, fd, offset);
+#endif
+    // Without MAP_FIXED the address is only a hint.
+    if (result == MAP_FAILED)
+        result = mmap(FIXTYPE address, space, prot, MAP_PRIVATE, fd, offset);
+    if (result == MAP_FAILED)
+        return 0;
+    return result;
+}
+
 
 #elif defined(_WIN32)
 // Use Windows memory management.
@@ -178,6 +204,12 @@ bool OSMem::SetPermissions(void *p, size_t space, unsigned permissions)
     return VirtualProtect(p, space, ConvertPermissions(permissions), &oldProtect) == TRUE;
 }
 
+// Mapped views can't be released with VirtualFree so we don't map files.
+void *OSMem::MapFile(int fd, off_t offset, size_t &space, void *address, unsigned permissions)
+{
+    return 0;
+}
+
 
 #else
 
@@ -208,6 +240,12 @@ bool OSMem::SetPermissions(void *p, size_t space, unsigned permissions)
     return true; // Let's hope this is all right.
 }
 
+// The caller will have to read the file.
+void *OSMem::MapFile(int fd, off_t offset, size_t &bytes, void *address, unsigned permissions)
+{
+    return 0;
+}
+
 #endif
 
 // Create the global object for the memory manager.
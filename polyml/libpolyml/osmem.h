@@ -32,6 +32,11 @@
 #include <stdlib.h>
 #endif
 
+// and off_t
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
 // This class provides access to the memory management provided by the
 // operating system.  It would be nice if we could always use malloc and
 // free for this but we need to have execute permission on the code
@@ -56,6 +61,14 @@ public:
     // Adjust the permissions on a segment.  This must apply to the
     // whole of a segment.
     bool SetPermissions(void *p, size_t space, unsigned permissions);
+
+    // Map part of a file into memory.  The mapping is private: changes are
+    // not written back to the file.  The offset must be a multiple of the
+    // page size.  If "address" is non-null the mapping is placed at that
+    // address if it is free but otherwise anywhere.  The size is updated as
+    // for Allocate and the space is released with Free.  Returns NULL if
+    // the file cannot be mapped.
+    void *MapFile(int fd, off_t offset, size_t &bytes, void *address, unsigned permissions);
 };
 
 
@@ -0,0 +1,219 @@
+/*
+    Title:  perfmap.cpp - Symbol map of ML code for external profilers
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+ML code is held in the heap so profilers such as perf only see anonymous
+addresses.  perf will read symbols for JIT-compiled code from the file
+/tmp/perf-<pid>.map, which has a line "start size name" for each function.
+This writes an entry for each code object in the permanent areas when the
+RTS starts and when a saved state is loaded, for each new code object when it
+is frozen and for each code object the GC moves.  Entries are only ever added
+so an address may appear more than once: the most recent entry is the valid one.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifdef HAVE_WINDOWS_H
+#include <windows.h>
+#endif
+
+#ifdef HAVE_INTTYPES_H
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "globals.h"
+#include "perfmap.h"
+#include "polystring.h"
+#include "memmgr.h"
+#include "rts_module.h"
+#include "locking.h"
+#include "diagnostics.h"
+
+bool perfMapEnabled = false;
+
+static const char *perfMapDirectory = 0;
+static FILE *perfMapFile = 0;
+static PLock perfMapLock("Perf map"); // Protects the file and the list of moved objects.
+
+// Code objects copied during the current GC.
+static PolyObject **movedCode = 0;
+static POLYUNSIGNED movedCount = 0, movedSize = 0;
+
+void SetPerfMapDirectory(const char *dirName)
+{
+    perfMapDirectory = dirName;
+}
+
+// Write the entry for a code object.  Must be called with perfMapLock held.
+static void WriteCodeEntry(PolyObject *code)
+{
+    PolyWord *consts;
+    POLYUNSIGNED count, length = code->Length();
+    code->GetConstSegmentForCode(length, consts, count);
+    // The size is the machine code up to the marker word before the constants.
+    POLYUNSIGNED codeBytes = (consts - 2 - (PolyWord*)code) * sizeof(PolyWord);
+    if (count == 0 || count >= length || codeBytes == 0)
+        return; // Not a properly formed code object.
+    fprintf(perfMapFile, "%" PRIxPTR " %" PRIxPTR " ", (uintptr_t)code, (uintptr_t)codeBytes);
+    // The first constant is the name of the function.  Small pieces of code
+    // built by the RTS have a single character.
+    PolyWord name = consts[0];
+    if (name.IsTagged())
+    {
+        if (name == TAGGED(0))
+            fputs("<anon>", perfMapFile);
+        else fprintf(perfMapFile, "<RTS %c>", (char)UNTAGGED(name));
+    }
+    else
+    {
+        PolyStringObject *str = (PolyStringObject*)name.AsObjPtr();
+        for (POLYUNSIGNED i = 0; i < str->length; i++)
+        {
+            char ch = str->chars[i];
+            // Names are terminated by the end of the line.
+            fputc(ch == '\n' || ch == '\r' ? ' ' : ch, perfMapFile);
+        }
+    }
+    fputc('\n', perfMapFile);
+}
+
+void PerfMapAddCode(PolyObject *code)
+{
+    if (perfMapFile == 0) return;
+    PLocker lock(&perfMapLock);
+    WriteCodeEntry(code);
+    fflush(perfMapFile);
+}
+
+void PerfMapAddArea(PolyWord *bottom, PolyWord *top)
+{
+    if (perfMapFile == 0) return;
+    PLocker lock(&perfMapLock);
+    for (PolyWord *p = bottom; p < top; )
+    {
+        p++;
+        PolyObject *obj = (PolyObject*)p;
+        POLYUNSIGNED length = obj->Length();
+        if (obj->IsCodeObject() && ! obj->IsMutable())
+            WriteCodeEntry(obj);
+        p += length;
+    }
+    fflush(perfMapFile);
+}
+
+// This may be called by several GC threads at the same time.
+void PerfMapCodeMoved(PolyObject *code)
+{
+    PLocker lock(&perfMapLock);
+    if (movedCount == movedSize)
+    {
+        POLYUNSIGNED newSize = movedSize == 0 ? 256 : movedSize * 2;
+        PolyObject **newList = (PolyObject**)realloc(movedCode, newSize * sizeof(PolyObject*));
+        if (newList == 0)
+            return; // Just lose this entry.
+        movedCode = newList;
+        movedSize = newSize;
+    }
+    movedCode[movedCount++] = code;
+}
+
+void PerfMapFlushMoved(void)
+{
+    if (perfMapFile == 0) return;
+    PLocker lock(&perfMapLock);
+    for (POLYUNSIGNED i = 0; i < movedCount; i++)
+        WriteCodeEntry(movedCode[i]);
+    movedCount = 0;
+    fflush(perfMapFile);
+}
+
+class PerfMap: public RtsModule
+{
+public:
+    virtual void Init(void);
+    virtual void Start(void);
+    virtual void Stop(void);
+};
+
+// Declare this.  It will be automatically added to the table.
+static PerfMap perfMapModule;
+
+void PerfMap::Init(void)
+{
+    if (perfMapDirectory == 0) return;
+    char *fileName = (char*)malloc(strlen(perfMapDirectory) + 40);
+    if (fileName == 0) return;
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+    sprintf(fileName, "%s\\perf-%lu.map", perfMapDirectory, (unsigned long)GetCurrentProcessId());
+#else
+    sprintf(fileName, "%s/perf-%lu.map", perfMapDirectory, (unsigned long)getpid());
+#endif
+    perfMapFile = fopen(fileName, "w");
+    if (perfMapFile == 0)
+        Log("Perf map: unable to open %s\n", fileName);
+    else perfMapEnabled = true;
+    free(fileName);
+}
+
+// The permanent areas have been set up by the time the modules are started.
+void PerfMap::Start(void)
+{
+    for (unsigned i = 0; i < gMem.npSpaces; i++)
+    {
+        PermanentMemSpace *space = gMem.pSpaces[i];
+        if (! space->byteOnly)
+            PerfMapAddArea(space->bottom, space->top);
+    }
+}
+
+void PerfMap::Stop(void)
+{
+    if (perfMapFile == 0) return;
+    perfMapEnabled = false;
+    PLocker lock(&perfMapLock);
+    fclose(perfMapFile);
+    perfMapFile = 0;
+}
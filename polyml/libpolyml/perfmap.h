@@ -0,0 +1,45 @@
+/*
+    Title:  perfmap.h - Symbol map of ML code for external profilers
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef PERFMAP_H_INCLUDED
+#define PERFMAP_H_INCLUDED
+
+class PolyObject;
+class PolyWord;
+
+// The map is enabled with the --perfmap option.  It names each code object
+// in the format the Linux perf tools use for JIT-compiled code.
+extern bool perfMapEnabled;
+
+extern void SetPerfMapDirectory(const char *dirName);
+
+// Add an entry for a newly created code object.
+extern void PerfMapAddCode(PolyObject *code);
+
+// Add entries for all the code in a loaded area.
+extern void PerfMapAddArea(PolyWord *bottom, PolyWord *top);
+
+// Called by the GC when it has copied a code object.  The entries are
+// written by PerfMapFlushMoved once all the addresses have been updated.
+extern void PerfMapCodeMoved(PolyObject *code);
+extern void PerfMapFlushMoved(void);
+
+#endif
@@ -39,6 +39,18 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 #ifdef HAVE_ASSERT_H
 #include <assert.h>
 #define ASSERT(x) assert(x)
@@ -58,18 +70,97 @@
 #include "processes.h" // For IO_SPACING
 #include "memmgr.h"
 #include "osmem.h"
+#include "gc.h"
+#include "gctaskfarm.h"
 
 /*
 This file contains the code both to export the file and to import it
 in a new session.
+
+There are two formats.  The text format is the original and is useful for
+debugging.  The binary format is much smaller and faster to import.  It is
+independent of the byte order and word length in the same way as the text
+format.  All the numbers in the header and the object table are little-endian.
+
+Header:     PORTABLE_MAGIC, version (4 bytes), bytes per word of the machine
+            that wrote it (4 bytes), number of objects (8 bytes), index of the
+            root object (8 bytes), position of the object table (8 bytes).
+Data:       The contents of each object in order of the object index.
+Object table: For each object, in order of the object index:
+            kind (1 byte: 'O', 'B', 'S' or 'D' as in the text format),
+            flags (1 byte: PORTABLE_FLAG_ values), length (words for 'O',
+            bytes for 'B', characters for 'S' and bytes of code for 'D'),
+            number of constants (only for 'D'), size of the data in bytes.
+            Since the data for each object follows the previous one the table
+            gives the position of every object so they can be read in parallel.
+
+Other than in the header the numbers are unsigned LEB128 i.e. seven bits per
+byte, least significant group first, with the top bit set on all but the last.
+'O'         The values.
+'B', 'S'    The bytes.
+'D'         The bytes of the code, the values of the constants, the number of
+            constants within the code and for each of those the byte offset, the
+            relocation kind and the value.
+A value is a PORTABLE_VALUE_ byte followed by its operands:
+TAGGED      The integer with the sign in the bottom bit (zig-zag encoding).
+OBJECT      The object index.
+CODE        The object index and the byte offset within the code.
+IO          The IO entry number.
+IOOFFSET    The IO entry number and the byte offset.
 */
 
-PExport::PExport()
+#define PORTABLE_MAGIC          "POLYPORT"
+#define PORTABLE_VERSION        1
+#define PORTABLE_HEADER_SIZE    40
+
+#define PORTABLE_FLAG_MUTABLE       1
+#define PORTABLE_FLAG_NEGATIVE      2
+#define PORTABLE_FLAG_WEAK          4
+#define PORTABLE_FLAG_NOOVERWRITE   8
+
+#define PORTABLE_VALUE_TAGGED   0
+#define PORTABLE_VALUE_OBJECT   1
+#define PORTABLE_VALUE_CODE     2
+#define PORTABLE_VALUE_IO       3
+#define PORTABLE_VALUE_IOOFFSET 4
+
+static void putLittleEndian(FILE *f, unsigned long long n, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; i++)
+    {
+        putc((int)(n & 0xff), f);
+        n >>= 8;
+    }
+}
+
+// File offsets in the binary format are 64 bits so that the file can be
+// larger than 2Gbytes even where long is 32 bits.  Both return -1 on error.
+#if defined(_WIN32)
+typedef __int64 FileOffset;
+static FileOffset getFilePos(FILE *f) { return _ftelli64(f); }
+static int setFilePos(FILE *f, FileOffset pos) { return _fseeki64(f, pos, SEEK_SET); }
+#else
+typedef off_t FileOffset;
+static FileOffset getFilePos(FILE *f) { return ftello(f); }
+static int setFilePos(FILE *f, FileOffset pos) { return fseeko(f, pos, SEEK_SET); }
+#endif
+
+static unsigned long long getLittleEndian(const byte *p, unsigned bytes)
+{
+    unsigned long long n = 0;
+    for (unsigned i = bytes; i > 0; i--)
+        n = (n << 8) | p[i-1];
+    return n;
+}
+
+PExport::PExport(bool text): textFormat(text)
 {
     pMap = 0;
     nMapSize = 0;
     nObjects = 0;
     indexOrder = 0;
+    codeConstCount = 0;
+    countingConsts = false;
 }
 
 PExport::~PExport()
@@ -143,6 +234,24 @@ void PExport::printValue(PolyWord q)
         printAddress(q.AsAddress());
 }
 
+// Byte objects may be strings, long format arbitrary precision numbers or
+// real numbers.  Strings are exported as characters so that they can be imported
+// on a machine with a different word length.
+bool PExport::isString(PolyObject *p)
+{
+    PolyStringObject* ps = (PolyStringObject*)p;
+    POLYUNSIGNED length = p->Length();
+    /* See if the first word is a possible length.  The length
+       cannot be one because single character strings are
+       represented by the character. */
+    /* This is not infallible but it seems to be good enough
+       to detect the strings. */
+    POLYUNSIGNED bytes = length * sizeof(PolyWord);
+    return length >= 2 &&
+        ps->length <= bytes - sizeof(POLYUNSIGNED) &&
+        ps->length > bytes - 2 * sizeof(POLYUNSIGNED);
+}
+
 void PExport::printObject(PolyObject *p)
 {
     POLYUNSIGNED length = p->Length();
@@ -166,15 +275,7 @@ void PExport::printObject(PolyObject *p)
         /* May be a string, a long format arbitrary precision
            number or a real number. */
         PolyStringObject* ps = (PolyStringObject*)p;
-        /* See if the first word is a possible length.  The length
-           cannot be one because single character strings are
-           represented by the character. */
-        /* This is not infallible but it seems to be good enough
-           to detect the strings. */
-        POLYUNSIGNED bytes = length * sizeof(PolyWord);
-        if (length >= 2 &&
-            ps->length <= bytes - sizeof(POLYUNSIGNED) &&
-            ps->length > bytes - 2 * sizeof(POLYUNSIGNED))
+        if (isString(p))
         {
             /* Looks like a string. */
             fprintf(exportFile, "S%" POLYUFMT "|", ps->length);
@@ -264,10 +365,148 @@ void PExport::ScanConstant(byte *addr, ScanRelocationKind code)
     PolyWord p = GetConstantValue(addr, code);
     // We put in all the values including tagged constants.
     PolyObject *obj = ObjCodePtrToPtr(addr);
-    // Put in the byte offset and the relocation type code.
-    fprintf(exportFile, "%" POLYUFMT ",%d,", (POLYUNSIGNED)(addr - (byte*)obj), code);
-    printValue(p); // The value to plug in.
-    fprintf(exportFile, " ");
+    if (textFormat)
+    {
+        // Put in the byte offset and the relocation type code.
+        fprintf(exportFile, "%" POLYUFMT ",%d,", (POLYUNSIGNED)(addr - (byte*)obj), code);
+        printValue(p); // The value to plug in.
+        fprintf(exportFile, " ");
+    }
+    else if (countingConsts)
+        codeConstCount++;
+    else
+    {
+        writeNumber((POLYUNSIGNED)(addr - (byte*)obj));
+        writeNumber(code);
+        writeValue(p);
+    }
+}
+
+void PExport::writeNumber(POLYUNSIGNED n)
+{
+    while (n >= 0x80)
+    {
+        putc((int)(n & 0x7f) | 0x80, exportFile);
+        n >>= 7;
+    }
+    putc((int)n, exportFile);
+}
+
+void PExport::writeValue(PolyWord q)
+{
+    if (IS_INT(q) || q == PolyWord::FromUnsigned(0))
+    {
+        POLYSIGNED n = UNTAGGED(q);
+        putc(PORTABLE_VALUE_TAGGED, exportFile);
+        writeNumber(n < 0 ? ((POLYUNSIGNED)(-(n+1)) << 1) | 1 : (POLYUNSIGNED)n << 1);
+    }
+    else if (OBJ_IS_CODEPTR(q))
+    {
+        PolyObject *obj = ObjCodePtrToPtr(q.AsCodePtr());
+        putc(PORTABLE_VALUE_CODE, exportFile);
+        writeNumber(getIndex(obj));
+        writeNumber((POLYUNSIGNED)(q.AsCodePtr() - (byte*)obj));
+    }
+    else if (findArea(q.AsAddress()) == ioMemEntry)
+    {
+        POLYUNSIGNED byteOffset = (char*)q.AsAddress() - (char*)memTable[ioMemEntry].mtAddr;
+        unsigned ioEntry = (unsigned)(byteOffset / (ioSpacing*sizeof(PolyWord)));
+        unsigned ioOffset = (unsigned)(byteOffset - ioEntry * (ioSpacing*sizeof(PolyWord)));
+        ASSERT(ioEntry >= 0 && ioEntry < POLY_SYS_vecsize);
+        putc(ioOffset == 0 ? PORTABLE_VALUE_IO : PORTABLE_VALUE_IOOFFSET, exportFile);
+        writeNumber(ioEntry);
+        if (ioOffset != 0)
+            writeNumber(ioOffset);
+    }
+    else
+    {
+        putc(PORTABLE_VALUE_OBJECT, exportFile);
+        writeNumber(getIndex(q.AsObjPtr()));
+    }
+}
+
+void PExport::writeObject(PolyObject *p)
+{
+    POLYUNSIGNED length = p->Length();
+
+    if (p->IsByteObject())
+    {
+        if (isString(p))
+        {
+            PolyStringObject* ps = (PolyStringObject*)p;
+            fwrite(ps->chars, 1, ps->length, exportFile);
+        }
+        else
+            fwrite(p, sizeof(PolyWord), length, exportFile);
+    }
+    else if (p->IsCodeObject())
+    {
+        POLYUNSIGNED constCount;
+        PolyWord *cp;
+        ASSERT(! p->IsMutable() );
+        p->GetConstSegmentForCode(cp, constCount);
+        POLYUNSIGNED byteCount = (length - constCount - 1) * sizeof(PolyWord);
+        fwrite(p, 1, byteCount, exportFile);
+        for (POLYUNSIGNED i = 0; i < constCount; i++)
+            writeValue(cp[i]);
+        // The constants within the code follow their count.  Scan the code
+        // once to count them and then again to write them.
+        countingConsts = true;
+        codeConstCount = 0;
+        machineDependent->ScanConstantsWithinCode(p, this);
+        countingConsts = false;
+        writeNumber(codeConstCount);
+        machineDependent->ScanConstantsWithinCode(p, this);
+    }
+    else /* Ordinary objects, essentially tuples. */
+    {
+        for (POLYUNSIGNED i = 0; i < length; i++)
+            writeValue(p->Get(i));
+    }
+}
+
+void PExport::writeDescriptor(PolyObject *p, POLYUNSIGNED dataSize)
+{
+    POLYUNSIGNED lengthWord = p->LengthWord();
+    unsigned flags = 0;
+    if (p->IsMutable()) flags |= PORTABLE_FLAG_MUTABLE;
+    if (OBJ_IS_NEGATIVE(lengthWord)) flags |= PORTABLE_FLAG_NEGATIVE;
+    if (OBJ_IS_WEAKREF_OBJECT(lengthWord)) flags |= PORTABLE_FLAG_WEAK;
+    if (OBJ_IS_NO_OVERWRITE(lengthWord)) flags |= PORTABLE_FLAG_NOOVERWRITE;
+
+    int kind;
+    POLYUNSIGNED constCount = 0, length;
+    if (p->IsByteObject())
+    {
+        if (isString(p))
+        {
+            kind = 'S';
+            length = ((PolyStringObject*)p)->length;
+        }
+        else
+        {
+            kind = 'B';
+            length = p->Length() * sizeof(PolyWord);
+        }
+    }
+    else if (p->IsCodeObject())
+    {
+        PolyWord *cp;
+        p->GetConstSegmentForCode(cp, constCount);
+        kind = 'D';
+        length = (p->Length() - constCount - 1) * sizeof(PolyWord);
+    }
+    else
+    {
+        kind = 'O';
+        length = p->Length();
+    }
+    putc(kind, exportFile);
+    putc(flags, exportFile);
+    writeNumber(length);
+    if (kind == 'D')
+        writeNumber(constCount);
+    writeNumber(dataSize);
 }
 
 void PExport::exportStore(void)
@@ -346,30 +585,67 @@ void PExport::exportStore(void)
         }
     }
 
-    /* Start writing the information. */
-    fprintf(exportFile, "Objects\t%lu\n", nObjects);
-    fprintf(exportFile, "Root\t%lu\n", getIndex(rootFunction));
+    if (textFormat)
+    {
+        /* Start writing the information. */
+        fprintf(exportFile, "Objects\t%lu\n", nObjects);
+        fprintf(exportFile, "Root\t%lu\n", getIndex(rootFunction));
 
 
-    // Generate each of the areas apart from the IO area.
-    for (i = 0; i < memTableEntries; i++)
-    {
-        if (i != ioMemEntry) // Don't relocate the IO area
+        // Generate each of the areas apart from the IO area.
+        for (i = 0; i < memTableEntries; i++)
         {
-            char *start = (char*)memTable[i].mtAddr;
-            char *end = start + memTable[i].mtLength;
-            for (PolyWord *p = (PolyWord*)start; p < (PolyWord*)end; )
+            if (i != ioMemEntry) // Don't relocate the IO area
             {
-                p++;
-                PolyObject *obj = (PolyObject*)p;
-                POLYUNSIGNED length = obj->Length();
-                printObject(obj);
-                p += length;
+                char *start = (char*)memTable[i].mtAddr;
+                char *end = start + memTable[i].mtLength;
+                for (PolyWord *p = (PolyWord*)start; p < (PolyWord*)end; )
+                {
+                    p++;
+                    PolyObject *obj = (PolyObject*)p;
+                    POLYUNSIGNED length = obj->Length();
+                    printObject(obj);
+                    p += length;
+                }
             }
         }
     }
+    else
+    {
+        // Leave space for the header.  The data for each object is written in
+        // order of the index and the object table at the end.
+        FileOffset *dataOffsets = (FileOffset*)malloc(nObjects * sizeof(FileOffset));
+        if (dataOffsets == 0)
+            throw MemoryException();
+        bool ok = setFilePos(exportFile, PORTABLE_HEADER_SIZE) == 0;
+        for (unsigned long j = 0; ok && j < nObjects; j++)
+        {
+            dataOffsets[j] = getFilePos(exportFile);
+            ok = dataOffsets[j] >= 0;
+            writeObject(pMap[j]);
+        }
+        FileOffset tablePos = ok ? getFilePos(exportFile) : -1;
+        ok = tablePos >= 0;
+        for (unsigned long k = 0; ok && k < nObjects; k++)
+            writeDescriptor(pMap[k], (POLYUNSIGNED)((k+1 < nObjects ? dataOffsets[k+1] : tablePos) - dataOffsets[k]));
+        free(dataOffsets);
+
+        if (! ok || setFilePos(exportFile, 0) != 0)
+        {
+            errorMessage = "Error while writing export file";
+            return; // The destructor closes the file.
+        }
+        fwrite(PORTABLE_MAGIC, 1, 8, exportFile);
+        putLittleEndian(exportFile, PORTABLE_VERSION, 4);
+        putLittleEndian(exportFile, sizeof(PolyWord), 4);
+        putLittleEndian(exportFile, nObjects, 8);
+        putLittleEndian(exportFile, getIndex(rootFunction), 8);
+        putLittleEndian(exportFile, tablePos, 8);
+    }
 
-    fclose(exportFile); exportFile = NULL;
+    if (ferror(exportFile) || fclose(exportFile) != 0)
+        errorMessage = "Error while writing export file";
+    exportFile = NULL;
 }
 
 
@@ -455,16 +731,38 @@ public:
     PImport();
     ~PImport();
     bool DoImport(void);
+    bool DoBinaryImport(void);
     FILE *f;
     PolyObject *Root(void) { return objMap[nRoot]; }
 private:
     PolyObject *NewObject(POLYUNSIGNED words, bool isMutable);
     bool ReadValue(PolyObject *p, POLYUNSIGNED i);
     bool GetValue(PolyWord *result);
+    bool InitIOSpace(void);
+
+    // Binary format.
+    bool DecodeValue(const byte *&ptr, PolyWord *result);
+    bool DecodeObject(POLYUNSIGNED objNo);
+    static void DecodeObjects(GCTaskId *, void *arg1, void *arg2);
     
     POLYUNSIGNED nObjects, nRoot;
     PolyObject **objMap;
 
+    // The object table entries are saved by the first pass.
+    struct PortableObject
+    {
+        POLYUNSIGNED dataOffset;
+        POLYUNSIGNED length;
+        POLYUNSIGNED nConsts;
+        char kind;
+    };
+
+    byte *fileData;
+    size_t fileSize;
+    POLYUNSIGNED tablePos;
+    PortableObject *objTable;
+    bool decodeFailed;
+
     SpaceAlloc mutSpace, immutSpace;
 };
 
@@ -472,6 +770,11 @@ PImport::PImport(): mutSpace(true, 1024*1024), immutSpace(false, 1024*1024)
 {
     f = NULL;
     objMap = 0;
+    fileData = 0;
+    fileSize = 0;
+    tablePos = 0;
+    objTable = 0;
+    decodeFailed = false;
 }
 
 PImport::~PImport()
@@ -479,6 +782,8 @@ PImport::~PImport()
     if (f)
         fclose(f);
     free(objMap);
+    free(fileData);
+    free(objTable);
 }
 
 PolyObject *PImport::NewObject(POLYUNSIGNED words, bool isMutableObj)
@@ -564,11 +869,8 @@ bool PImport::ReadValue(PolyObject *p, POLYUNSIGNED i)
     else return false;
 }
 
-bool PImport::DoImport()
+bool PImport::InitIOSpace()
 {
-    int ch;
-    POLYUNSIGNED objNo;
-
     ASSERT(gMem.npSpaces == 0);
     ASSERT(gMem.neSpaces == 0);
     ASSERT(gMem.ioSpace->bottom == 0);
@@ -579,6 +881,16 @@ bool PImport::DoImport()
         return false;
     }
     gMem.InitIOSpace(ioSpace, POLY_SYS_vecsize*IO_SPACING);
+    return true;
+}
+
+bool PImport::DoImport()
+{
+    int ch;
+    POLYUNSIGNED objNo;
+
+    if (! InitIOSpace())
+        return false;
 
     ch = getc(f);
     /* Skip the "Mapping" line. */
@@ -897,17 +1209,340 @@ bool PImport::DoImport()
     return mutSpace.AddToTable() && immutSpace.AddToTable();
 }
 
+// Read an unsigned LEB128 number checking that it is within the buffer.
+static bool DecodeNumber(const byte *&ptr, const byte *end, POLYUNSIGNED *result)
+{
+    POLYUNSIGNED n = 0;
+    unsigned shift = 0;
+    while (ptr < end && shift < sizeof(POLYUNSIGNED)*8)
+    {
+        byte b = *ptr++;
+        n |= (POLYUNSIGNED)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+        {
+            *result = n;
+            return true;
+        }
+        shift += 7;
+    }
+    return false;
+}
+
+bool PImport::DecodeValue(const byte *&ptr, PolyWord *result)
+{
+    const byte *end = fileData + tablePos;
+    if (ptr >= end)
+        return false;
+    POLYUNSIGNED n, offset;
+    switch (*ptr++)
+    {
+    case PORTABLE_VALUE_TAGGED:
+        {
+            if (! DecodeNumber(ptr, end, &n))
+                return false;
+            POLYSIGNED j = (n & 1) ? -(POLYSIGNED)(n >> 1) - 1 : (POLYSIGNED)(n >> 1);
+            /* The assertion may be false if we are porting to a machine
+               with a shorter tagged representation. */
+            ASSERT(j >= -MAXTAGGED-1 && j <= MAXTAGGED);
+            *result = TAGGED(j);
+            return true;
+        }
+
+    case PORTABLE_VALUE_OBJECT:
+        if (! DecodeNumber(ptr, end, &n) || n >= nObjects)
+            return false;
+        *result = objMap[n];
+        return true;
+
+    case PORTABLE_VALUE_CODE:
+        {
+            if (! DecodeNumber(ptr, end, &n) || n >= nObjects || ! DecodeNumber(ptr, end, &offset))
+                return false;
+            PolyObject *q = objMap[n];
+            if (! q->IsCodeObject() || offset >= q->Length() * sizeof(PolyWord))
+                return false;
+            *result = PolyWord::FromCodePtr((PolyWord(q)).AsCodePtr() + offset); /* The offset is in bytes. */
+            return true;
+        }
+
+    case PORTABLE_VALUE_IO:
+        if (! DecodeNumber(ptr, end, &n) || n >= POLY_SYS_vecsize)
+            return false;
+        *result = (PolyObject*)&gMem.ioSpace->bottom[n * IO_SPACING];
+        return true;
+
+    case PORTABLE_VALUE_IOOFFSET:
+        {
+            if (! DecodeNumber(ptr, end, &n) || n >= POLY_SYS_vecsize || ! DecodeNumber(ptr, end, &offset))
+                return false;
+            PolyWord base = (PolyObject*)&gMem.ioSpace->bottom[n * IO_SPACING];
+            *result = PolyWord::FromCodePtr(base.AsCodePtr() + offset);
+            return true;
+        }
+
+    default:
+        return false;
+    }
+}
+
+// Fill in the contents of an object that has already been allocated.
+bool PImport::DecodeObject(POLYUNSIGNED objNo)
+{
+    const PortableObject *descr = &objTable[objNo];
+    POLYUNSIGNED nConsts = descr->nConsts, length = descr->length;
+    const byte *ptr = fileData + descr->dataOffset, *end = fileData + tablePos;
+    PolyObject *p = objMap[objNo];
+    POLYUNSIGNED i;
+
+    switch (descr->kind)
+    {
+    case 'O':
+        for (i = 0; i < length; i++)
+        {
+            PolyWord val = TAGGED(0);
+            if (! DecodeValue(ptr, &val))
+                return false;
+            p->Set(i, val);
+        }
+        return true;
+
+    case 'B':
+        if ((POLYUNSIGNED)(end - ptr) < length)
+            return false;
+        memcpy(p, ptr, length);
+        return true;
+
+    case 'S':
+        {
+            if ((POLYUNSIGNED)(end - ptr) < length)
+                return false;
+            PolyStringObject *ps = (PolyStringObject *)p;
+            ps->length = length;
+            memcpy(ps->chars, ptr, length);
+            return true;
+        }
+
+    case 'D':
+        {
+            byte *u = (byte*)p;
+            POLYUNSIGNED words = p->Length();
+            if ((POLYUNSIGNED)(end - ptr) < length)
+                return false;
+            memcpy(u, ptr, length);
+            ptr += length;
+            machineDependent->FlushInstructionCache(u, length);
+            /* Set the constant count. */
+            p->Set(words-1, PolyWord::FromUnsigned(nConsts));
+            /* Read in the constants. */
+            for (i = 0; i < nConsts; i++)
+            {
+                PolyWord val = TAGGED(0);
+                if (! DecodeValue(ptr, &val))
+                    return false;
+                p->Set(i+words-nConsts-1, val);
+            }
+            // Read in any constants in the code.
+            POLYUNSIGNED nCodeConsts;
+            if (! DecodeNumber(ptr, end, &nCodeConsts))
+                return false;
+            for (i = 0; i < nCodeConsts; i++)
+            {
+                POLYUNSIGNED constOffset, code;
+                PolyWord constVal = TAGGED(0);
+                if (! DecodeNumber(ptr, end, &constOffset) || constOffset >= length ||
+                    ! DecodeNumber(ptr, end, &code) || ! DecodeValue(ptr, &constVal))
+                    return false;
+                ScanAddress::SetConstantValue(u + constOffset, constVal, (ScanRelocationKind)code);
+            }
+            return true;
+        }
+
+    default:
+        return false;
+    }
+}
+
+#define PORTABLE_DECODE_CHUNK   4096    // Number of objects decoded by each task.
+
+// Task to fill in a range of objects.  Each object is only written by the task
+// that owns it so no locking is needed.
+void PImport::DecodeObjects(GCTaskId *, void *arg1, void *arg2)
+{
+    PImport *import = (PImport *)arg1;
+    POLYUNSIGNED first = (POLYUNSIGNED)((uintptr_t)arg2) * PORTABLE_DECODE_CHUNK;
+    POLYUNSIGNED last = first + PORTABLE_DECODE_CHUNK;
+    if (last > import->nObjects)
+        last = import->nObjects;
+    for (POLYUNSIGNED i = first; i < last && ! import->decodeFailed; i++)
+    {
+        if (! import->DecodeObject(i))
+            import->decodeFailed = true;
+    }
+}
+
+bool PImport::DoBinaryImport()
+{
+    // Read the whole file into memory.
+    if (fseek(f, 0, SEEK_END) != 0)
+        return false;
+    FileOffset endPos = getFilePos(f);
+    if (endPos < PORTABLE_HEADER_SIZE || setFilePos(f, 0) != 0)
+    {
+        fprintf(stderr, "Invalid portable export file\n");
+        return false;
+    }
+    fileSize = (size_t)endPos;
+    fileData = (byte*)malloc(fileSize);
+    if (fileData == 0)
+    {
+        fprintf(stderr, "Unable to allocate memory\n");
+        return false;
+    }
+    if (fread(fileData, 1, fileSize, f) != fileSize)
+    {
+        fprintf(stderr, "Unable to read file\n");
+        return false;
+    }
+
+    unsigned version = (unsigned)getLittleEndian(fileData+8, 4);
+    nObjects = (POLYUNSIGNED)getLittleEndian(fileData+16, 8);
+    nRoot = (POLYUNSIGNED)getLittleEndian(fileData+24, 8);
+    tablePos = (POLYUNSIGNED)getLittleEndian(fileData+32, 8);
+    // Each table entry is at least four bytes.
+    if (version != PORTABLE_VERSION || nRoot >= nObjects || tablePos < PORTABLE_HEADER_SIZE ||
+        tablePos > fileSize || (fileSize - tablePos) / 4 < nObjects)
+    {
+        fprintf(stderr, "Invalid portable export file\n");
+        return false;
+    }
+
+    if (! InitIOSpace())
+        return false;
+
+    objMap = (PolyObject**)calloc(nObjects, sizeof(PolyObject*));
+    objTable = (PortableObject*)malloc(nObjects * sizeof(PortableObject));
+    if (objMap == 0 || objTable == 0)
+    {
+        fprintf(stderr, "Unable to allocate memory\n");
+        return false;
+    }
+
+    // First pass - read the table, allocate the objects and set their length words.
+    const byte *tablePtr = fileData + tablePos, *tableEnd = fileData + fileSize;
+    POLYUNSIGNED offset = PORTABLE_HEADER_SIZE;
+    for (POLYUNSIGNED objNo = 0; objNo < nObjects; objNo++)
+    {
+        PortableObject *descr = &objTable[objNo];
+        POLYUNSIGNED length, nConsts = 0, dataSize;
+        if (tableEnd - tablePtr < 2)
+        {
+            fprintf(stderr, "Invalid portable export file\n");
+            return false;
+        }
+        char kind = (char)*tablePtr++;
+        unsigned flags = *tablePtr++;
+        if (! DecodeNumber(tablePtr, tableEnd, &length) ||
+            (kind == 'D' && ! DecodeNumber(tablePtr, tableEnd, &nConsts)) ||
+            ! DecodeNumber(tablePtr, tableEnd, &dataSize) ||
+            dataSize > tablePos - offset)
+        {
+            fprintf(stderr, "Invalid portable export file\n");
+            return false;
+        }
+        descr->dataOffset = offset;
+        descr->length = length;
+        descr->nConsts = nConsts;
+        descr->kind = kind;
+        offset += dataSize;
+
+        bool isMutable = (flags & PORTABLE_FLAG_MUTABLE) != 0;
+        unsigned objBits = 0;
+        POLYUNSIGNED nWords;
+        if (isMutable) objBits |= F_MUTABLE_BIT;
+        if (flags & PORTABLE_FLAG_NEGATIVE) objBits |= F_NEGATIVE_BIT;
+        if (flags & PORTABLE_FLAG_NOOVERWRITE) objBits |= F_NO_OVERWRITE;
+        if (flags & PORTABLE_FLAG_WEAK) objBits |= F_WEAK_BIT;
+
+        switch (kind)
+        {
+        case 'O': /* Simple object. */
+            nWords = length;
+            break;
+
+        case 'B': /* Byte segment. */
+            objBits |= F_BYTE_OBJ;
+            nWords = (length + sizeof(PolyWord) -1) / sizeof(PolyWord);
+            break;
+
+        case 'S': /* String.  Add one word for the length. */
+            objBits |= F_BYTE_OBJ;
+            nWords = (length + sizeof(PolyWord) -1) / sizeof(PolyWord) + 1;
+            break;
+
+        case 'D': /* Code segment.  Add one word for the constant count. */
+            objBits |= F_CODE_OBJ;
+            nWords = nConsts + 1 + (length + sizeof(PolyWord) -1) / sizeof(PolyWord);
+            break;
+
+        default:
+            fprintf(stderr, "Invalid object type\n");
+            return false;
+        }
+
+        if (nWords > MAX_OBJECT_SIZE)
+        {
+            fprintf(stderr, "Invalid portable export file\n");
+            return false;
+        }
+        PolyObject *p = NewObject(nWords, isMutable);
+        if (p == 0)
+            return false;
+        objMap[objNo] = p;
+        p->SetLengthWord(nWords, objBits);
+    }
+
+    // Second pass - fill in the contents.  All the objects have been allocated
+    // so this can be done in parallel.
+    POLYUNSIGNED nChunks = (nObjects + PORTABLE_DECODE_CHUNK - 1) / PORTABLE_DECODE_CHUNK;
+    for (POLYUNSIGNED c = 0; c < nChunks; c++)
+        gpTaskFarm->AddWorkOrRunNow(&DecodeObjects, this, (void*)((uintptr_t)c));
+    gpTaskFarm->WaitForCompletion();
+    if (decodeFailed)
+    {
+        fprintf(stderr, "Invalid portable export file\n");
+        return false;
+    }
+
+    return mutSpace.AddToTable() && immutSpace.AddToTable();
+}
+
 // Import a file in the portable format and return a pointer to the root object.
+// The format is determined from the start of the file.
 PolyObject *ImportPortable(const char *fileName)
 {
     PImport pImport;
-    pImport.f = fopen(fileName, "r");
+    pImport.f = fopen(fileName, "rb");
     if (pImport.f == 0)
     {
         fprintf(stderr, "Unable to open file: %s\n", fileName);
         return 0;
     }
-    if (pImport.DoImport())
+    char magic[8];
+    bool isBinary =
+        fread(magic, 1, sizeof(magic), pImport.f) == sizeof(magic) &&
+        memcmp(magic, PORTABLE_MAGIC, sizeof(magic)) == 0;
+    if (! isBinary)
+    {
+        // The text format.  Reopen it in text mode.
+        fclose(pImport.f);
+        pImport.f = fopen(fileName, "r");
+        if (pImport.f == 0)
+        {
+            fprintf(stderr, "Unable to open file: %s\n", fileName);
+            return 0;
+        }
+    }
+    if (isBinary ? pImport.DoBinaryImport() : pImport.DoImport())
         return pImport.Root();
     else
         return 0;
@@ -30,7 +30,7 @@
 class PExport: public Exporter, public ScanAddress
 {
 public:
-    PExport();
+    PExport(bool text=false);
     virtual ~PExport();
 public:
     virtual void exportStore(void);
@@ -43,10 +43,17 @@ private:
 
 private:
     unsigned long getIndex(PolyObject *p);
+    bool isString(PolyObject *p);
+    // Text format.
     void printCodeAddr(byte *q);
     void printAddress(void *p);
     void printValue(PolyWord q);
     void printObject(PolyObject *p);
+    // Binary format.
+    void writeNumber(POLYUNSIGNED n);
+    void writeValue(PolyWord q);
+    void writeObject(PolyObject *p);
+    void writeDescriptor(PolyObject *p, POLYUNSIGNED dataSize);
 
     // We don't use the relocation code so just provide a dummy function here.
     virtual PolyWord createRelocation(PolyWord p, void *relocAddr) { return p; }
@@ -54,6 +61,10 @@ private:
     PolyObject **pMap;
     unsigned long nMapSize, nObjects, totalBytes;
     unsigned *indexOrder;
+    bool textFormat;
+    // Binary format: the constants within a code object.
+    unsigned long codeConstCount;
+    bool countingConsts;
 
 };
 
@@ -52,6 +52,9 @@
 #include "processes.h"
 #include "savestate.h"
 #include "statistics.h"
+#include "rtstrace.h"
+#include "heapdump.h"
+#include "bytevector.h"
 #include "../polystatistics.h"
 
 #define SAVE(x) taskData->saveVec.push(x)
@@ -293,6 +296,7 @@ static Handle unpackStats(TaskData *taskData, const polystatistics *stats)
 Handle poly_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 1:
@@ -302,6 +306,8 @@ Handle poly_dispatch_c(TaskData *taskData, Handle args, Handle code)
         return 0;
     case 3:
         return exportPortable(taskData, args); // Export as portable format
+    case 4:
+        return exportPortableText(taskData, args); // Export as portable text format
 
     case 10: // Return the RTS version string.
         {
@@ -399,13 +405,40 @@ Handle poly_dispatch_c(TaskData *taskData, Handle args, Handle code)
                 raise_exception0(taskData, EXC_subscript);
             int value = get_C_int(taskData, DEREFHANDLE(args)->Get(1));
             globalStats.setUserCounter(index, value);
-            Make_arbitrary_precision(taskData, 0);
+            return Make_arbitrary_precision(taskData, 0);
         }
 
+    case 29: // Write the heap graph to a file.
+        return HeapDump(taskData, args);
+
     case 50: // GCD
         return gcd_arbitrary(taskData, SAVE(DEREFHANDLE(args)->Get(0)), SAVE(DEREFHANDLE(args)->Get(1)));
     case 51: // LCM
         return lcm_arbitrary(taskData, SAVE(DEREFHANDLE(args)->Get(0)), SAVE(DEREFHANDLE(args)->Get(1)));
+    case 52: // Convert an integer to a string in a given radix.
+        return int_to_string_arbitrary(taskData, SAVE(DEREFHANDLE(args)->Get(0)), SAVE(DEREFHANDLE(args)->Get(1)));
+    case 53: // Convert a string of digits in a given radix to an integer.
+        return string_to_int_arbitrary(taskData, SAVE(DEREFHANDLE(args)->Get(0)), SAVE(DEREFHANDLE(args)->Get(1)));
+    case 54: // Compare two substrings.
+        return compareSubstrings(taskData, args);
+    case 55: // Find a string within a substring.
+        return searchString(taskData, args);
+    case 56: // Concatenate a list of strings.
+        return concatStrings(taskData, args);
+    case 57: // Concatenate a list of substrings.
+        return concatSubstrings(taskData, args);
+    case 58: // Find a byte in a slice.
+        return findByte(taskData, args);
+    case 59: // Find any of a set of bytes in a slice.
+        return findAnyByte(taskData, args);
+    case 60: // Return the offsets of a delimiter in a slice.
+        return splitBytes(taskData, args);
+    case 61: // Validate UTF-8 and count the characters.
+        return countUtf8(taskData, args);
+    case 62: // Decode UTF-8 to a vector of words.
+        return decodeUtf8(taskData, args);
+    case 63: // ASCII case folding.
+        return foldAsciiCase(taskData, args);
 
         // These next ones were originally in process_env and have now been moved here,
     case 100: /* Return the maximum word segment size. */
@@ -262,7 +262,7 @@ Handle strconcatc(TaskData *mdTaskData, Handle y, Handle x)
 {
     Handle result;
     POLYUNSIGNED len, xlen, ylen;
-    char *from_ptr, *to_ptr;
+    char *to_ptr;
     
     if (IS_INT(DEREFWORD(x)))
         xlen = 1;
@@ -295,8 +295,8 @@ Handle strconcatc(TaskData *mdTaskData, Handle y, Handle x)
     }
     else
     {
-        from_ptr = DEREFSTRINGHANDLE(x)->chars;
-        while (xlen-- > 0) (*to_ptr++ = *from_ptr++);
+        memcpy(to_ptr, DEREFSTRINGHANDLE(x)->chars, xlen);
+        to_ptr += xlen;
     }
     
     
@@ -307,8 +307,7 @@ Handle strconcatc(TaskData *mdTaskData, Handle y, Handle x)
     }
     else
     {
-        from_ptr = DEREFSTRINGHANDLE(y)->chars;
-        while (ylen-- > 0) (*to_ptr++ = *from_ptr++);
+        memcpy(to_ptr, DEREFSTRINGHANDLE(y)->chars, ylen);
     }
     
     return(result);
@@ -334,48 +333,45 @@ Handle string_length_c(TaskData *mdTaskData, Handle string)    /* Length of a st
     return Make_arbitrary_precision(mdTaskData, length);
 }
 
-static PolyStringObject s_test_x, s_test_y;
+// Return a pointer to the characters of a string and set the length.  Single
+// character strings are represented by the character itself so that is copied
+// into "single" which must remain valid while the result is used.
+const char *stringChars(PolyWord s, char *single, POLYUNSIGNED *length)
+{
+    if (IS_INT(s))
+    {
+        *single = (char)UNTAGGED(s);
+        *length = 1;
+        return single;
+    }
+    PolyStringObject *str = (PolyStringObject*)s.AsObjPtr();
+    *length = str->length;
+    return str->chars;
+}
+
+// Compare two sequences of bytes.  Characters are unsigned so that this agrees
+// with Char.compare.  memcmp is usually vectorised.
+static int compareBytes(const char *x, POLYUNSIGNED xLen, const char *y, POLYUNSIGNED yLen)
+{
+    int res = memcmp(x, y, xLen < yLen ? xLen : yLen);
+    if (res != 0) return res < 0 ? -1 : 1;
+    /* They must be equal or one must be a leading substring of the other. */
+    if (xLen > yLen) return 1; /* y must be the substring. */
+    else if (xLen < yLen) return -1; /* x must be the substring */
+    else return 0; /* They must be equal. */
+}
 
 // These functions are used in the interpreter.  They are generally replaced by
 // hand-coded versions in the assembly code section.
 static int string_test(PolyWord x, PolyWord y) 
 /* Returns -1, 0, +1 if the first string is less, equal to or greater than the
-   second. These are addresses of the strings because calling
-   fix_persistent_address could result in a garbage-collection which could
-   move the other string. */
+   second. */
 {
-    POLYUNSIGNED i;
-    PolyStringObject *xs, *ys;
-    /* Deal with single characters. */
-    if (IS_INT(x))
-    {
-        s_test_x.length = 1;
-        s_test_x.chars[0] = (char)UNTAGGED(x);
-        xs = &s_test_x;
-    }
-    else xs = (PolyStringObject*)x.AsObjPtr();
-
-    if (IS_INT(y))
-    {
-        s_test_y.length = 1;
-        s_test_y.chars[0] = (char)UNTAGGED(y);
-        ys = &s_test_y;
-    }
-    else ys = (PolyStringObject*)y.AsObjPtr();
-    /* Now do the comparison. */
-
-    for(i = 0; i < xs->length && i < ys->length; i++)
-    {
-        if (xs->chars[i] != ys->chars[i])
-            return xs->chars[i] < ys->chars[i] ? -1 : 1;
-    }
-    /* They must be equal or one must be a leading substring of the other. */
-    if (i < xs->length)
-        return 1; /* y must be the substring. */
-    else if (i < ys->length)
-        return -1; /* x must be the substring */
-    else
-        return 0; /* They must be equal. */
+    char xSingle, ySingle;
+    POLYUNSIGNED xLen, yLen;
+    const char *xChars = stringChars(x, &xSingle, &xLen);
+    const char *yChars = stringChars(y, &ySingle, &yLen);
+    return compareBytes(xChars, xLen, yChars, yLen);
 }
 
 Handle compareStrings(TaskData *mdTaskData, Handle y, Handle x)
@@ -412,3 +408,107 @@ Handle testStringLessOrEqual(TaskData *mdTaskData, Handle y, Handle x)
 {
     return mdTaskData->saveVec.push(string_test(DEREFWORD(x), DEREFWORD(y)) <= 0 ? TAGGED(1) : TAGGED(0));
 }
+
+// Get a slice (string, start, length) from a tuple starting at item.  The ML
+// code checks the ranges but we check again because a mistake would read
+// outside the string.
+const char *stringSliceArg(TaskData *mdTaskData, PolyObject *args, unsigned item, char *single, POLYUNSIGNED *length)
+{
+    POLYUNSIGNED strLength;
+    const char *chars = stringChars(args->Get(item), single, &strLength);
+    POLYUNSIGNED start = get_C_ulong(mdTaskData, args->Get(item+1));
+    POLYUNSIGNED len = get_C_ulong(mdTaskData, args->Get(item+2));
+    if (start > strLength || len > strLength - start)
+        raise_exception0(mdTaskData, EXC_subscript);
+    *length = len;
+    return chars + start;
+}
+
+// Compare two substrings.  The argument is (s1, i1, l1, s2, i2, l2).
+Handle compareSubstrings(TaskData *mdTaskData, Handle args)
+{
+    char xSingle, ySingle;
+    POLYUNSIGNED xLen, yLen;
+    const char *xChars = stringSliceArg(mdTaskData, DEREFHANDLE(args), 0, &xSingle, &xLen);
+    const char *yChars = stringSliceArg(mdTaskData, DEREFHANDLE(args), 3, &ySingle, &yLen);
+    return SAVE(TAGGED(compareBytes(xChars, xLen, yChars, yLen)));
+}
+
+// Find the first occurrence of a string within a substring.  The argument is
+// (pattern, s, i, l).  Returns the offset from i or ~1 if it is not there.
+// Candidate positions are found by looking for the first character of the
+// pattern with memchr, which is usually vectorised, and the rest is then
+// compared with memcmp.
+Handle searchString(TaskData *mdTaskData, Handle args)
+{
+    char pSingle, sSingle;
+    POLYUNSIGNED patLength, length;
+    const char *pattern = stringChars(DEREFHANDLE(args)->Get(0), &pSingle, &patLength);
+    const char *chars = stringSliceArg(mdTaskData, DEREFHANDLE(args), 1, &sSingle, &length);
+    if (patLength == 0) return SAVE(TAGGED(0));
+    if (patLength > length) return SAVE(TAGGED(-1));
+    const char *p = chars, *last = chars + length - patLength;
+    while (p <= last)
+    {
+        p = (const char *)memchr(p, pattern[0], last - p + 1);
+        if (p == 0) break;
+        if (memcmp(p+1, pattern+1, patLength-1) == 0)
+            return SAVE(TAGGED(p - chars));
+        p++;
+    }
+    return SAVE(TAGGED(-1));
+}
+
+// Concatenate a list of strings or, if isSlices is true, a list of substrings
+// each given as a triple (s, i, l).  The result is allocated once.
+static Handle concatList(TaskData *mdTaskData, Handle list, bool isSlices)
+{
+    const POLYUNSIGNED maxLength = MAX_OBJECT_SIZE*sizeof(PolyWord) - sizeof(PolyWord);
+    POLYUNSIGNED total = 0;
+    char single;
+    POLYUNSIGNED length;
+    // Find the total length.  This checks the slices.
+    for (PolyWord p = DEREFWORD(list); ! ML_Cons_Cell::IsNull(p); p = ((ML_Cons_Cell*)p.AsObjPtr())->t)
+    {
+        PolyWord item = ((ML_Cons_Cell*)p.AsObjPtr())->h;
+        if (isSlices) (void)stringSliceArg(mdTaskData, item.AsObjPtr(), 0, &single, &length);
+        else (void)stringChars(item, &single, &length);
+        if (length > maxLength - total)
+            raise_exception0(mdTaskData, EXC_size);
+        total += length;
+    }
+    if (total == 0) return SAVE(EmptyString());
+
+    // A single character is represented by the character itself.
+    char result1;
+    char *to = &result1;
+    Handle result = 0;
+    if (total > 1)
+    {
+        result = alloc_and_save(mdTaskData, WORDS(total) + 1, F_BYTE_OBJ);
+        DEREFSTRINGHANDLE(result)->length = total;
+        to = DEREFSTRINGHANDLE(result)->chars;
+    }
+    // The allocation may have moved the list so we dereference it again.
+    for (PolyWord p = DEREFWORD(list); ! ML_Cons_Cell::IsNull(p); p = ((ML_Cons_Cell*)p.AsObjPtr())->t)
+    {
+        PolyWord item = ((ML_Cons_Cell*)p.AsObjPtr())->h;
+        const char *from;
+        if (isSlices) from = stringSliceArg(mdTaskData, item.AsObjPtr(), 0, &single, &length);
+        else from = stringChars(item, &single, &length);
+        memcpy(to, from, length);
+        to += length;
+    }
+    if (total == 1) return SAVE(TAGGED((unsigned char)result1));
+    return result;
+}
+
+Handle concatStrings(TaskData *mdTaskData, Handle list)
+{
+    return concatList(mdTaskData, list, false);
+}
+
+Handle concatSubstrings(TaskData *mdTaskData, Handle list)
+{
+    return concatList(mdTaskData, list, true);
+}
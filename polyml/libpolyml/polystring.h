@@ -85,6 +85,17 @@ extern Handle testStringLess(TaskData *mdTaskData, Handle y, Handle x);
 extern Handle testStringGreaterOrEqual(TaskData *mdTaskData, Handle y, Handle x);
 extern Handle testStringLessOrEqual(TaskData *mdTaskData, Handle y, Handle x);
 
+// Return the characters of a string, copying a single character into "single".
+extern const char *stringChars(PolyWord s, char *single, POLYUNSIGNED *length);
+// Get a substring passed as items (string, start, length) of a tuple.
+extern const char *stringSliceArg(TaskData *mdTaskData, PolyObject *args, unsigned item, char *single, POLYUNSIGNED *length);
+
+// Substrings are passed as a string, start and length.
+extern Handle compareSubstrings(TaskData *mdTaskData, Handle args);
+extern Handle searchString(TaskData *mdTaskData, Handle args);
+extern Handle concatStrings(TaskData *mdTaskData, Handle list);
+extern Handle concatSubstrings(TaskData *mdTaskData, Handle list);
+
 
 
 #endif /* POLYSTRING_H */
@@ -80,6 +80,7 @@
 #include "save_vec.h"
 #include "process_env.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "machine_dep.h"
 #include "processes.h"
 #include "locking.h"
@@ -124,12 +125,13 @@ static PolyWord at_exit_list = TAGGED(0);
    calls to atExit are allowed. */
 static bool exiting = false;
 
-static PLock atExitLock; // Thread lock for above.
+static PLock atExitLock("At exit"); // Thread lock for above.
 
 
 Handle process_env_dispatch_c(TaskData *mdTaskData, Handle args, Handle code)
 {
     int c = get_C_int(mdTaskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(mdTaskData, c);
     switch (c)
     {
     case 0: /* Return the program name. */
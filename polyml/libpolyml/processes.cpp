@@ -121,6 +121,7 @@
 #include "sharedata.h"
 #include "exporter.h"
 #include "statistics.h"
+#include "rtstrace.h"
 
 #if (defined(_WIN32) && ! defined(__CYGWIN__))
 #include "Console.h"
@@ -381,6 +382,7 @@ Handle ThreadDispatch(TaskData *taskData, Handle args, Handle code)
 Handle Processes::ThreadDispatch(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
     ProcessTaskData *ptaskData = (ProcessTaskData *)taskData;
     switch (c)
     {
@@ -420,7 +422,9 @@ Handle Processes::ThreadDispatch(TaskData *taskData, Handle args, Handle code)
                     }
                 case kRequestNone:
                     globalStats.incCount(PSC_THREADS_WAIT_MUTEX);
+                    RtsTraceBlockStart(taskData);
                     ptaskData->threadLock.Wait(&schedLock);
+                    RtsTraceBlockEnd(taskData);
                     globalStats.decCount(PSC_THREADS_WAIT_MUTEX);
                 }
                 ptaskData->blockMutex = 0; // No longer blocked.
@@ -518,10 +522,12 @@ Handle Processes::ThreadDispatch(TaskData *taskData, Handle args, Handle code)
                 // Now release the ML memory.  A GC can start.
                 ThreadReleaseMLMemoryWithSchedLock(ptaskData);
                 globalStats.incCount(PSC_THREADS_WAIT_CONDVAR);
+                RtsTraceBlockStart(taskData);
                 // We pass zero as the wake time to represent infinity.
                 if (isInfinite)
                     ptaskData->threadLock.Wait(&schedLock);
                 else (void)ptaskData->threadLock.WaitUntil(&schedLock, &tWake);
+                RtsTraceBlockEnd(taskData);
                 globalStats.decCount(PSC_THREADS_WAIT_CONDVAR);
                 // We want to use the memory again.
                 ThreadUseMLMemoryWithSchedLock(ptaskData);
@@ -621,12 +627,13 @@ Handle Processes::ThreadDispatch(TaskData *taskData, Handle args, Handle code)
 
 TaskData::TaskData(): mdTaskData(0), allocPointer(0), allocLimit(0), allocSize(MIN_HEAP_SIZE), allocCount(0),
         stack(0), threadObject(0), signalStack(0), pendingInterrupt(false), foreignStack(TAGGED(0)),
-        inML(false)
+        inML(false), rtsTrace(0)
 {
 }
 
 TaskData::~TaskData()
 {
+    RtsTraceThreadExit(this);
     if (signalStack) free(signalStack);
     if (stack) gMem.DeleteStackSpace(stack);
     delete(mdTaskData);
@@ -947,7 +954,9 @@ void Processes::ThreadPauseForIO(TaskData *taskData, Waiter *pWait)
     TestAnyEvents(taskData); // Consider this a blocking call that may raise Interrupt
     ThreadReleaseMLMemory(taskData);
     globalStats.incCount(PSC_THREADS_WAIT_IO);
+    RtsTraceBlockStart(taskData);
     pWait->Wait(1000); // Wait up to a second
+    RtsTraceBlockEnd(taskData);
     globalStats.decCount(PSC_THREADS_WAIT_IO);
     ThreadUseMLMemory(taskData);
     TestAnyEvents(taskData); // Check if we've been interrupted.
@@ -1309,6 +1318,7 @@ void Processes::BeginRootThread(PolyObject *rootFunction)
         // threads in case a thread has allocated some more.
         freeSpace += gMem.GetFreeAllocSpace();
         globalStats.updatePeriodicStats(freeSpace, threadsInML);
+        CheckLockProfileRequest();
     }
     schedLock.Unlock();
     // We are about to return normally.  Stop any crowbar function
@@ -1789,7 +1799,9 @@ bool Processes::WaitForSignal(TaskData *taskData, PLock *sigLock)
         // Now release the ML memory.  A GC can start.
         ThreadReleaseMLMemoryWithSchedLock(ptaskData);
         globalStats.incCount(PSC_THREADS_WAIT_SIGNAL);
+        RtsTraceBlockStart(taskData);
         ptaskData->threadLock.Wait(&schedLock);
+        RtsTraceBlockEnd(taskData);
         globalStats.decCount(PSC_THREADS_WAIT_SIGNAL);
         // We want to use the memory again.
         ThreadUseMLMemoryWithSchedLock(ptaskData);
@@ -44,6 +44,7 @@ class PolyWord;
 class ScanAddress;
 class MDTaskData;
 class Exporter;
+class RtsTraceBuffer;
 
 #ifdef HAVE_WINDOWS_H
 typedef void *HANDLE;
@@ -91,6 +92,7 @@ public:
     bool        pendingInterrupt; // The thread should trap into the RTS soon.
     PolyWord    foreignStack;   // Stack of saved data used in call_sym_and_convert
     bool        inML;          // True when this is in ML, false in the RTS
+    RtsTraceBuffer *rtsTrace;   // Buffer for RTS call tracing.  Only used with --rtstrace.
 };
 
 NORETURNFN(extern Handle exitThread(TaskData *mdTaskData));
@@ -118,6 +120,7 @@ extern enum _mainThreadPhase {
     MTP_LOADSTATE,
     MTP_PROFILING,
     MTP_SIGHANDLER,
+    MTP_HEAPDUMP,
     MTP_MAXENTRY
 } mainThreadPhase;
 
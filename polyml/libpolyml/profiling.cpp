@@ -118,7 +118,8 @@ static const char* mainThreadText[MTP_MAXENTRY] =
     "Saving state",
     "Loading saved state",
     "Profiling",
-    "Setting signal handler"
+    "Setting signal handler",
+    "Writing heap dump"
 };
 
 // Entries for store profiling
@@ -183,7 +184,7 @@ static struct
 // Lock to serialise updates of counts. Only used during update.
 // Not required when we print the counts since there's only one thread
 // running then.
-static PLock countLock;
+static PLock countLock("Profile count");
 
 // Get the profile object associated with a piece of code.  Returns null if
 // there isn't one, in particular if this is in the old format.
@@ -555,7 +556,7 @@ public:
 // To speed up testing whether profiling is off already we
 // maintain a variable that contains the global state.
 static unsigned profile_mode = 0;
-static PLock profLock;
+static PLock profLock("Profiling");
 
 // Called from ML to control profiling.
 Handle profilerc(TaskData *taskData, Handle mode_handle)
@@ -57,6 +57,7 @@ these has filled up it fails and a full garbage collection must be done.
 #include "heapsizing.h"
 #include "gctaskfarm.h"
 #include "statistics.h"
+#include "perfmap.h"
 
 // This protects access to the gMem.lSpace table.
 static PLock localTableLock("Minor GC tables");
@@ -167,6 +168,134 @@ static bool atomiclySetForwarding(LocalMemSpace *space, POLYUNSIGNED *pt,
 #endif
 }
 
+/*
+Optionally, small immutable objects are "interned" as they are copied.  If an
+object with the same length word and contents has already been copied the
+object is forwarded to that copy instead of being copied again.  The table
+holds the copies made by minor GCs and these are all in local spaces that are
+not allocation spaces.  A minor GC never moves or frees objects in those spaces
+so the entries remain valid from one minor GC to the next.  A full GC may move
+or free them so doGC calls ClearInternTable before it does anything else.  The
+table is not a root.  Only objects found by scanning other objects are
+interned.  Objects referenced directly from the roots, which include the
+handles used by the RTS, may still be being initialised.
+
+The table is divided into stripes, each with its own lock and its own part of
+the table, so that the GC threads can use it concurrently.  When a stripe fills
+up nothing more is added to it until it is cleared.
+*/
+bool internInMinorGC = false;
+
+#define INTERN_STRIPES          64
+#define INTERN_STRIPE_SIZE      16384   // Entries in each stripe.  Must be a power of two.
+#define INTERN_MAX_BYTE_WORDS   8       // Largest byte object to intern
+#define INTERN_MAX_WORD_WORDS   4       // Largest word object to intern
+
+class InternTable
+{
+public:
+    InternTable(): table(0) {}
+    ~InternTable() { free(table); }
+
+    bool Initialise(void);
+    void Clear(bool onlyIfFull);
+    PolyObject *FindOrCopy(PolyObject *obj, POLYUNSIGNED L, PolyObject *newObject);
+    POLYUNSIGNED Shared(void);
+
+    static bool IsCandidate(POLYUNSIGNED L)
+    {
+        POLYUNSIGNED n = OBJ_OBJECT_LENGTH(L);
+        if (OBJ_IS_MUTABLE_OBJECT(L) || n == 0)
+            return false;
+        if (OBJ_IS_BYTE_OBJECT(L))
+            return n <= INTERN_MAX_BYTE_WORDS;
+        return GetTypeBits(L) == 0 && n <= INTERN_MAX_WORD_WORDS;
+    }
+
+private:
+    PolyObject **table;
+    struct {
+        PLock lock;
+        POLYUNSIGNED count, shared;
+    } stripes[INTERN_STRIPES];
+};
+
+static InternTable internTable;
+
+bool InternTable::Initialise()
+{
+    if (table == 0)
+        table = (PolyObject **)calloc(INTERN_STRIPES * INTERN_STRIPE_SIZE, sizeof(PolyObject*));
+    return table != 0;
+}
+
+// Clear the table or, at the start of a minor GC, any stripes that are full.
+void InternTable::Clear(bool onlyIfFull)
+{
+    if (table == 0)
+        return;
+    for (unsigned s = 0; s < INTERN_STRIPES; s++)
+    {
+        if (! onlyIfFull || stripes[s].count >= INTERN_STRIPE_SIZE / 4 * 3)
+        {
+            memset(table + s * INTERN_STRIPE_SIZE, 0, INTERN_STRIPE_SIZE * sizeof(PolyObject*));
+            stripes[s].count = 0;
+        }
+    }
+}
+
+POLYUNSIGNED InternTable::Shared()
+{
+    POLYUNSIGNED total = 0;
+    for (unsigned s = 0; s < INTERN_STRIPES; s++)
+    {
+        total += stripes[s].shared;
+        stripes[s].shared = 0;
+    }
+    return total;
+}
+
+// Look for an object with the same contents.  If there is none copy the object
+// to newObject and add it to the table.  The copy is made with the lock held
+// so that another thread never compares against a partially copied object.
+// Returns the object to use.
+PolyObject *InternTable::FindOrCopy(PolyObject *obj, POLYUNSIGNED L, PolyObject *newObject)
+{
+    const POLYUNSIGNED mult = (POLYUNSIGNED)0x9E3779B97F4A7C15ULL;
+    POLYUNSIGNED n = OBJ_OBJECT_LENGTH(L);
+    POLYUNSIGNED h = L;
+    for (POLYUNSIGNED i = 0; i < n; i++)
+    {
+        POLYUNSIGNED w = obj->Get(i).AsUnsigned();
+        h = (h ^ w) * mult;
+    }
+    h ^= h >> (sizeof(POLYUNSIGNED)*4);
+    h *= mult;
+
+    unsigned s = (unsigned)(h >> (sizeof(POLYUNSIGNED)*8 - 6)) & (INTERN_STRIPES-1);
+    PolyObject **stripe = table + s * INTERN_STRIPE_SIZE;
+    PLocker lock(&stripes[s].lock);
+    for (POLYUNSIGNED slot = h & (INTERN_STRIPE_SIZE-1); ; slot = (slot+1) & (INTERN_STRIPE_SIZE-1))
+    {
+        PolyObject *entry = stripe[slot];
+        if (entry == 0)
+        {
+            CopyObjectToNewAddress(obj, newObject, L);
+            if (stripes[s].count < INTERN_STRIPE_SIZE / 4 * 3)
+            {
+                stripe[slot] = newObject;
+                stripes[s].count++;
+            }
+            return newObject;
+        }
+        if (entry->LengthWord() == L && memcmp(entry, obj, n * sizeof(PolyWord)) == 0)
+        {
+            stripes[s].shared++;
+            return entry;
+        }
+    }
+}
+
 PolyObject *QuickGCScanner::FindNewAddress(PolyObject *obj, POLYUNSIGNED L, LocalMemSpace *srcSpace)
 {
     bool isMutable = OBJ_IS_MUTABLE_OBJECT(L);
@@ -209,6 +338,19 @@ PolyObject *QuickGCScanner::FindNewAddress(PolyObject *obj, POLYUNSIGNED L, Loca
             objectCopied = false;
             return newObject;
         }
+        else if (internInMinorGC && ! rootScan && InternTable::IsCandidate(L))
+        {
+            PolyObject *shareWith = internTable.FindOrCopy(obj, L, newObject);
+            obj->SetForwardingPtr(shareWith);
+            if (shareWith != newObject)
+            {
+                objectCopied = false;
+                return shareWith;
+            }
+            lSpace->lowerAllocPtr += n+1;
+            objectCopied = true;
+            return newObject;
+        }
         else obj->SetForwardingPtr(newObject);
     }
 
@@ -500,6 +642,13 @@ bool RunQuickGC(const POLYUNSIGNED wordsRequiredToAllocate)
     if (debugOptions & DEBUG_HEAPSIZE)
         gMem.ReportHeapSizes("Minor GC (before)");
 
+    if (internInMinorGC)
+    {
+        if (internTable.Initialise())
+            internTable.Clear(true);
+        else internInMinorGC = false; // Insufficient memory
+    }
+
     POLYUNSIGNED spaceBeforeGC = 0;
 
     for(unsigned k = 0; k < gMem.nlSpaces; k++)
@@ -591,6 +740,10 @@ bool RunQuickGC(const POLYUNSIGNED wordsRequiredToAllocate)
 
     gpTaskFarm->WaitForCompletion();
 
+    // Record the new addresses of any code we've moved.
+    if (perfMapEnabled)
+        PerfMapFlushMoved();
+
     POLYUNSIGNED spaceAfterGC = 0;
 
     if (succeeded)
@@ -642,6 +795,9 @@ bool RunQuickGC(const POLYUNSIGNED wordsRequiredToAllocate)
         if (debugOptions & DEBUG_HEAPSIZE)
             gMem.ReportHeapSizes("Minor GC (after)");
 
+        if ((debugOptions & DEBUG_GC) && internInMinorGC)
+            Log("GC: Quick: %" POLYUFMT " objects shared with existing copies\n", internTable.Shared());
+
         if (debugOptions & DEBUG_GC)
             Log("GC: Completed successfully\n");
 
@@ -658,3 +814,9 @@ bool RunQuickGC(const POLYUNSIGNED wordsRequiredToAllocate)
 
     return succeeded;
 }
+
+// Called at the start of a full GC.  Objects in the table may be moved or freed.
+void ClearInternTable(void)
+{
+    internTable.Clear(false);
+}
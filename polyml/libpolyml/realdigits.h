@@ -0,0 +1,37 @@
+/*
+    Title:  realdigits.h - Fast conversion between reals and decimal digits
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef REALDIGITS_H_INCLUDED
+#define REALDIGITS_H_INCLUDED
+
+// These handle the common cases of poly_dtoa and poly_strtod and give
+// exactly the same results when the rounding mode is round-to-nearest.
+// They return zero or false when the caller must use the general functions.
+
+// Convert a finite, non-zero value to digits for poly_dtoa modes 0, 2 and 3.
+// buff must have space for at least 18 characters.  The result is the number
+// of digits, which are not null-terminated.
+extern int realToDigits(double d, int mode, int ndigits, char *buff, int *decpt, int *sign);
+
+// Convert a string of the form [+-]digits[.digits][(e|E)[+-]digits].
+extern bool realFromString(const char *s, double *result);
+
+#endif
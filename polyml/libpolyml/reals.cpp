@@ -80,9 +80,11 @@
 #include "arb.h"
 #include "sys.h"
 #include "realconv.h"
+#include "realdigits.h"
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "machine_dep.h"
 #include "processes.h"
 
@@ -281,18 +283,24 @@ Handle Real_expc(TaskData *mdTaskData, Handle arg)
     return real_result(mdTaskData, exp(real_arg(arg)));
 }
 
-/* CALL_IO1(Real_ln, REF, NOIND) */
-Handle Real_lnc(TaskData *mdTaskData, Handle arg)
+static double realLn(double x)
 {
-    double x = real_arg(arg);
     /* Make sure the result conforms to the definition. */
     if (x < 0.0)
-        return real_result(mdTaskData, notANumber); /* Nan. */
+        return notANumber; /* Nan. */
     else if (x == 0.0) /* x may be +0.0 or -0.0 */
-        return real_result(mdTaskData, negInf); /* -infinity. */
-    else return real_result(mdTaskData, log(x));
+        return negInf; /* -infinity. */
+    else return log(x);
+}
+
+/* CALL_IO1(Real_ln, REF, NOIND) */
+Handle Real_lnc(TaskData *mdTaskData, Handle arg)
+{
+    return real_result(mdTaskData, realLn(real_arg(arg)));
 }
 
+static bool useFastConversion(TaskData *mdTaskData);
+
 /* Real_Rep and Real_reprc are redundant.  This is now dealt with by a function within the
    basis library.  DCJM June 2002.*/
 
@@ -367,18 +375,31 @@ Handle Real_convc(TaskData *mdTaskData, Handle str) /* string to real */
     double result;
     int i;
     char *finish;
-    char *string_buffer = Poly_string_to_C_alloc(DEREFHANDLE(str));
+    // Most strings are short enough to copy onto the stack.
+    char buff[100];
+    PolyWord ps = DEREFWORD(str);
+    bool isShort = IS_INT(ps) || ((PolyStringObject*)ps.AsObjPtr())->length < sizeof(buff);
+    char *string_buffer = buff;
+    if (isShort) Poly_string_to_C(ps, buff, sizeof(buff));
+    else string_buffer = Poly_string_to_C_alloc(ps);
     
     /* Scan the string turning '~' into '-' */
     for(i = 0; string_buffer[i] != '\0'; i ++)
     {
         if (string_buffer[i] == '~') string_buffer[i] = '-';
     }
+
+    // Try the fast conversion first.
+    if (useFastConversion(mdTaskData) && realFromString(string_buffer, &result))
+    {
+        if (! isShort) free(string_buffer);
+        return real_result(mdTaskData, result);
+    }
         
     /* Now convert it */
     result = poly_strtod(string_buffer, &finish);
     bool isError = *finish != '\0'; // Test before deallocating
-    free(string_buffer);
+    if (! isShort) free(string_buffer);
     // We no longer detect overflow and underflow and instead return
     // (signed) zeros for underflow and (signed) infinities for overflow.
     if (isError) raise_exception_string(mdTaskData, EXC_conversion, "");
@@ -579,6 +600,7 @@ static void setrounding(TaskData *taskData, Handle args)
 }
 #else
 // Give up.
+#define NO_ROUNDING_CONTROL 1
 static int getrounding(TaskData *mdTaskData)
 {
     raise_exception_string(mdTaskData, EXC_Fail, "Unable to get floating point rounding control");
@@ -590,6 +612,17 @@ static void setrounding(TaskData *mdTaskData, Handle)
 }
 #endif
 
+// The conversions in realdigits.cpp give the same results as poly_dtoa and
+// poly_strtod only when rounding to nearest.
+static bool useFastConversion(TaskData *mdTaskData)
+{
+#ifdef NO_ROUNDING_CONTROL
+    return true; // The rounding mode cannot be changed.
+#else
+    return getrounding(mdTaskData) == POLY_ROUND_TONEAREST;
+#endif
+}
+
 Handle Real_strc(TaskData *mdTaskData, Handle hDigits, Handle hMode, Handle arg)
 {
     double  dx = real_arg(arg);
@@ -597,12 +630,24 @@ Handle Real_strc(TaskData *mdTaskData, Handle hDigits, Handle hMode, Handle arg)
     int     mode = get_C_int(mdTaskData, DEREFWORDHANDLE(hMode));
     int     digits = get_C_int(mdTaskData, DEREFWORDHANDLE(hDigits));
     /* Compute the shortest string which gives the required value. */
-    /*  */
-    char *chars = poly_dtoa(dx, mode, digits, &decpt, &sign, NULL);
-    /* We have to be careful in case an allocation causes a
-       garbage collection. */
-    PolyWord pStr = C_string_to_Poly(mdTaskData, chars);
-    poly_freedtoa(chars);
+    PolyWord pStr = TAGGED(0);
+    char buff[20];
+    int length = 0;
+    if (useFastConversion(mdTaskData))
+        length = realToDigits(dx, mode, digits, buff, &decpt, &sign);
+    if (length != 0)
+    {
+        buff[length] = '\0';
+        pStr = C_string_to_Poly(mdTaskData, buff);
+    }
+    else
+    {
+        char *chars = poly_dtoa(dx, mode, digits, &decpt, &sign, NULL);
+        /* We have to be careful in case an allocation causes a
+           garbage collection. */
+        pStr = C_string_to_Poly(mdTaskData, chars);
+        poly_freedtoa(chars);
+    }
     Handle ppStr = mdTaskData->saveVec.push(pStr);
     /* Allocate a triple for the results. */
     PolyObject *result = alloc(mdTaskData, 3);
@@ -612,10 +657,102 @@ Handle Real_strc(TaskData *mdTaskData, Handle hDigits, Handle hMode, Handle arg)
     return mdTaskData->saveVec.push(result);
 }
 
+/* RealVector and RealArray hold the values unboxed in a byte object with
+   DBLE bytes per element.  The length is held separately in ML because the
+   object is rounded up to a whole number of words.  The ML code checks the
+   subscripts but we check again against the size of the object because a
+   mistake here would overwrite the heap.  Objects are only word aligned so
+   values are always moved with memcpy. */
+static byte *realVectorArg(TaskData *mdTaskData, Handle args, unsigned item, POLYUNSIGNED length)
+{
+    PolyObject *obj = DEREFHANDLE(args)->Get(item).AsObjPtr();
+    if (length > obj->Length() * sizeof(PolyWord) / DBLE)
+        raise_exception0(mdTaskData, EXC_subscript);
+    return obj->AsBytePtr();
+}
+
+static inline double loadReal(const byte *p, POLYUNSIGNED i)
+{
+    double d;
+    memcpy(&d, p + i * DBLE, DBLE);
+    return d;
+}
+
+static inline void storeReal(byte *p, POLYUNSIGNED i, double d)
+{
+    memcpy(p + i * DBLE, &d, DBLE);
+}
+
+// Return a boxed real from a tuple.
+static double realFieldArg(Handle args, unsigned item)
+{
+    return loadReal(DEREFHANDLE(args)->Get(item).AsObjPtr()->AsBytePtr(), 0);
+}
+
+// The bulk operations are simple loops over the elements that the compiler
+// can turn into vector instructions.  Sums are accumulated in four separate
+// partial sums so that the additions are independent.
+static double realArrayDot(const byte *x, const byte *y, POLYUNSIGNED n)
+{
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    POLYUNSIGNED i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += loadReal(x, i) * loadReal(y, i);
+        s1 += loadReal(x, i+1) * loadReal(y, i+1);
+        s2 += loadReal(x, i+2) * loadReal(y, i+2);
+        s3 += loadReal(x, i+3) * loadReal(y, i+3);
+    }
+    for (; i < n; i++)
+        s0 += loadReal(x, i) * loadReal(y, i);
+    return (s0 + s1) + (s2 + s3);
+}
+
+static double realArraySum(const byte *x, POLYUNSIGNED n)
+{
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    POLYUNSIGNED i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += loadReal(x, i);
+        s1 += loadReal(x, i+1);
+        s2 += loadReal(x, i+2);
+        s3 += loadReal(x, i+3);
+    }
+    for (; i < n; i++)
+        s0 += loadReal(x, i);
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Minimum and maximum follow Real.min and Real.max: a NaN is ignored unless
+// all the values are NaN.
+static double realArrayMin(const byte *x, POLYUNSIGNED n)
+{
+    double m = notANumber;
+    for (POLYUNSIGNED i = 0; i < n; i++)
+    {
+        double v = loadReal(x, i);
+        if (v < m || isnan(m)) m = v;
+    }
+    return m;
+}
+
+static double realArrayMax(const byte *x, POLYUNSIGNED n)
+{
+    double m = notANumber;
+    for (POLYUNSIGNED i = 0; i < n; i++)
+    {
+        double v = loadReal(x, i);
+        if (v > m || isnan(m)) m = v;
+    }
+    return m;
+}
+
 /* Functions added for Standard Basis Library are all indirected through here. */
 Handle Real_dispatchc(TaskData *mdTaskData, Handle args, Handle code)
 {
     int c = get_C_int(mdTaskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(mdTaskData, c);
     switch (c)
     {
     case 0: /* tan */ return real_result(mdTaskData, tan(real_arg(args)));
@@ -744,6 +881,75 @@ Handle Real_dispatchc(TaskData *mdTaskData, Handle args, Handle code)
     case 28: /* Return the number of bytes for a real.  */
         return mdTaskData->saveVec.push(TAGGED(sizeof(double)));
 
+    /* Unboxed real vectors and arrays. */
+    case 29: /* Subscript: (vector, index) */
+        {
+            POLYUNSIGNED i = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(1));
+            byte *x = realVectorArg(mdTaskData, args, 0, i+1);
+            return real_result(mdTaskData, loadReal(x, i));
+        }
+    case 30: /* Update: (array, index, value) */
+        {
+            POLYUNSIGNED i = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(1));
+            byte *x = realVectorArg(mdTaskData, args, 0, i+1);
+            storeReal(x, i, realFieldArg(args, 2));
+            return mdTaskData->saveVec.push(TAGGED(0)); /* Unit */
+        }
+    case 31: /* Set every element: (array, length, value) */
+        {
+            POLYUNSIGNED n = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(1));
+            byte *x = realVectorArg(mdTaskData, args, 0, n);
+            double v = realFieldArg(args, 2);
+            for (POLYUNSIGNED i = 0; i < n; i++) storeReal(x, i, v);
+            return mdTaskData->saveVec.push(TAGGED(0)); /* Unit */
+        }
+    case 32: /* axpy - y := a*x+y: (a, x, y, length) */
+        {
+            POLYUNSIGNED n = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(3));
+            double a = realFieldArg(args, 0);
+            const byte *x = realVectorArg(mdTaskData, args, 1, n);
+            byte *y = realVectorArg(mdTaskData, args, 2, n);
+            for (POLYUNSIGNED i = 0; i < n; i++)
+                storeReal(y, i, a * loadReal(x, i) + loadReal(y, i));
+            return mdTaskData->saveVec.push(TAGGED(0)); /* Unit */
+        }
+    case 33: /* Dot product: (x, y, length) */
+        {
+            POLYUNSIGNED n = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(2));
+            const byte *x = realVectorArg(mdTaskData, args, 0, n);
+            const byte *y = realVectorArg(mdTaskData, args, 1, n);
+            return real_result(mdTaskData, realArrayDot(x, y, n));
+        }
+    case 34: /* Apply a function to each element: (function, src, dest, length) */
+        {
+            int f = get_C_int(mdTaskData, DEREFHANDLE(args)->Get(0));
+            POLYUNSIGNED n = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(3));
+            const byte *x = realVectorArg(mdTaskData, args, 1, n);
+            byte *y = realVectorArg(mdTaskData, args, 2, n);
+            switch (f)
+            {
+            case 0: for (POLYUNSIGNED i = 0; i < n; i++) storeReal(y, i, sqrt(loadReal(x, i))); break;
+            case 1: for (POLYUNSIGNED i = 0; i < n; i++) storeReal(y, i, exp(loadReal(x, i))); break;
+            case 2: for (POLYUNSIGNED i = 0; i < n; i++) storeReal(y, i, realLn(loadReal(x, i))); break;
+            default: raise_exception_string(mdTaskData, EXC_Fail, "Unknown real array function");
+            }
+            return mdTaskData->saveVec.push(TAGGED(0)); /* Unit */
+        }
+    case 35: /* Reduce the elements to a single value: (function, x, length) */
+        {
+            int f = get_C_int(mdTaskData, DEREFHANDLE(args)->Get(0));
+            POLYUNSIGNED n = get_C_ulong(mdTaskData, DEREFHANDLE(args)->Get(2));
+            const byte *x = realVectorArg(mdTaskData, args, 1, n);
+            switch (f)
+            {
+            case 0: return real_result(mdTaskData, realArraySum(x, n));
+            case 1: return real_result(mdTaskData, realArrayMin(x, n));
+            case 2: return real_result(mdTaskData, realArrayMax(x, n));
+            default: raise_exception_string(mdTaskData, EXC_Fail, "Unknown real array function");
+            }
+            return 0;
+        }
+
     default:
         {
             char msg[100];
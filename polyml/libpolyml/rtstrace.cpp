@@ -0,0 +1,320 @@
+/*
+    Title:  rtstrace.cpp - Tracing of calls from ML into the run-time system
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+This records every call that ML code makes into the run-time system.  Each
+thread has its own buffer and only that thread adds records to it, so
+recording a call does not take a lock.  A record is made when the call
+returns and holds the start time, the duration, the time spent blocked e.g.
+waiting for IO or a mutex, the RTS call number and, for the dispatch
+functions, the function code.  When a buffer fills it is written to the
+trace file in Chrome trace event format so the result can be loaded
+directly into chrome://tracing or Perfetto.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifdef HAVE_WINDOWS_H
+#include <windows.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "globals.h"
+#include "rtstrace.h"
+#include "processes.h"
+#include "run_time.h"
+#include "rts_module.h"
+#include "locking.h"
+#include "diagnostics.h"
+
+#define TRACE_BUFFER_SIZE   4096    // Records per thread before flushing
+#define TRACE_MAX_NESTING   8       // Maximum depth of nested calls e.g. callbacks
+
+typedef unsigned long long traceTime; // Microseconds since the trace started.
+
+// A record must be complete before the count that includes it is seen by
+// another thread.
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+#define TRACE_BARRIER() MemoryBarrier()
+#else
+#define TRACE_BARRIER() __sync_synchronize()
+#endif
+
+typedef struct {
+    traceTime   start;
+    traceTime   duration;
+    traceTime   blocked;
+    int         ioCall;
+    int         subCode;
+} RtsTraceRecord;
+
+class RtsTraceBuffer {
+public:
+    RtsTraceBuffer(unsigned id): threadId(id), nRecords(0), depth(0), blockStart(0), next(0) {}
+
+    unsigned        threadId;
+    // Only the owning thread changes this.  RtsTrace::Stop may read it from
+    // another thread so it is only increased once the record is complete.
+    volatile unsigned nRecords;
+    RtsTraceRecord  records[TRACE_BUFFER_SIZE];
+    // Calls that have started but not yet returned.  Callbacks from foreign
+    // code can result in nested calls.
+    unsigned        depth;
+    RtsTraceRecord  pending[TRACE_MAX_NESTING];
+    traceTime       blockStart;
+    RtsTraceBuffer  *next;
+};
+
+bool rtsTracing = false;
+
+static const char *traceFileName = 0;
+static FILE *traceFile = 0;
+static bool traceFirstEvent = true;
+static traceTime traceStartTime = 0;
+static unsigned traceThreadCount = 0;
+static RtsTraceBuffer *traceBuffers = 0;  // List of all buffers
+static PLock traceLock("Trace");         // Protects the file and the list of buffers.
+
+// Use a monotonic clock so that the durations are not affected if the
+// system time is changed.
+static traceTime TraceTimeNow(void)
+{
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (traceTime)(count.QuadPart / freq.QuadPart * 1000000 +
+        count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart) - traceStartTime;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (traceTime)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - traceStartTime;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (traceTime)tv.tv_sec * 1000000 + tv.tv_usec - traceStartTime;
+#endif
+}
+
+static int TraceProcessId(void)
+{
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+    return (int)GetCurrentProcessId();
+#else
+    return (int)getpid();
+#endif
+}
+
+void SetRtsTraceFile(const char *fileName)
+{
+    traceFileName = fileName;
+}
+
+// Get the buffer for this thread, creating it if necessary.
+static RtsTraceBuffer *GetTraceBuffer(TaskData *taskData)
+{
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff == 0)
+    {
+        PLocker lock(&traceLock);
+        buff = new RtsTraceBuffer(++traceThreadCount);
+        buff->next = traceBuffers;
+        traceBuffers = buff;
+        taskData->rtsTrace = buff;
+    }
+    return buff;
+}
+
+// Write out the first n records.  Must be called with traceLock held.
+static void WriteTraceRecords(RtsTraceBuffer *buff, unsigned n)
+{
+    if (traceFile != 0)
+    {
+        int pid = TraceProcessId();
+        for (unsigned i = 0; i < n; i++)
+        {
+            RtsTraceRecord *r = &buff->records[i];
+            fputs(traceFirstEvent ? "\n" : ",\n", traceFile);
+            traceFirstEvent = false;
+            fprintf(traceFile, "{\"name\":\"%s", RtsCallName(r->ioCall));
+            if (r->subCode >= 0)
+                fprintf(traceFile, ":%d", r->subCode);
+            fprintf(traceFile, "\",\"cat\":\"rts\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,"
+                "\"args\":{\"call\":%d,\"code\":%d,\"blocked\":%llu}}",
+                pid, buff->threadId, r->start, r->duration, r->ioCall, r->subCode, r->blocked);
+        }
+    }
+}
+
+// Write out the records and empty the buffer.  Only called by the owning thread.
+static void FlushTraceBuffer(RtsTraceBuffer *buff)
+{
+    PLocker lock(&traceLock);
+    WriteTraceRecords(buff, buff->nRecords);
+    buff->nRecords = 0;
+}
+
+void RtsTraceEnter(TaskData *taskData, int ioCall)
+{
+    if (! rtsTracing) return; // Tracing has stopped.
+    RtsTraceBuffer *buff = GetTraceBuffer(taskData);
+    if (buff->depth < TRACE_MAX_NESTING)
+    {
+        RtsTraceRecord *r = &buff->pending[buff->depth];
+        r->start = TraceTimeNow();
+        r->duration = 0;
+        r->blocked = 0;
+        r->ioCall = ioCall;
+        r->subCode = -1;
+    }
+    buff->depth++;
+}
+
+void RtsTraceExit(TaskData *taskData)
+{
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff == 0 || ! rtsTracing || buff->depth == 0) return;
+    buff->depth--;
+    if (buff->depth >= TRACE_MAX_NESTING) return; // Too deeply nested to record.
+    // Complete the record before counting it.
+    unsigned n = buff->nRecords;
+    RtsTraceRecord *r = &buff->records[n];
+    *r = buff->pending[buff->depth];
+    r->duration = TraceTimeNow() - r->start;
+    TRACE_BARRIER();
+    buff->nRecords = n+1;
+    // If the buffer is full write it out.  If RtsTrace::Stop has already
+    // written it the file has been closed and this writes nothing.
+    if (n+1 == TRACE_BUFFER_SIZE)
+        FlushTraceBuffer(buff);
+}
+
+void RtsTraceSubCode(TaskData *taskData, int code)
+{
+    if (! rtsTracing) return;
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff != 0 && buff->depth != 0 && buff->depth <= TRACE_MAX_NESTING)
+        buff->pending[buff->depth-1].subCode = code;
+}
+
+void RtsTraceBlockStart(TaskData *taskData)
+{
+    if (! rtsTracing) return;
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff != 0)
+        buff->blockStart = TraceTimeNow();
+}
+
+void RtsTraceBlockEnd(TaskData *taskData)
+{
+    if (! rtsTracing) return;
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff != 0 && buff->depth != 0 && buff->depth <= TRACE_MAX_NESTING)
+        buff->pending[buff->depth-1].blocked += TraceTimeNow() - buff->blockStart;
+}
+
+// Write out any remaining records and remove the buffer.
+void RtsTraceThreadExit(TaskData *taskData)
+{
+    RtsTraceBuffer *buff = taskData->rtsTrace;
+    if (buff == 0) return;
+    taskData->rtsTrace = 0;
+    PLocker lock(&traceLock);
+    WriteTraceRecords(buff, buff->nRecords);
+    for (RtsTraceBuffer **p = &traceBuffers; *p != 0; p = &(*p)->next)
+    {
+        if (*p == buff)
+        {
+            *p = buff->next;
+            break;
+        }
+    }
+    delete(buff);
+}
+
+class RtsTrace: public RtsModule
+{
+public:
+    virtual void Init(void);
+    virtual void Stop(void);
+};
+
+// Declare this.  It will be automatically added to the table.
+static RtsTrace rtsTraceModule;
+
+void RtsTrace::Init(void)
+{
+    if (traceFileName == 0) return;
+    traceFile = fopen(traceFileName, "w");
+    if (traceFile == 0)
+    {
+        Log("RTS trace: unable to open %s\n", traceFileName);
+        return;
+    }
+    traceStartTime = 0;
+    traceStartTime = TraceTimeNow();
+    fputs("{\"traceEvents\":[", traceFile);
+    rtsTracing = true;
+}
+
+void RtsTrace::Stop(void)
+{
+    if (traceFile == 0) return;
+    PLocker lock(&traceLock);
+    rtsTracing = false;
+    // Other threads may still be running and adding records.  Write out
+    // those that are complete.  The owner only empties its buffer while
+    // holding traceLock so they cannot be overwritten while we write them.
+    for (RtsTraceBuffer *buff = traceBuffers; buff != 0; buff = buff->next)
+    {
+        unsigned n = buff->nRecords;
+        TRACE_BARRIER();
+        WriteTraceRecords(buff, n);
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", traceFile);
+    fclose(traceFile);
+    traceFile = 0;
+}
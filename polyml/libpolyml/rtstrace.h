@@ -0,0 +1,50 @@
+/*
+    Title:  rtstrace.h - Tracing of calls from ML into the run-time system
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef RTSTRACE_H_INCLUDED
+#define RTSTRACE_H_INCLUDED
+
+class TaskData;
+
+// Tracing is enabled with the --rtstrace option.  Each ML thread records
+// the RTS calls it makes in its own buffer, along with the sub-code for
+// the dispatch functions and any time spent blocked, and the buffers are
+// written to the trace file in Chrome trace event format when they fill up,
+// when the thread exits and when the RTS stops.
+extern bool rtsTracing;
+
+extern void SetRtsTraceFile(const char *fileName);
+
+// Called from EnterPolyCode when ML calls into the RTS and when the call returns.
+extern void RtsTraceEnter(TaskData *taskData, int ioCall);
+extern void RtsTraceExit(TaskData *taskData);
+
+// Called by the dispatch functions to record the function code.
+extern void RtsTraceSubCode(TaskData *taskData, int code);
+
+// Called around points where the thread may block.
+extern void RtsTraceBlockStart(TaskData *taskData);
+extern void RtsTraceBlockEnd(TaskData *taskData);
+
+// Called when a thread's task data is deleted.
+extern void RtsTraceThreadExit(TaskData *taskData);
+
+#endif
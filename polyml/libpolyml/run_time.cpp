@@ -142,6 +142,8 @@
 #include "rts_module.h"
 #include "memmgr.h"
 #include "statistics.h"
+#include "rtstrace.h"
+#include "perfmap.h"
 
 #define SAVE(x) taskData->saveVec.push(x)
 #define SIZEOF(x) (sizeof(x)/sizeof(PolyWord))
@@ -578,7 +580,11 @@ Handle CodeSegmentFlags(TaskData *taskData, Handle flags_handle, Handle addr_han
 
     // Flush the cache on architectures that need it.
     if (pt->IsCodeObject() && ! pt->IsMutable())
+    {
         machineDependent->FlushInstructionCache(pt, objLength * sizeof(PolyWord));
+        if (perfMapEnabled)
+            PerfMapAddCode(pt);
+    }
     
     return SAVE(TAGGED(0));
 }
@@ -1129,10 +1135,17 @@ Handle EnterPolyCode(TaskData *taskData)
 /* Called from "main" to enter the code. */
 {
     Handle hOriginal = taskData->saveVec.mark(); // Set this up for the IO calls.
+    bool tracePending = false; // True if we have recorded the start of an RTS call.
     while (1)
     {
         taskData->saveVec.reset(hOriginal); // Remove old RTS arguments and results.
 
+        if (tracePending)
+        {
+            RtsTraceExit(taskData);
+            tracePending = false;
+        }
+
         // Run the ML code and return with the function to call.
         taskData->inML = true;
         int ioFunction = machineDependent->SwitchToPoly(taskData);
@@ -1141,6 +1154,12 @@ Handle EnterPolyCode(TaskData *taskData)
         if ((debugOptions & DEBUG_RTSCALLS) && ioFunction >= 0 && ioFunction < POLY_SYS_vecsize)
             rtsCallCounts[ioFunction]++;
 
+        if (rtsTracing && ioFunction >= 0 && ioFunction < POLY_SYS_vecsize)
+        {
+            RtsTraceEnter(taskData, ioFunction);
+            tracePending = true;
+        }
+
         try {
             switch (ioFunction)
             {
@@ -1966,6 +1985,13 @@ static const char * const rtsName[POLY_SYS_vecsize] =
     "SYS_assign_word"
 };
 
+const char *RtsCallName(int ioCall)
+{
+    if (ioCall < 0 || ioCall >= POLY_SYS_vecsize)
+        return "Unknown RTS call";
+    return rtsName[ioCall];
+}
+
 void RTS::Stop()
 {
     if (debugOptions & DEBUG_RTSCALLS)
@@ -96,4 +96,7 @@ extern void CheckAndGrowStack(TaskData *mdTaskData, PolyWord *lower_limit);
 
 extern Handle errorMsg(TaskData *taskData, int err);
 
+// Return the name of an RTS call for diagnostics.
+extern const char *RtsCallName(int ioCall);
+
 #endif /* _RUNTIME_H_DEFINED */
@@ -40,6 +40,10 @@
 #include <sys/param.h> // For MAX_PATH
 #endif
 
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
@@ -67,6 +71,11 @@
 #define ASSERT(x)
 #endif
 
+#if (defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ))
+#define HAVE_COMPRESSION 1
+#include <zlib.h>
+#endif
+
 #include "globals.h"
 #include "savestate.h"
 #include "processes.h"
@@ -78,8 +87,11 @@
 #include "mpoly.h" // For exportTimeStamp
 #include "exporter.h" // For CopyScan
 #include "machine_dep.h"
+#include "perfmap.h"
 #include "osmem.h"
 #include "gc.h" // For FullGC.
+#include "gctaskfarm.h"
+#include "diagnostics.h"
 
 #if(!defined(MAXPATHLEN) && defined(MAX_PATH))
 #define MAXPATHLEN MAX_PATH
@@ -124,6 +136,9 @@ private:
 
 #define SAVEDSTATESIGNATURE "POLYSAVE"
 #define SAVEDSTATEVERSION   1
+// Files with compressed or delta segments have a different version number so
+// that older versions of Poly/ML reject them.  The format is otherwise the same.
+#define SAVEDSTATEEXTENDEDVERSION 2
 
 // File header for a saved state file.  This appears as the first entry
 // in the file.
@@ -146,8 +161,13 @@ typedef struct _savedStateHeader
     uintptr_t   fileSignature;        // The signature for this file.
     time_t      parentTimeStamp;      // The time stamp for the parent.
     uintptr_t   parentSignature;      // The signature for the parent.
+    // Files written before the checksums were added have a header that
+    // ends here.  They can still be loaded but are not checked.
+    off_t       checksumTable;          // Position of the checksum table (zero if none)
 } SavedStateHeader;
 
+#define SAVEDSTATEOLDHEADERLENGTH   offsetof(SavedStateHeader, checksumTable)
+
 // Entry for segment table.  This describes the segments on the disc that
 // need to be loaded into memory.
 typedef struct _savedStateSegmentDescr
@@ -166,6 +186,14 @@ typedef struct _savedStateSegmentDescr
 #define SSF_OVERWRITE   2               // The segment overwrites the data (mutable) in a parent.
 #define SSF_NOOVERWRITE 4               // The segment must not be further overwritten
 #define SSF_BYTES       8               // The segment containing only byte data
+#define SSF_COMPRESSED  16              // The segment data is compressed (see below)
+#define SSF_DELTA       32              // The overwrite only contains the changed pages (see below)
+
+// The segment data is aligned in the file so that it can be mapped into
+// memory rather than read.  This is a multiple of the page size on all the
+// systems we support.  Files written before this was introduced can still
+// be loaded: segments that are not aligned are read.
+#define SAVEDSTATE_SEGMENT_ALIGNMENT    65536
 
 typedef struct _relocationEntry
 {
@@ -179,6 +207,83 @@ typedef struct _relocationEntry
     ScanRelocationKind relKind;         // The kind of relocation (processor dependent).
 } RelocationEntry;
 
+// A compressed segment is split into chunks that are compressed separately
+// with zlib so that they can be compressed and decompressed in parallel.
+// The segment data begins with this header followed by a table with an
+// entry for each chunk.  All the chunks except the last are chunkSize
+// bytes when they are decompressed.
+typedef struct _compressedSegmentHeader
+{
+    unsigned    chunkSize;              // Size of an uncompressed chunk
+    unsigned    chunkCount;             // Number of entries in the chunk table
+} CompressedSegmentHeader;
+
+typedef struct _compressedChunkEntry
+{
+    off_t       chunkData;              // Position of the compressed data
+    size_t      chunkLength;            // Size of the compressed data
+} CompressedChunkEntry;
+
+#define COMPRESSION_CHUNK_SIZE  (1024*1024)
+// Number of chunks to hold in memory while they are being processed.
+#define COMPRESSION_BATCH_SIZE  64
+
+// The compression level.  Zero means that saved states are not compressed.
+unsigned savedStateCompression = 0;
+
+// A delta segment overwrites only some of the pages of a mutable segment in a
+// parent.  The segment data begins with this header followed by the index of
+// each page that is present and then the data for those pages.  The last page
+// of the segment may be shorter than pageSize.
+typedef struct _deltaSegmentHeader
+{
+    unsigned    pageSize;               // Size of a page in bytes
+    unsigned    pageCount;              // Number of pages present
+} DeltaSegmentHeader;
+
+#define SAVEDSTATE_DELTA_PAGE_SIZE  4096
+
+// The checksum table has an entry for each segment descriptor giving the
+// position of a hash of each page of the segment data as it is in memory
+// before it is relocated.  For a delta segment there is a hash for each page
+// that is present, in order.  The file signature is computed from all the
+// hashes and is recorded in each child as the parent signature so that a
+// parent that has been replaced is detected even if it has the same time stamp.
+typedef struct _segmentChecksum
+{
+    off_t       hashes;                 // Position of the hashes (zero if none)
+    unsigned    pageSize;               // Number of bytes covered by each hash
+    unsigned    hashCount;              // Number of hashes
+} SegmentChecksum;
+
+#define SAVEDSTATE_CHECKSUM_PAGE_SIZE   65536
+// Number of pages hashed by each task.
+#define CHECKSUM_PAGES_PER_TASK         16
+
+// Write delta segments for the mutable data in the parents when the changed
+// pages are known.
+bool deltaSavedStates = false;
+
+// Use identical objects in the parents rather than copying them into a child.
+bool dedupSavedStates = false;
+
+// A record of the contents of a mutable permanent segment when the hierarchy
+// was last loaded or saved.  Rather than rely on the operating system to track
+// writes, which may be made by the RTS as well as by ML code, we keep a hash of
+// each page and compare it when the next child is saved.
+typedef struct {
+    unsigned    index;                  // Segment index
+    PolyWord    *bottom;                // Address of the segment
+    size_t      length;                 // Length in bytes of the data
+    size_t      pageCount;
+    uint64_t    *pageHashes;
+} DeltaSnapshot;
+
+static DeltaSnapshot *deltaSnapshots;
+static unsigned nDeltaSnapshots;
+// The depth of the hierarchy whose files reproduce the snapshot.  Zero if there isn't one.
+static unsigned deltaSnapshotDepth;
+
 #define SAVE(x) taskData->saveVec.push(x)
 
 /*
@@ -191,20 +296,41 @@ typedef struct _relocationEntry
 class HierarchyTable
 {
 public:
-    HierarchyTable(const char *file, time_t time):
-      fileName(strdup(file)), timeStamp(time) { }
+    HierarchyTable(const char *file, time_t time, uintptr_t sig);
     AutoFree<char*> fileName;
     time_t          timeStamp;
+    uintptr_t       signature;
+#ifndef HAVE_WINDOWS_H
+    // The identity of the file when it was loaded or saved.  Saving a child
+    // only has to look up the new file rather than every file in the hierarchy.
+    bool            haveId;
+    dev_t           device;
+    ino_t           inode;
+#endif
 };
 
+HierarchyTable::HierarchyTable(const char *file, time_t time, uintptr_t sig):
+    fileName(strdup(file)), timeStamp(time), signature(sig)
+{
+#ifndef HAVE_WINDOWS_H
+    struct stat fStat;
+    haveId = stat(file, &fStat) == 0;
+    if (haveId)
+    {
+        device = fStat.st_dev;
+        inode = fStat.st_ino;
+    }
+#endif
+}
+
 HierarchyTable **hierarchyTable;
 
 static unsigned hierarchyDepth;
 
-static bool AddHierarchyEntry(const char *fileName, time_t timeStamp)
+static bool AddHierarchyEntry(const char *fileName, time_t timeStamp, uintptr_t signature)
 {
     // Add an entry to the hierarchy table for this file.
-    HierarchyTable *newEntry = new HierarchyTable(fileName, timeStamp);
+    HierarchyTable *newEntry = new HierarchyTable(fileName, timeStamp, signature);
     if (newEntry == 0) return false;
     HierarchyTable **newTable =
         (HierarchyTable **)realloc(hierarchyTable, sizeof(HierarchyTable *)*(hierarchyDepth+1));
@@ -216,32 +342,52 @@ static bool AddHierarchyEntry(const char *fileName, time_t timeStamp)
 
 // Test whether we're overwriting a parent of ourself.
 #ifdef HAVE_WINDOWS_H
-static bool sameFile(const char *x, const char *y)
+static bool sameFile(const HierarchyTable *x, const char *y)
 {
     // Get the lengths and return if either does not exist.
     LPSTR filePart;
-    DWORD dwxLen = GetFullPathName(x, 1, 0, 0);
+    DWORD dwxLen = GetFullPathName(x->fileName, 1, 0, 0);
     if (dwxLen == 0) return false;
     DWORD dwyLen = GetFullPathName(y, 0, 0, 0);
     if (dwyLen == 0) return false;
     if (dwxLen != dwyLen) return false;
     AutoFree<char*> xName = (char*)malloc(dwxLen+1);
-    GetFullPathName(x, dwxLen+1, xName, &filePart);
+    GetFullPathName(x->fileName, dwxLen+1, xName, &filePart);
     AutoFree<char*> yName = (char*)malloc(dwyLen+1);
     GetFullPathName(y, dwyLen+1, yName, &filePart);
     return strcmpi(xName, yName) == 0;
 }
 #else
-static bool sameFile(const char *x, const char *y)
+static bool sameFile(const HierarchyTable *x, const struct stat *yStat)
 {
-    struct stat xStat, yStat;
     // If either file does not exist that's fine.
-    if (stat(x, &xStat) != 0 || stat(y, &yStat) != 0)
+    if (! x->haveId || yStat == 0)
         return false;
-    return (xStat.st_dev == yStat.st_dev && xStat.st_ino == yStat.st_ino);
+    return (x->device == yStat->st_dev && x->inode == yStat->st_ino);
 }
 #endif
 
+// Read the header of a saved state and check that it is one we can load.
+// Returns an error message or zero if it succeeds.  Files written before the
+// checksums were added have a shorter header.
+static const char *ReadSavedStateHeader(FILE *loadFile, SavedStateHeader *header)
+{
+    memset(header, 0, sizeof(SavedStateHeader));
+    if (fread(header, SAVEDSTATEOLDHEADERLENGTH, 1, loadFile) != 1)
+        return "Unable to load header";
+    if (strncmp(header->headerSignature, SAVEDSTATESIGNATURE, sizeof(header->headerSignature)) != 0)
+        return "File is not a saved state";
+    if ((header->headerVersion != SAVEDSTATEVERSION && header->headerVersion != SAVEDSTATEEXTENDEDVERSION) ||
+        (header->headerLength != sizeof(SavedStateHeader) && header->headerLength != SAVEDSTATEOLDHEADERLENGTH) ||
+        header->segmentDescrLength != sizeof(SavedStateSegmentDescr))
+        return "Unsupported version of saved state file";
+    if (header->headerLength > SAVEDSTATEOLDHEADERLENGTH &&
+        fread((char*)header + SAVEDSTATEOLDHEADERLENGTH,
+              header->headerLength - SAVEDSTATEOLDHEADERLENGTH, 1, loadFile) != 1)
+        return "Unable to load header";
+    return 0;
+}
+
 /*
  *  Saving state.
  */
@@ -323,6 +469,387 @@ void SaveStateExport::ScanConstant(byte *addr, ScanRelocationKind code)
     relocationCount++;
 }
 
+#ifdef HAVE_COMPRESSION
+// A chunk to be compressed or decompressed by one of the task farm threads.
+typedef struct {
+    const Bytef *source;
+    uLong       sourceLength;
+    Bytef       *dest;
+    uLongf      destLength;     // The size of the buffer and then the size used.
+    uLong       expectedLength; // Decompression only: the size of the chunk.
+    bool        succeeded;
+} CompressionChunk;
+
+static void compressChunk(GCTaskId *, void *arg1, void *)
+{
+    CompressionChunk *chunk = (CompressionChunk *)arg1;
+    chunk->succeeded =
+        compress2(chunk->dest, &chunk->destLength, chunk->source, chunk->sourceLength,
+            (int)savedStateCompression) == Z_OK;
+}
+
+static void decompressChunk(GCTaskId *, void *arg1, void *)
+{
+    CompressionChunk *chunk = (CompressionChunk *)arg1;
+    chunk->succeeded =
+        uncompress(chunk->dest, &chunk->destLength, chunk->source, chunk->sourceLength) == Z_OK &&
+        chunk->destLength == chunk->expectedLength;
+}
+#endif
+
+// Write the segment data as compressed chunks.  Each batch of chunks is
+// compressed in parallel and then written.  Returns false if the segment
+// could not be compressed.  The caller then writes it uncompressed at the
+// same position.
+static bool WriteCompressedSegment(FILE *saveFile, void *data, size_t length)
+{
+#ifdef HAVE_COMPRESSION
+    CompressedSegmentHeader header;
+    header.chunkSize = COMPRESSION_CHUNK_SIZE;
+    header.chunkCount = (unsigned)((length + COMPRESSION_CHUNK_SIZE - 1) / COMPRESSION_CHUNK_SIZE);
+    uLong bound = compressBound(COMPRESSION_CHUNK_SIZE);
+    // A small segment only needs buffers for the chunks it has.
+    unsigned batchSize =
+        header.chunkCount < COMPRESSION_BATCH_SIZE ? header.chunkCount : COMPRESSION_BATCH_SIZE;
+    AutoFree<CompressedChunkEntry*>
+        table((CompressedChunkEntry*)calloc(header.chunkCount, sizeof(CompressedChunkEntry)));
+    AutoFree<Bytef*> buffer((Bytef*)malloc(bound * batchSize));
+    if (table == 0 || buffer == 0)
+        return false;
+
+    off_t tablePos = ftell(saveFile) + sizeof(header);
+    fwrite(&header, sizeof(header), 1, saveFile);
+    // Write the table now to reserve the space.  It is rewritten at the end.
+    fwrite(table, sizeof(CompressedChunkEntry), header.chunkCount, saveFile);
+
+    CompressionChunk chunks[COMPRESSION_BATCH_SIZE];
+    for (unsigned first = 0; first < header.chunkCount; first += COMPRESSION_BATCH_SIZE)
+    {
+        unsigned batch = header.chunkCount - first;
+        if (batch > COMPRESSION_BATCH_SIZE) batch = COMPRESSION_BATCH_SIZE;
+        for (unsigned i = 0; i < batch; i++)
+        {
+            size_t offset = (size_t)(first+i) * COMPRESSION_CHUNK_SIZE;
+            CompressionChunk *chunk = &chunks[i];
+            chunk->source = (Bytef*)data + offset;
+            chunk->sourceLength = (uLong)(length - offset < COMPRESSION_CHUNK_SIZE ? length - offset : COMPRESSION_CHUNK_SIZE);
+            chunk->dest = buffer + bound * i;
+            chunk->destLength = bound;
+            gpTaskFarm->AddWorkOrRunNow(compressChunk, chunk, 0);
+        }
+        gpTaskFarm->WaitForCompletion();
+        for (unsigned j = 0; j < batch; j++)
+        {
+            if (! chunks[j].succeeded)
+                return false;
+            table[first+j].chunkData = ftell(saveFile);
+            table[first+j].chunkLength = chunks[j].destLength;
+            fwrite(chunks[j].dest, chunks[j].destLength, 1, saveFile);
+        }
+    }
+
+    off_t endPos = ftell(saveFile);
+    fseek(saveFile, tablePos, SEEK_SET);
+    fwrite(table, sizeof(CompressedChunkEntry), header.chunkCount, saveFile);
+    fseek(saveFile, endPos, SEEK_SET);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Read and decompress the segment data.  While one batch of chunks is being
+// decompressed by the task farm threads the next batch is read.
+// Returns an error message or zero if it succeeds.
+static const char *ReadCompressedSegment(FILE *loadFile, off_t position, void *data, size_t length)
+{
+#ifdef HAVE_COMPRESSION
+    CompressedSegmentHeader header;
+    if (fseek(loadFile, position, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, loadFile) != 1)
+        return "Unable to read segment";
+    // The chunk size is used to size the buffers so check it before using it.
+    // We only ever write chunks of COMPRESSION_CHUNK_SIZE.
+    if (header.chunkSize == 0 || header.chunkSize > COMPRESSION_CHUNK_SIZE ||
+        header.chunkCount != (length + header.chunkSize - 1) / header.chunkSize)
+        return "Bad compressed segment";
+    uLong bound = compressBound(header.chunkSize);
+    unsigned batchSize =
+        header.chunkCount < COMPRESSION_BATCH_SIZE ? header.chunkCount : COMPRESSION_BATCH_SIZE;
+    AutoFree<CompressedChunkEntry*>
+        table((CompressedChunkEntry*)malloc(header.chunkCount * sizeof(CompressedChunkEntry)));
+    AutoFree<Bytef*> buffer((Bytef*)malloc(bound * batchSize * 2));
+    if (table == 0 || buffer == 0)
+        return "Unable to allocate memory";
+    if (fread(table, sizeof(CompressedChunkEntry), header.chunkCount, loadFile) != header.chunkCount)
+        return "Unable to read segment";
+
+    CompressionChunk chunks[2][COMPRESSION_BATCH_SIZE];
+    const char *errorMessage = 0;
+    unsigned batches = (header.chunkCount + COMPRESSION_BATCH_SIZE - 1) / COMPRESSION_BATCH_SIZE;
+    // Read a batch into one of the two sets of buffers.
+    for (unsigned b = 0; b <= batches && errorMessage == 0; b++)
+    {
+        // Start decompressing the batch we read last time round.
+        if (b > 0)
+        {
+            unsigned first = (b-1) * COMPRESSION_BATCH_SIZE;
+            for (unsigned i = 0; i < COMPRESSION_BATCH_SIZE && first+i < header.chunkCount; i++)
+                gpTaskFarm->AddWorkOrRunNow(decompressChunk, &chunks[(b-1) % 2][i], 0);
+        }
+        // Read the next batch.
+        if (b < batches)
+        {
+            unsigned first = b * COMPRESSION_BATCH_SIZE;
+            for (unsigned i = 0; i < COMPRESSION_BATCH_SIZE && first+i < header.chunkCount; i++)
+            {
+                CompressedChunkEntry *entry = &table[first+i];
+                CompressionChunk *chunk = &chunks[b % 2][i];
+                size_t offset = (size_t)(first+i) * header.chunkSize;
+                chunk->source = buffer + bound * (batchSize * (b % 2) + i);
+                chunk->sourceLength = (uLong)entry->chunkLength;
+                chunk->dest = (Bytef*)data + offset;
+                chunk->expectedLength = (uLong)(length - offset < header.chunkSize ? length - offset : header.chunkSize);
+                chunk->destLength = chunk->expectedLength;
+                chunk->succeeded = false;
+                if (entry->chunkLength > bound ||
+                    fseek(loadFile, entry->chunkData, SEEK_SET) != 0 ||
+                    fread((void*)chunk->source, entry->chunkLength, 1, loadFile) != 1)
+                {
+                    errorMessage = "Unable to read segment";
+                    break;
+                }
+            }
+        }
+        if (b > 0)
+        {
+            gpTaskFarm->WaitForCompletion();
+            unsigned first = (b-1) * COMPRESSION_BATCH_SIZE;
+            for (unsigned i = 0; i < COMPRESSION_BATCH_SIZE && first+i < header.chunkCount; i++)
+            {
+                if (! chunks[(b-1) % 2][i].succeeded)
+                    errorMessage = "Bad compressed segment";
+            }
+        }
+    }
+    return errorMessage;
+#else
+    return "Compressed saved states are not supported";
+#endif
+}
+
+static uint64_t HashPage(const POLYUNSIGNED *data, size_t words)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < words; i++)
+    {
+        hash ^= (uint64_t)data[i];
+        hash *= 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// The page hashes of a segment.  These are computed in parallel by the
+// task farm when the segment is written and again when it is loaded.
+typedef struct {
+    const char  *data;                  // The segment data in memory
+    size_t      length;                 // Length of the data in bytes
+    unsigned    pageSize;
+    unsigned    hashCount;
+    unsigned    *pages;                 // The page for each hash in a delta segment, otherwise zero
+    uint64_t    *hashes;
+} SegmentHashes;
+
+static void hashPagesTask(GCTaskId *, void *arg1, void *arg2)
+{
+    SegmentHashes *sh = (SegmentHashes *)arg1;
+    unsigned first = (unsigned)(uintptr_t)arg2;
+    unsigned last = first + CHECKSUM_PAGES_PER_TASK;
+    if (last > sh->hashCount) last = sh->hashCount;
+    for (unsigned i = first; i < last; i++)
+    {
+        size_t offset = (size_t)(sh->pages ? sh->pages[i] : i) * sh->pageSize;
+        size_t bytes = sh->length - offset < sh->pageSize ? sh->length - offset : sh->pageSize;
+        sh->hashes[i] = HashPage((const POLYUNSIGNED*)(sh->data + offset), bytes / sizeof(PolyWord));
+    }
+}
+
+// Allocate the hashes for a segment and queue the tasks to compute them.
+// The caller must wait for the task farm to complete.
+static bool StartSegmentHashes(SegmentHashes *sh, const void *data, size_t length,
+                               unsigned pageSize, unsigned *pages, unsigned pageCount)
+{
+    sh->data = (const char*)data;
+    sh->length = length;
+    sh->pageSize = pageSize;
+    sh->pages = pages;
+    sh->hashCount = pages ? pageCount : (unsigned)((length + pageSize - 1) / pageSize);
+    sh->hashes = (uint64_t*)malloc(sh->hashCount * sizeof(uint64_t) + 1);
+    if (sh->hashes == 0)
+        return false;
+    for (unsigned i = 0; i < sh->hashCount; i += CHECKSUM_PAGES_PER_TASK)
+        gpTaskFarm->AddWorkOrRunNow(hashPagesTask, sh, (void*)(uintptr_t)i);
+    return true;
+}
+
+// Combine the hashes of all the segments into the file signature.
+static uintptr_t FileSignature(const SegmentHashes *segments, unsigned count)
+{
+    uint64_t sig = 14695981039346656037ULL;
+    for (unsigned i = 0; i < count; i++)
+    {
+        for (unsigned j = 0; j < segments[i].hashCount; j++)
+        {
+            sig ^= segments[i].hashes[j];
+            sig *= 1099511628211ULL;
+        }
+    }
+    uintptr_t result = (uintptr_t)(sig ^ (sig >> 32));
+    return result == 0 ? 1 : result; // Zero means there isn't a signature.
+}
+
+static void ClearDeltaSnapshot(void)
+{
+    for (unsigned i = 0; i < nDeltaSnapshots; i++)
+        free(deltaSnapshots[i].pageHashes);
+    free(deltaSnapshots);
+    deltaSnapshots = 0;
+    nDeltaSnapshots = 0;
+    deltaSnapshotDepth = 0;
+}
+
+// Record the contents of the mutable segments that a child of this hierarchy
+// may overwrite.  Segments in the executable are excluded because they are not
+// reloaded when a saved state is loaded so a delta could not be applied to them.
+static void TakeDeltaSnapshot(unsigned depth)
+{
+    ClearDeltaSnapshot();
+    if (! deltaSavedStates || depth == 0)
+        return;
+    deltaSnapshots = (DeltaSnapshot*)calloc(gMem.npSpaces, sizeof(DeltaSnapshot));
+    if (deltaSnapshots == 0)
+        return;
+    for (unsigned i = 0; i < gMem.npSpaces; i++)
+    {
+        PermanentMemSpace *space = gMem.pSpaces[i];
+        if (! space->isMutable || space->noOverwrite || space->hierarchy == 0)
+            continue;
+        DeltaSnapshot *snap = &deltaSnapshots[nDeltaSnapshots];
+        snap->index = space->index;
+        snap->bottom = space->bottom;
+        snap->length = (space->topPointer-space->bottom)*sizeof(PolyWord);
+        snap->pageCount = (snap->length + SAVEDSTATE_DELTA_PAGE_SIZE - 1) / SAVEDSTATE_DELTA_PAGE_SIZE;
+        snap->pageHashes = (uint64_t*)malloc(snap->pageCount * sizeof(uint64_t));
+        if (snap->pageHashes == 0)
+        {
+            ClearDeltaSnapshot();
+            return;
+        }
+        for (size_t p = 0; p < snap->pageCount; p++)
+        {
+            size_t offset = p * SAVEDSTATE_DELTA_PAGE_SIZE;
+            size_t bytes = snap->length - offset < SAVEDSTATE_DELTA_PAGE_SIZE ? snap->length - offset : SAVEDSTATE_DELTA_PAGE_SIZE;
+            snap->pageHashes[p] = HashPage((POLYUNSIGNED*)((char*)space->bottom + offset), bytes / sizeof(PolyWord));
+        }
+        nDeltaSnapshots++;
+    }
+    deltaSnapshotDepth = depth;
+}
+
+// Write the pages of a mutable segment that have changed since the snapshot.
+// Returns false if there is no snapshot for the segment or if so much has
+// changed that the whole segment should be written.  If it succeeds it
+// returns the list of pages written, which the caller must free.
+static bool WriteDeltaSegment(FILE *saveFile, unsigned index, void *data, size_t length,
+                              unsigned **pagesWritten, unsigned *pageCount)
+{
+    DeltaSnapshot *snap = 0;
+    for (unsigned i = 0; i < nDeltaSnapshots; i++)
+    {
+        if (deltaSnapshots[i].index == index)
+            snap = &deltaSnapshots[i];
+    }
+    if (snap == 0 || snap->bottom != (PolyWord*)data || snap->length != length)
+        return false;
+
+    AutoFree<unsigned*> pages((unsigned*)malloc(snap->pageCount * sizeof(unsigned)));
+    if (pages == 0)
+        return false;
+    DeltaSegmentHeader header;
+    header.pageSize = SAVEDSTATE_DELTA_PAGE_SIZE;
+    header.pageCount = 0;
+    for (size_t p = 0; p < snap->pageCount; p++)
+    {
+        size_t offset = p * SAVEDSTATE_DELTA_PAGE_SIZE;
+        size_t bytes = length - offset < SAVEDSTATE_DELTA_PAGE_SIZE ? length - offset : SAVEDSTATE_DELTA_PAGE_SIZE;
+        if (HashPage((POLYUNSIGNED*)((char*)data + offset), bytes / sizeof(PolyWord)) != snap->pageHashes[p])
+            pages[header.pageCount++] = (unsigned)p;
+    }
+    // If more than half the pages have changed it's not worth it.
+    if (header.pageCount > snap->pageCount / 2)
+        return false;
+
+    fwrite(&header, sizeof(header), 1, saveFile);
+    fwrite(pages, sizeof(unsigned), header.pageCount, saveFile);
+    for (unsigned q = 0; q < header.pageCount; q++)
+    {
+        size_t offset = (size_t)pages[q] * SAVEDSTATE_DELTA_PAGE_SIZE;
+        size_t bytes = length - offset < SAVEDSTATE_DELTA_PAGE_SIZE ? length - offset : SAVEDSTATE_DELTA_PAGE_SIZE;
+        fwrite((char*)data + offset, bytes, 1, saveFile);
+    }
+    if (debugOptions & DEBUG_MEMMGR)
+        Log("MMGR: Wrote %u of %lu pages of segment %u\n", header.pageCount, (unsigned long)snap->pageCount, index);
+    *pagesWritten = pages;
+    *pageCount = header.pageCount;
+    pages = 0; // Now owned by the caller.
+    return true;
+}
+
+// The pages of a segment that have been overwritten by a delta segment.  Only
+// the addresses in these pages need to be relocated.  The others were relocated
+// when the parent was loaded.
+typedef struct {
+    unsigned        pageSize;
+    size_t          pageCount;
+    unsigned char   *present;
+} DeltaPageMap;
+
+// Read a delta segment over the existing data.  Returns an error message or
+// zero if it succeeds.
+static const char *ReadDeltaSegment(FILE *loadFile, off_t position, void *data, size_t length,
+                                    size_t spaceLength, DeltaPageMap *pageMap)
+{
+    DeltaSegmentHeader header;
+    if (fseek(loadFile, position, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, loadFile) != 1)
+        return "Unable to read segment";
+    if (header.pageSize == 0 || header.pageSize % sizeof(PolyWord) != 0 || length > spaceLength)
+        return "Bad delta segment";
+    size_t pageCount = (length + header.pageSize - 1) / header.pageSize;
+    if (header.pageCount > pageCount)
+        return "Bad delta segment";
+    AutoFree<unsigned*> pages((unsigned*)malloc(header.pageCount * sizeof(unsigned) + 1));
+    pageMap->present = (unsigned char*)calloc(pageCount, 1);
+    if (pages == 0 || pageMap->present == 0)
+        return "Unable to allocate memory";
+    pageMap->pageSize = header.pageSize;
+    pageMap->pageCount = pageCount;
+    if (fread(pages, sizeof(unsigned), header.pageCount, loadFile) != header.pageCount)
+        return "Unable to read segment";
+    for (unsigned q = 0; q < header.pageCount; q++)
+    {
+        if (pages[q] >= pageCount)
+            return "Bad delta segment";
+        size_t offset = (size_t)pages[q] * header.pageSize;
+        size_t bytes = length - offset < header.pageSize ? length - offset : header.pageSize;
+        if (fread((char*)data + offset, bytes, 1, loadFile) != 1)
+            return "Unable to read segment";
+        pageMap->present[pages[q]] = 1;
+    }
+    return 0;
+}
+
 // Request to the main thread to save data.
 class SaveRequest: public MainThreadRequest
 {
@@ -397,8 +924,16 @@ PolyWord SaveFixupAddress::GetNewAddress(PolyWord old)
 void SaveRequest::Perform()
 {
     // Check that we aren't overwriting our own parent.
+#ifndef HAVE_WINDOWS_H
+    struct stat saveStat;
+    bool saveExists = stat(fileName, &saveStat) == 0;
+#endif
     for (unsigned q = 0; q < newHierarchy-1; q++) {
-        if (sameFile(hierarchyTable[q]->fileName, fileName))
+#ifdef HAVE_WINDOWS_H
+        if (sameFile(hierarchyTable[q], fileName))
+#else
+        if (sameFile(hierarchyTable[q], saveExists ? &saveStat : 0))
+#endif
         {
             errorMessage = "File being saved is used as a parent of this file";
             errCode = 0;
@@ -406,9 +941,22 @@ void SaveRequest::Perform()
         }
     }
 
+    // The mutable data in the parents can be written as the pages that have
+    // changed if we have a record of it as it was when the parent was loaded or saved.
+    bool writeDelta = deltaSavedStates && deltaSnapshotDepth != 0 && deltaSnapshotDepth == newHierarchy-1;
+
     SaveStateExport exports;
+#if (!defined(_WIN32) || defined(__CYGWIN__))
+    // Write a new file and rename it when it is complete.  A saved state that
+    // has been loaded is mapped from its file rather than copied so we must not
+    // overwrite a file that this or another process may have loaded.
+    char saveFileName[MAXPATHLEN+20];
+    sprintf(saveFileName, "%s.%d", fileName, (int)getpid());
+#else
+    const char *saveFileName = fileName;
+#endif
     // Open the file.  This could quite reasonably fail if the path is wrong.
-    exports.exportFile = fopen(fileName, "wb");
+    exports.exportFile = fopen(saveFileName, "wb");
     if (exports.exportFile == NULL)
     {
         errorMessage = "Cannot open save file";
@@ -420,6 +968,8 @@ void SaveRequest::Perform()
     // not in a lower hierarchy into new permanent segments.
     CopyScan copyScan(newHierarchy);
     copyScan.initialise(false);
+    if (dedupSavedStates)
+        copyScan.EnableDeduplication();
     bool success = true;
     try {
         for (unsigned i = 0; i < gMem.npSpaces; i++)
@@ -433,6 +983,10 @@ void SaveRequest::Perform()
     {
         success = false;
     }
+    copyScan.CopyObjects();
+    if (debugOptions & DEBUG_MEMMGR && dedupSavedStates)
+        Log("Save: %" POLYUFMT " objects (%" POLYUFMT " words) found in the parents\n",
+            copyScan.dedupObjects, copyScan.dedupWords);
 
     // Copy the areas into the export object.  Make sufficient space for
     // the largest possible number of entries.
@@ -510,6 +1064,9 @@ void SaveRequest::Perform()
     {
         errorMessage = "Out of Memory";
         errCode = ENOMEM;
+        ClearDeltaSnapshot();
+        if (saveFileName != fileName)
+            unlink(saveFileName);
         return;
     }
     // Remove any deeper entries from the hierarchy table.
@@ -567,6 +1124,10 @@ void SaveRequest::Perform()
     saveHeader.segmentDescr = ftell(exports.exportFile);
     fwrite(descrs, sizeof(SavedStateSegmentDescr), exports.memTableEntries, exports.exportFile);
 
+    // The page hashes for the checksum table.  These are computed by the task
+    // farm while the data is being written.
+    SegmentHashes *segHashes = (SegmentHashes*)calloc(exports.memTableEntries, sizeof(SegmentHashes));
+
     // Write out the relocations and the data.
     for (unsigned k = 1 /* Not IO area */; k < exports.memTableEntries; k++)
     {
@@ -596,12 +1157,73 @@ void SaveRequest::Perform()
                 p += length;
             }
             descrs[k].relocationCount = exports.relocationCount;
-            // Write out the data.
-            descrs[k].segmentData = ftell(exports.exportFile);
-            fwrite(entry->mtAddr, entry->mtLength, 1, exports.exportFile);
+            // Write out the data.  Skip to an aligned position.  The gap is
+            // left as a hole in the file if the file system supports it.
+            long dataPos = ftell(exports.exportFile);
+            dataPos = (dataPos + SAVEDSTATE_SEGMENT_ALIGNMENT - 1) & ~(long)(SAVEDSTATE_SEGMENT_ALIGNMENT - 1);
+            fseek(exports.exportFile, dataPos, SEEK_SET);
+            descrs[k].segmentData = dataPos;
+            unsigned *deltaPages = 0, deltaPageCount = 0;
+            if (writeDelta && k < permanentEntries &&
+                    WriteDeltaSegment(exports.exportFile, descrs[k].segmentIndex, entry->mtAddr, entry->mtLength,
+                                      &deltaPages, &deltaPageCount))
+            {
+                descrs[k].segmentFlags |= SSF_DELTA;
+                saveHeader.headerVersion = SAVEDSTATEEXTENDEDVERSION;
+            }
+            else if (savedStateCompression != 0 &&
+                    WriteCompressedSegment(exports.exportFile, entry->mtAddr, entry->mtLength))
+            {
+                descrs[k].segmentFlags |= SSF_COMPRESSED;
+                saveHeader.headerVersion = SAVEDSTATEEXTENDEDVERSION;
+            }
+            else
+            {
+                fseek(exports.exportFile, dataPos, SEEK_SET);
+                fwrite(entry->mtAddr, entry->mtLength, 1, exports.exportFile);
+            }
+            if (segHashes != 0 &&
+                ! StartSegmentHashes(&segHashes[k], entry->mtAddr, entry->mtLength,
+                    deltaPages ? SAVEDSTATE_DELTA_PAGE_SIZE : SAVEDSTATE_CHECKSUM_PAGE_SIZE,
+                    deltaPages, deltaPageCount))
+            {
+                free(deltaPages);
+                segHashes[k].pages = 0;
+                segHashes[k].hashCount = 0;
+            }
        }
     }
 
+    // Write the checksum table once the hashes are complete.
+    if (segHashes != 0)
+    {
+        gpTaskFarm->WaitForCompletion();
+        SegmentChecksum *checksums = new SegmentChecksum[exports.memTableEntries];
+        for (unsigned c = 0; c < exports.memTableEntries; c++)
+        {
+            memset(&checksums[c], 0, sizeof(SegmentChecksum));
+            if (segHashes[c].hashCount != 0)
+            {
+                checksums[c].hashes = ftell(exports.exportFile);
+                checksums[c].pageSize = segHashes[c].pageSize;
+                checksums[c].hashCount = segHashes[c].hashCount;
+                fwrite(segHashes[c].hashes, sizeof(uint64_t), segHashes[c].hashCount, exports.exportFile);
+            }
+        }
+        saveHeader.checksumTable = ftell(exports.exportFile);
+        fwrite(checksums, sizeof(SegmentChecksum), exports.memTableEntries, exports.exportFile);
+        saveHeader.fileSignature = FileSignature(segHashes, exports.memTableEntries);
+        delete[](checksums);
+        for (unsigned f = 0; f < exports.memTableEntries; f++)
+        {
+            free(segHashes[f].pages);
+            free(segHashes[f].hashes);
+        }
+        free(segHashes);
+    }
+    if (newHierarchy > 1)
+        saveHeader.parentSignature = hierarchyTable[newHierarchy-2]->signature;
+
     // If this is a child we need to write a string table containing the parent name.
     if (newHierarchy > 1)
     {
@@ -616,11 +1238,32 @@ void SaveRequest::Perform()
     fseek(exports.exportFile, 0, SEEK_SET);
     fwrite(&saveHeader, sizeof(saveHeader), 1, exports.exportFile);
     fwrite(descrs, sizeof(SavedStateSegmentDescr), exports.memTableEntries, exports.exportFile);
+    delete[](descrs);
 
-    // Add an entry to the hierarchy table for this file.
-    (void)AddHierarchyEntry(fileName, saveHeader.timeStamp);
+    if (saveFileName != fileName)
+    {
+        if (fflush(exports.exportFile) != 0 || ferror(exports.exportFile))
+        {
+            errorMessage = "Error while writing save file";
+            errCode = errno;
+            ClearDeltaSnapshot();
+            unlink(saveFileName);
+            return;
+        }
+        if (rename(saveFileName, fileName) != 0)
+        {
+            errorMessage = "Cannot rename save file";
+            errCode = errno;
+            ClearDeltaSnapshot();
+            unlink(saveFileName);
+            return;
+        }
+    }
 
-    delete[](descrs);
+    // Add an entry to the hierarchy table for this file.
+    (void)AddHierarchyEntry(fileName, saveHeader.timeStamp, saveHeader.fileSignature);
+    // A child of this file can now be saved as a delta.
+    TakeDeltaSnapshot(newHierarchy);
 }
 
 Handle SaveState(TaskData *taskData, Handle args)
@@ -652,6 +1295,8 @@ Handle SaveState(TaskData *taskData, Handle args)
  *  Loading saved state files.
  */
 
+class LoadRelocate;
+
 class StateLoader: public MainThreadRequest
 {
 public:
@@ -659,7 +1304,10 @@ public:
         errorResult(0), errNumber(0) { strcpy(fileName, file); }
 
     virtual void Perform(void);
-    bool LoadFile(bool isInitial, time_t requiredStamp);
+    bool LoadFile(bool isInitial, time_t requiredStamp, uintptr_t requiredSignature);
+    bool CheckSegments(LoadRelocate *relocate, FILE *loadFile, const char *thisFile,
+                       off_t checksumTable, const bool *mapped, char **staging, bool needRelocation);
+    bool RelocateSegments(LoadRelocate *relocate, FILE *loadFile, POLYUNSIGNED relocationWords, unsigned explicitGroups);
     const char *errorResult;
     // The fileName here is the last file loaded.  As well as using it
     // to load the name can also be printed out at the end to identify the
@@ -671,14 +1319,17 @@ public:
 // Called by the main thread once all the ML threads have stopped.
 void StateLoader::Perform(void)
 {
-    (void)LoadFile(true, 0);
+    if (LoadFile(true, 0, 0))
+        TakeDeltaSnapshot(hierarchyDepth);
+    else
+        ClearDeltaSnapshot();
 }
 
 // This class is used to relocate addresses in areas that have been loaded.
 class LoadRelocate
 {
 public:
-    LoadRelocate(): descrs(0), nDescrs(0), errorMessage(0) {}
+    LoadRelocate(): descrs(0), nDescrs(0), pageMaps(0), errorMessage(0) {}
     ~LoadRelocate();
 
     void RelocateObject(PolyObject *p);
@@ -686,12 +1337,19 @@ public:
 
     SavedStateSegmentDescr *descrs;
     unsigned nDescrs;
+    DeltaPageMap *pageMaps; // For each descriptor: the pages in a delta segment.
     const char *errorMessage;
 };
 
 LoadRelocate::~LoadRelocate()
 {
     if (descrs) delete[](descrs);
+    if (pageMaps)
+    {
+        for (unsigned i = 0; i < nDescrs; i++)
+            free(pageMaps[i].present);
+        free(pageMaps);
+    }
 }
 
 // Update the addresses in a group of words.
@@ -714,7 +1372,10 @@ void LoadRelocate::RelocateAddressAt(PolyWord *pt)
                 descr->segmentIndex == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(descr->segmentIndex);
             // Error if this doesn't match.
             byte *setAddress = (byte*)space->bottom + ((char*)val.AsAddress() - (char*)descr->originalAddress);
-            *pt = PolyWord::FromCodePtr(setAddress);
+            // Only write if the address has changed.  A page of a mapped segment
+            // is only copied if it is written.
+            if (setAddress != val.AsCodePtr())
+                *pt = PolyWord::FromCodePtr(setAddress);
             break;
         }
     }
@@ -751,8 +1412,300 @@ void LoadRelocate::RelocateObject(PolyObject *p)
     }
 }
 
+// Relocation is done in parallel on the GC task farm threads.  The objects in
+// each segment are split into chunks of about this many words.
+#define RELOCATION_CHUNK_WORDS      (64*1024)
+// Explicit relocations are split into groups of this many entries.
+#define RELOCATION_ENTRIES_PER_TASK 16384
+
+// A chunk of a segment, starting and ending on an object boundary.
+typedef struct {
+    LoadRelocate    *relocate;
+    PolyWord        *start, *end;
+    PolyWord        *base;          // Start of the segment
+    DeltaPageMap    *pageMap;       // Non-zero if only some pages have been overwritten.
+} RelocationChunk;
+
+static void relocateChunk(GCTaskId *, void *arg1, void *)
+{
+    RelocationChunk *chunk = (RelocationChunk *)arg1;
+    DeltaPageMap *pageMap = chunk->pageMap;
+    for (PolyWord *p = chunk->start; p < chunk->end; )
+    {
+        p++;
+        PolyObject *obj = (PolyObject*)p;
+        POLYUNSIGNED length = obj->Length();
+        if (pageMap == 0)
+            chunk->relocate->RelocateObject(obj);
+        else if (! obj->IsByteObject())
+        {
+            // Mutable segments only contain ordinary objects and byte objects.
+            // Relocate the words in the pages that have been read.
+            for (POLYUNSIGNED i = 0; i < length; i++)
+            {
+                size_t page = ((char*)obj->Offset(i) - (char*)chunk->base) / pageMap->pageSize;
+                if (page < pageMap->pageCount && pageMap->present[page])
+                    chunk->relocate->RelocateAddressAt(obj->Offset(i));
+            }
+        }
+        p += length;
+    }
+}
+
+// A group of explicit relocations for a segment.
+typedef struct {
+    MemSpace        *space;
+    RelocationEntry *entries;
+    unsigned        count;
+    const char      *errorMessage;
+} ExplicitRelocations;
+
+// If we get errors just skip the error and continue rather than leave
+// everything in an unstable state.
+static void relocateExplicit(GCTaskId *, void *arg1, void *)
+{
+    ExplicitRelocations *relocs = (ExplicitRelocations *)arg1;
+    MemSpace *space = relocs->space;
+    for (unsigned k = 0; k < relocs->count; k++)
+    {
+        RelocationEntry *reloc = &relocs->entries[k];
+        MemSpace *toSpace =
+            reloc->targetSegment == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(reloc->targetSegment);
+        if (toSpace == NULL)
+        {
+            relocs->errorMessage = "Unknown space reference in relocation";
+            continue;
+        }
+        byte *setAddress = (byte*)space->bottom + reloc->relocAddress;
+        byte *targetAddress = (byte*)toSpace->bottom + reloc->targetAddress;
+        if (setAddress >= (byte*)space->top || targetAddress >= (byte*)toSpace->top)
+        {
+            relocs->errorMessage = "Bad relocation";
+            continue;
+        }
+        ScanAddress::SetConstantValue(setAddress, PolyWord::FromCodePtr(targetAddress), reloc->relKind);
+    }
+}
+
+// Relocate the addresses in the segments of this file.  The objects in each
+// segment are split into chunks on object boundaries and the chunks are
+// relocated by the task farm threads while this thread reads the explicit
+// relocations.  Those are then processed in parallel as well.
+bool StateLoader::RelocateSegments(LoadRelocate *relocate, FILE *loadFile,
+                                   POLYUNSIGNED relocationWords, unsigned explicitGroups)
+{
+    // A chunk ends at the first object boundary after RELOCATION_CHUNK_WORDS so
+    // there is at most one more chunk for each segment than this.
+    size_t maxChunks = relocationWords / RELOCATION_CHUNK_WORDS + relocate->nDescrs;
+    AutoFree<RelocationChunk*> chunks((RelocationChunk*)malloc(maxChunks * sizeof(RelocationChunk)));
+    AutoFree<ExplicitRelocations*>
+        groups((ExplicitRelocations*)calloc(explicitGroups+1, sizeof(ExplicitRelocations)));
+    AutoFree<RelocationEntry**>
+        tables((RelocationEntry**)calloc(relocate->nDescrs, sizeof(RelocationEntry*)));
+    if (chunks == 0 || groups == 0 || tables == 0)
+    {
+        errorResult = "Unable to allocate memory";
+        return false;
+    }
+
+    size_t nChunks = 0;
+    for (unsigned j = 0; j < relocate->nDescrs; j++)
+    {
+        SavedStateSegmentDescr *descr = &relocate->descrs[j];
+        if (descr->segmentData == 0)
+            continue;
+        MemSpace *space =
+            descr->segmentIndex == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(descr->segmentIndex);
+        PolyWord *chunkStart = space->bottom;
+        for (PolyWord *p = space->bottom; p < space->top; )
+        {
+            p += ((PolyObject*)(p+1))->Length() + 1;
+            if (p - chunkStart >= RELOCATION_CHUNK_WORDS || p >= space->top)
+            {
+                RelocationChunk *chunk = &chunks[nChunks++];
+                chunk->relocate = relocate;
+                chunk->start = chunkStart;
+                chunk->end = p;
+                chunk->base = space->bottom;
+                chunk->pageMap =
+                    relocate->pageMaps != 0 && relocate->pageMaps[j].present != 0 ? &relocate->pageMaps[j] : 0;
+                gpTaskFarm->AddWorkOrRunNow(relocateChunk, chunk, 0);
+                chunkStart = p;
+            }
+        }
+    }
+
+    // Read each table of explicit relocations in one go.
+    // If we get errors just skip the error and continue rather than leave
+    // everything in an unstable state.
+    unsigned nGroups = 0;
+    for (unsigned k = 0; k < relocate->nDescrs; k++)
+    {
+        SavedStateSegmentDescr *descr = &relocate->descrs[k];
+        if (descr->relocations == 0 || descr->relocationCount == 0)
+            continue;
+        RelocationEntry *table = (RelocationEntry*)malloc(descr->relocationCount * sizeof(RelocationEntry));
+        if (table == 0)
+        {
+            errorResult = "Unable to allocate memory";
+            continue;
+        }
+        if (fseek(loadFile, descr->relocations, SEEK_SET) != 0 ||
+            fread(table, sizeof(RelocationEntry), descr->relocationCount, loadFile) != descr->relocationCount)
+        {
+            errorResult = "Unable to read relocation segment";
+            free(table);
+            continue;
+        }
+        tables[k] = table;
+        MemSpace *space =
+            descr->segmentIndex == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(descr->segmentIndex);
+        for (unsigned first = 0; first < descr->relocationCount; first += RELOCATION_ENTRIES_PER_TASK)
+        {
+            ExplicitRelocations *group = &groups[nGroups++];
+            group->space = space;
+            group->entries = table + first;
+            group->count = descr->relocationCount - first;
+            if (group->count > RELOCATION_ENTRIES_PER_TASK)
+                group->count = RELOCATION_ENTRIES_PER_TASK;
+        }
+    }
+    // The explicit relocations are mostly within code so wait until the
+    // chunks have been done.
+    gpTaskFarm->WaitForCompletion();
+
+    for (unsigned g = 0; g < nGroups; g++)
+        gpTaskFarm->AddWorkOrRunNow(relocateExplicit, &groups[g], 0);
+    gpTaskFarm->WaitForCompletion();
+
+    for (unsigned h = 0; h < nGroups; h++)
+    {
+        if (groups[h].errorMessage)
+            errorResult = groups[h].errorMessage;
+    }
+    for (unsigned t = 0; t < relocate->nDescrs; t++)
+        free(tables[t]);
+    return true;
+}
+
+// Check the page hashes of the segments that have been loaded from this file.
+// The data for the overwrites is in the staging buffers.  A segment that has
+// been mapped is only checked if it is going to be relocated.  Relocation
+// reads every page anyway whereas a segment that can be used where it is
+// mapped is read from the file only as its pages are used.  The hashes are
+// computed in parallel by the task farm.
+bool StateLoader::CheckSegments(LoadRelocate *relocate, FILE *loadFile, const char *thisFile,
+                                off_t checksumTable, const bool *mapped, char **staging, bool needRelocation)
+{
+    unsigned nDescrs = relocate->nDescrs;
+    AutoFree<SegmentChecksum*> checksums((SegmentChecksum*)malloc(nDescrs * sizeof(SegmentChecksum) + 1));
+    AutoFree<SegmentHashes*> segHashes((SegmentHashes*)calloc(nDescrs + 1, sizeof(SegmentHashes)));
+    AutoFree<uint64_t**> expected((uint64_t**)calloc(nDescrs + 1, sizeof(uint64_t*)));
+    if (checksums == 0 || segHashes == 0 || expected == 0)
+    {
+        errorResult = "Unable to allocate memory";
+        return false;
+    }
+    if (fseek(loadFile, checksumTable, SEEK_SET) != 0 ||
+        fread(checksums, sizeof(SegmentChecksum), nDescrs, loadFile) != nDescrs)
+    {
+        errorResult = "Unable to read checksum table";
+        return false;
+    }
+
+    const char *checkError = 0;
+    unsigned pagesChecked = 0;
+    for (unsigned i = 0; i < nDescrs && checkError == 0; i++)
+    {
+        SavedStateSegmentDescr *descr = &relocate->descrs[i];
+        SegmentChecksum *sum = &checksums[i];
+        if (descr->segmentData == 0 || descr->segmentIndex == 0 || sum->hashCount == 0 ||
+                (mapped[i] && ! needRelocation))
+            continue;
+        if (sum->pageSize == 0 || sum->pageSize % sizeof(PolyWord) != 0)
+        {
+            checkError = "Bad checksum table";
+            break;
+        }
+        AutoFree<unsigned*> pages;
+        unsigned pageCount = 0;
+        if (descr->segmentFlags & SSF_DELTA)
+        {
+            // There is a hash for each page that was present in the delta.
+            DeltaPageMap *pageMap = &relocate->pageMaps[i];
+            if (pageMap->pageSize != sum->pageSize ||
+                (pages = (unsigned*)malloc(sum->hashCount * sizeof(unsigned))) == 0)
+            {
+                checkError = pageMap->pageSize != sum->pageSize ? "Bad checksum table" : "Unable to allocate memory";
+                break;
+            }
+            for (size_t p = 0; p < pageMap->pageCount && pageCount <= sum->hashCount; p++)
+            {
+                if (pageMap->present[p])
+                {
+                    if (pageCount < sum->hashCount) pages[pageCount] = (unsigned)p;
+                    pageCount++;
+                }
+            }
+            if (pageCount != sum->hashCount)
+            {
+                checkError = "Bad checksum table";
+                break;
+            }
+        }
+        else if ((descr->segmentSize + sum->pageSize - 1) / sum->pageSize != sum->hashCount)
+        {
+            checkError = "Bad checksum table";
+            break;
+        }
+        expected[i] = (uint64_t*)malloc(sum->hashCount * sizeof(uint64_t));
+        if (expected[i] == 0)
+        {
+            checkError = "Unable to allocate memory";
+            break;
+        }
+        if (fseek(loadFile, sum->hashes, SEEK_SET) != 0 ||
+            fread(expected[i], sizeof(uint64_t), sum->hashCount, loadFile) != sum->hashCount)
+        {
+            checkError = "Unable to read checksum table";
+            break;
+        }
+        MemSpace *space = gMem.SpaceForIndex(descr->segmentIndex);
+        const void *data = staging[i] != 0 ? (const void*)staging[i] : (const void*)space->bottom;
+        if (! StartSegmentHashes(&segHashes[i], data, descr->segmentSize, sum->pageSize, pages, pageCount))
+        {
+            segHashes[i].pages = 0;
+            segHashes[i].hashCount = 0;
+            checkError = "Unable to allocate memory";
+            break;
+        }
+        pages = 0; // Freed below once the tasks have finished.
+        pagesChecked += sum->hashCount;
+    }
+    // Wait for the tasks even if there has been an error since they use the tables.
+    gpTaskFarm->WaitForCompletion();
+
+    for (unsigned j = 0; j < nDescrs; j++)
+    {
+        if (checkError == 0 && segHashes[j].hashCount != 0 &&
+            memcmp(segHashes[j].hashes, expected[j], segHashes[j].hashCount * sizeof(uint64_t)) != 0)
+        {
+            if (debugOptions & DEBUG_MEMMGR)
+                Log("MMGR: Checksum mismatch in segment %u of %s\n", relocate->descrs[j].segmentIndex, thisFile);
+            checkError = "Saved state file is damaged";
+        }
+        free(segHashes[j].pages);
+        free(segHashes[j].hashes);
+        free(expected[j]);
+    }
+    if (checkError == 0 && (debugOptions & DEBUG_MEMMGR))
+        Log("MMGR: Checked %u pages of %s\n", pagesChecked, thisFile);
+    errorResult = checkError;
+    return checkError == 0;
+}
+
 // Load a saved state file.  Calls itself to handle parent files.
-bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
+bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp, uintptr_t requiredSignature)
 {
     LoadRelocate relocate;
     AutoFree<char*> thisFile(strdup(fileName));
@@ -767,27 +1720,18 @@ bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
 
     SavedStateHeader header;
     // Read the header and check the signature.
-    if (fread(&header, sizeof(SavedStateHeader), 1, loadFile) != 1)
-    {
-        errorResult = "Unable to load header";
-        return false;
-    }
-    if (strncmp(header.headerSignature, SAVEDSTATESIGNATURE, sizeof(header.headerSignature)) != 0)
+    const char *headerError = ReadSavedStateHeader(loadFile, &header);
+    if (headerError != 0)
     {
-        errorResult = "File is not a saved state";
-        return false;
-    }
-    if (header.headerVersion != SAVEDSTATEVERSION ||
-        header.headerLength != sizeof(SavedStateHeader) ||
-        header.segmentDescrLength != sizeof(SavedStateSegmentDescr))
-    {
-        errorResult = "Unsupported version of saved state file";
+        errorResult = headerError;
         return false;
     }
 
     // Check that we have the required stamp before loading any children.
-    // If a parent has been overwritten we could get a loop.
-    if (! isInitial && header.timeStamp != requiredStamp)
+    // If a parent has been overwritten we could get a loop.  The signature
+    // is only present if both files were written with checksums.
+    if (! isInitial && (header.timeStamp != requiredStamp ||
+        (requiredSignature != 0 && header.fileSignature != 0 && header.fileSignature != requiredSignature)))
     {
         // Time-stamps don't match.
         errorResult = "The parent for this saved state does not match or has been changed";
@@ -810,7 +1754,7 @@ bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
         }
         fileName[toRead] = 0; // Should already be null-terminated, but just in case.
 
-        if (! LoadFile(false, header.parentTimeStamp))
+        if (! LoadFile(false, header.parentTimeStamp, header.parentSignature))
             return false;
 
         // Check the parent time stamp.
@@ -852,6 +1796,14 @@ bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
         return false;
     }
 
+    // Record which segments have been mapped rather than read.
+    AutoFree<bool*> mapped((bool*)calloc(relocate.nDescrs+1, sizeof(bool)));
+    if (mapped == 0)
+    {
+        errorResult = "Unable to allocate memory";
+        return false;
+    }
+
     // Read in and create the new segments first.  If we have problems,
     // in particular if we have run out of memory, then it's easier to recover.  
     for (unsigned i = 0; i < relocate.nDescrs; i++)
@@ -876,22 +1828,53 @@ bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
                 errorResult = "Segment already exists";
                 return false;
             }
-            // Allocate memory for the new segment.
+            // Map the segment from the file if we can.  The pages are only read
+            // when they are used.  If we get the address it was saved at and
+            // so do all the other segments we don't need to relocate anything.
+            // Otherwise relocation reads every page but only copies the pages
+            // that contain addresses in a segment that has moved.
+            // Compressed segments have to be read.
             size_t actualSize = descr->segmentSize;
-            PolyWord *mem  =
-                (PolyWord*)osMemoryManager->Allocate(actualSize,
-                                PERMISSION_READ|PERMISSION_WRITE|PERMISSION_EXEC);
+            PolyWord *mem = 0;
+            if ((descr->segmentFlags & SSF_COMPRESSED) == 0)
+                mem = (PolyWord*)osMemoryManager->MapFile(fileno(loadFile), descr->segmentData, actualSize,
+                                descr->originalAddress, PERMISSION_READ|PERMISSION_WRITE|PERMISSION_EXEC);
             if (mem == 0)
             {
-                errorResult = "Unable to allocate memory";
-                return false;
+                // Allocate memory for the new segment and read it in.
+                actualSize = descr->segmentSize;
+                mem = (PolyWord*)osMemoryManager->Allocate(actualSize,
+                                PERMISSION_READ|PERMISSION_WRITE|PERMISSION_EXEC);
+                if (mem == 0)
+                {
+                    errorResult = "Unable to allocate memory";
+                    return false;
+                }
+                if (descr->segmentFlags & SSF_COMPRESSED)
+                {
+                    const char *readError =
+                        ReadCompressedSegment(loadFile, descr->segmentData, mem, descr->segmentSize);
+                    if (readError != 0)
+                    {
+                        errorResult = readError;
+                        osMemoryManager->Free(mem, actualSize);
+                        return false;
+                    }
+                }
+                else if (fseek(loadFile, descr->segmentData, SEEK_SET) != 0 ||
+                    fread(mem, descr->segmentSize, 1, loadFile) != 1)
+                {
+                    errorResult = "Unable to read segment";
+                    osMemoryManager->Free(mem, actualSize);
+                    return false;
+                }
             }
-            if (fseek(loadFile, descr->segmentData, SEEK_SET) != 0 ||
-                fread(mem, descr->segmentSize, 1, loadFile) != 1)
+            else
             {
-                errorResult = "Unable to read segment";
-                osMemoryManager->Free(mem, descr->segmentSize);
-                return false;
+                mapped[i] = true;
+                if (debugOptions & DEBUG_MEMMGR)
+                    Log("MMGR: Mapped segment %u of %s at %p (saved at %p)\n",
+                        descr->segmentIndex, (char*)thisFile, mem, descr->originalAddress);
             }
             // Fill unused space to the top of the area.
             gMem.FillUnusedSpace(mem+descr->segmentSize/sizeof(PolyWord),
@@ -906,75 +1889,145 @@ bool StateLoader::LoadFile(bool isInitial, time_t requiredStamp)
         }
     }
 
-    // Now read in the mutable overwrites and relocate.
+    // If every segment, including those in the parents and the IO area, is
+    // where it was when the file was saved the addresses are all correct.
+    // The IO area is in the executable so it moves on each run if that is
+    // position-independent and the address space is randomised.
+    bool needRelocation = false;
+    for (unsigned r = 0; r < relocate.nDescrs; r++)
+    {
+        SavedStateSegmentDescr *descr = &relocate.descrs[r];
+        MemSpace *space =
+            descr->segmentIndex == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(descr->segmentIndex);
+        if ((void*)space->bottom != descr->originalAddress)
+            needRelocation = true;
+    }
+
+    // Now read in the mutable overwrites.  If the file has checksums these are
+    // read into separate buffers and only copied over the existing data once
+    // they have been checked.  Otherwise a damaged file would overwrite the
+    // data of the running program before we found that it could not be used.
+    AutoFree<char**> staging((char**)calloc(relocate.nDescrs+1, sizeof(char*)));
+    if (staging == 0)
+    {
+        errorResult = "Unable to allocate memory";
+        return false;
+    }
 
-    for (unsigned j = 0; j < relocate.nDescrs; j++)
+    POLYUNSIGNED relocationWords = 0;
+    unsigned explicitGroups = 0;
+    const char *overwriteError = 0;
+    for (unsigned j = 0; j < relocate.nDescrs && overwriteError == 0; j++)
     {
         SavedStateSegmentDescr *descr = &relocate.descrs[j];
         MemSpace *space =
             descr->segmentIndex == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(descr->segmentIndex);
         ASSERT(space != NULL); // We should have created it.
+        if (descr->segmentData != 0)
+            relocationWords += space->top - space->bottom;
+        if (descr->relocations)
+            explicitGroups += (descr->relocationCount + RELOCATION_ENTRIES_PER_TASK - 1) / RELOCATION_ENTRIES_PER_TASK;
         if (descr->segmentFlags & SSF_OVERWRITE)
         {
-            if (fseek(loadFile, descr->segmentData, SEEK_SET) != 0 ||
-                fread(space->bottom, descr->segmentSize, 1, loadFile) != 1)
+            size_t spaceLength = (char*)space->top - (char*)space->bottom;
+            void *target = space->bottom;
+            if (descr->segmentSize > spaceLength)
             {
-                errorResult = "Unable to read segment";
-                return false;
+                overwriteError = "Unable to read segment";
+                break;
             }
+            if (header.checksumTable != 0)
+            {
+                // A delta only replaces some of the pages so the buffer starts
+                // with a copy of the existing data.
+                staging[j] = (char*)malloc(descr->segmentSize + 1);
+                if (staging[j] == 0)
+                {
+                    overwriteError = "Unable to allocate memory";
+                    break;
+                }
+                if (descr->segmentFlags & SSF_DELTA)
+                    memcpy(staging[j], space->bottom, descr->segmentSize);
+                target = staging[j];
+            }
+            if (descr->segmentFlags & SSF_DELTA)
+            {
+                if (relocate.pageMaps == 0 &&
+                    (relocate.pageMaps = (DeltaPageMap*)calloc(relocate.nDescrs, sizeof(DeltaPageMap))) == 0)
+                    overwriteError = "Unable to allocate memory";
+                else
+                    overwriteError =
+                        ReadDeltaSegment(loadFile, descr->segmentData, target, descr->segmentSize,
+                            spaceLength, &relocate.pageMaps[j]);
+            }
+            else if (descr->segmentFlags & SSF_COMPRESSED)
+                overwriteError =
+                    ReadCompressedSegment(loadFile, descr->segmentData, target, descr->segmentSize);
+            else if (fseek(loadFile, descr->segmentData, SEEK_SET) != 0 ||
+                fread(target, descr->segmentSize, 1, loadFile) != 1)
+                overwriteError = "Unable to read segment";
         }
+    }
 
-        // Relocation.
-        if (descr->segmentData != 0)
+    if (overwriteError == 0 && header.checksumTable != 0 &&
+            ! CheckSegments(&relocate, loadFile, thisFile, header.checksumTable, mapped, staging, needRelocation))
+        overwriteError = errorResult;
+
+    for (unsigned s = 0; s < relocate.nDescrs; s++)
+    {
+        if (staging[s] != 0)
         {
-            // Adjust the addresses in the loaded segment.
-            for (PolyWord *p = space->bottom; p < space->top; )
+            if (overwriteError == 0)
             {
-                p++;
-                PolyObject *obj = (PolyObject*)p;
-                POLYUNSIGNED length = obj->Length();
-                relocate.RelocateObject(obj);
-                p += length;
+                SavedStateSegmentDescr *descr = &relocate.descrs[s];
+                MemSpace *space = gMem.SpaceForIndex(descr->segmentIndex);
+                memcpy(space->bottom, staging[s], descr->segmentSize);
             }
+            free(staging[s]);
         }
+    }
+    if (overwriteError != 0)
+    {
+        errorResult = overwriteError;
+        return false;
+    }
 
-        // Process explicit relocations.
-        // If we get errors just skip the error and continue rather than leave
-        // everything in an unstable state.
-        if (descr->relocations)
+    if (needRelocation && ! RelocateSegments(&relocate, loadFile, relocationWords, explicitGroups))
+        return false;
+
+    // Remove write access from the new immutable segments.  Pages that have not
+    // been relocated are then never copied and are shared through the page cache
+    // with any other process that has mapped the same file.  Mutable segments,
+    // including the byte segments, are copied when they are written.
+    for (unsigned m = 0; m < relocate.nDescrs; m++)
+    {
+        SavedStateSegmentDescr *descr = &relocate.descrs[m];
+        if (descr->segmentIndex != 0 && descr->segmentData != 0 &&
+            (descr->segmentFlags & (SSF_WRITABLE|SSF_OVERWRITE)) == 0)
         {
-            if (fseek(loadFile, descr->relocations, SEEK_SET) != 0)
-            {
-                errorResult = "Unable to read relocation segment";
-            }
-            for (unsigned k = 0; k < descr->relocationCount; k++)
+            PermanentMemSpace *space = gMem.SpaceForIndex(descr->segmentIndex);
+            if (osMemoryManager->SetPermissions(space->bottom, (char*)space->top - (char*)space->bottom,
+                    PERMISSION_READ|PERMISSION_EXEC))
+                space->isReadOnly = true;
+        }
+    }
+
+    // Name the code in the new areas.
+    if (perfMapEnabled)
+    {
+        for (unsigned k = 0; k < relocate.nDescrs; k++)
+        {
+            SavedStateSegmentDescr *descr = &relocate.descrs[k];
+            if (descr->segmentIndex != 0 && descr->segmentData != 0 && (descr->segmentFlags & SSF_BYTES) == 0)
             {
-                RelocationEntry reloc;
-                if (fread(&reloc, sizeof(reloc), 1, loadFile) != 1)
-                {
-                    errorResult = "Unable to read relocation segment";
-                }
-                MemSpace *toSpace =
-                    reloc.targetSegment == 0 ? gMem.IoSpace() : gMem.SpaceForIndex(reloc.targetSegment);
-                if (toSpace == NULL)
-                {
-                    errorResult = "Unknown space reference in relocation";
-                    continue;
-                }
-                byte *setAddress = (byte*)space->bottom + reloc.relocAddress;
-                byte *targetAddress = (byte*)toSpace->bottom + reloc.targetAddress;
-                if (setAddress >= (byte*)space->top || targetAddress >= (byte*)toSpace->top)
-                {
-                    errorResult = "Bad relocation";
-                    continue;
-                }
-                ScanAddress::SetConstantValue(setAddress, PolyWord::FromCodePtr(targetAddress), reloc.relKind);
+                MemSpace *space = gMem.SpaceForIndex(descr->segmentIndex);
+                PerfMapAddArea(space->bottom, space->top);
             }
         }
     }
 
     // Add an entry to the hierarchy table for this file.
-    if (! AddHierarchyEntry(thisFile, header.timeStamp))
+    if (! AddHierarchyEntry(thisFile, header.timeStamp, header.fileSignature))
         return false;
 
     return true; // Succeeded
@@ -1064,18 +2117,9 @@ Handle RenameParent(TaskData *taskData, Handle args)
 
     SavedStateHeader header;
     // Read the header and check the signature.
-    if (fread(&header, sizeof(SavedStateHeader), 1, loadFile) != 1)
-        raise_fail(taskData, "Unable to load header");
-
-    if (strncmp(header.headerSignature, SAVEDSTATESIGNATURE, sizeof(header.headerSignature)) != 0)
-        raise_fail(taskData, "File is not a saved state");
-
-    if (header.headerVersion != SAVEDSTATEVERSION ||
-        header.headerLength != sizeof(SavedStateHeader) ||
-        header.segmentDescrLength != sizeof(SavedStateSegmentDescr))
-    {
-        raise_fail(taskData, "Unsupported version of saved state file");
-    }
+    const char *headerError = ReadSavedStateHeader(loadFile, &header);
+    if (headerError != 0)
+        raise_fail(taskData, headerError);
 
     // Does this actually have a parent?
     if (header.parentNameEntry == 0)
@@ -1092,9 +2136,10 @@ Handle RenameParent(TaskData *taskData, Handle args)
     fputc(0, loadFile); // A terminating null.
     header.stringTableSize = strlen(parentNameBuff) + 2;
 
-    // Now rewind and write the header with the revised string table.
+    // Now rewind and write the header with the revised string table.  This
+    // may be the shorter header of an older file.
     fseek(loadFile, 0, SEEK_SET);
-    fwrite(&header, sizeof(header), 1, loadFile);
+    fwrite(&header, header.headerLength, 1, loadFile);
 
     return SAVE(TAGGED(0));
 }
@@ -1119,18 +2164,9 @@ Handle ShowParent(TaskData *taskData, Handle hFileName)
 
     SavedStateHeader header;
     // Read the header and check the signature.
-    if (fread(&header, sizeof(SavedStateHeader), 1, loadFile) != 1)
-        raise_fail(taskData, "Unable to load header");
-
-    if (strncmp(header.headerSignature, SAVEDSTATESIGNATURE, sizeof(header.headerSignature)) != 0)
-        raise_fail(taskData, "File is not a saved state");
-
-    if (header.headerVersion != SAVEDSTATEVERSION ||
-        header.headerLength != sizeof(SavedStateHeader) ||
-        header.segmentDescrLength != sizeof(SavedStateSegmentDescr))
-    {
-        raise_fail(taskData, "Unsupported version of saved state file");
-    }
+    const char *headerError = ReadSavedStateHeader(loadFile, &header);
+    if (headerError != 0)
+        raise_fail(taskData, headerError);
 
     // Does this have a parent?
     if (header.parentNameEntry != 0)
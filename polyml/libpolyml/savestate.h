@@ -41,5 +41,15 @@ Handle RenameParent(TaskData *taskData, Handle args);
 // Return the name of the immediate parent stored in a child
 Handle ShowParent(TaskData *taskData, Handle hFileName);
 
+// The compression level (1-9) used when writing saved states.  Zero means
+// that they are not compressed.
+extern unsigned savedStateCompression;
+
+// Write only the changed pages of the mutable data in the parents of a child.
+extern bool deltaSavedStates;
+
+// Replace code and immutable byte objects by identical objects in the parents.
+extern bool dedupSavedStates;
+
 #endif
 
@@ -78,11 +78,10 @@ The basic algorithm works like this:
 2. Vectors are created containing objects of the same depth, from 1 to the
    maximum depth found.
 3. We begin a loop starting at depth 1.
-4. The objects are sorted by their contents so bringing together objects
-   with the same contents.  The contents are considered simply as
-   uninterpreted bits.
-5. The sorted vector is processed to find those objects that are actually
-   bitwise equal.  One object is selected to be retained and its length
+4. The contents of each object are hashed.  The contents are considered
+   simply as uninterpreted bits.
+5. The objects are entered into a hash table to find those objects that are
+   actually bitwise equal.  One object is selected to be retained and its length
    word is restored to be a normal length (phase 1 had set it to be a depth).
    The other objects have their length words turned into tombstones pointing
    at the retained object.
@@ -110,14 +109,41 @@ This has been substantially updated while retaining the basic algorithm.
 Sorting is now done in parallel by the GC task farm and the stack is
 now in dynamic memory.  That avoids a possible segfault if the normal
 C stack overflows.
+
+The sort has since been replaced by hashing.  The vector for each depth is
+split by the hash value into partitions and each partition is merged using
+its own hash table by the GC task farm.  Only objects with the same hash are
+compared so the cost is linear rather than O(n log n) in the number of objects.
 */
 
 typedef struct
 {
     POLYUNSIGNED    L;
-    PolyObject *pt;
+    PolyObject      *pt;
+    POLYUNSIGNED    hash; // Hash of the contents.  Later the index of its hash table entry.
 } Item;
 
+// Each depth vector is divided into partitions by the hash value.  Each partition
+// is processed by a separate task with its own hash table.
+typedef struct
+{
+    Item            *first;
+    POLYUNSIGNED    nitems;
+    POLYUNSIGNED    shared; // Result: the number of items that were merged.
+} ItemPartition;
+
+// Entry in the hash table of a partition.  The item is the one that will be
+// retained from those with the same contents.
+typedef struct
+{
+    POLYUNSIGNED    hash;
+    Item            *item;
+} HashEntry;
+
+#define SHARE_ITEMS_PER_TASK        4096    // Number of items hashed by a single task
+#define SHARE_PARTITIONS_PER_THREAD 8       // Partitions for each GC thread
+#define SHARE_MIN_PARTITION         1024    // Don't partition vectors smaller than this
+
 // The DepthVector type contains all the items of a particular depth.
 class DepthVector {
 public:
@@ -128,17 +154,15 @@ public:
     POLYUNSIGNED    vsize;
     Item            *vector;
 
-    void Sort(void);
 private:
-    static void SortRange(Item *first, Item *last);
-
-    static int CompareItems(const Item *a, const Item *b);
-
-    static int qsCompare(const void *a, const void *b)
-        { return CompareItems((const Item*)a, (const Item*)b); }
-
-    static void sortTask(GCTaskId*, void *s, void *l)
-        { SortRange((Item*)s, (Item*)l); }
+    static POLYUNSIGNED HashObject(PolyObject *obj, POLYUNSIGNED L);
+    static bool SameItems(const Item *a, const Item *b);
+    static bool BetterShare(MemSpace *bestSpace, MemSpace *space);
+    static POLYUNSIGNED MergePartition(Item *first, POLYUNSIGNED nitems);
+
+    static void hashTask(GCTaskId*, void *s, void *e);
+    static void mergeTask(GCTaskId*, void *p, void *)
+        { ItemPartition *part = (ItemPartition *)p; part->shared = MergePartition(part->first, part->nitems); }
 };
 
 class ShareData {
@@ -207,216 +231,237 @@ void ShareData::AddToVector(POLYUNSIGNED depth, POLYUNSIGNED L, PolyObject *pt)
 
     v->vector[v->nitems].L  = L;
     v->vector[v->nitems].pt = pt;
+    v->vector[v->nitems].hash = 0;
 
     v->nitems++;
 
     ASSERT (v->nitems <= v->vsize);
 }
 
-// Comparison function used for sorting and also to test whether
-// two cells can be merged.
-int DepthVector::CompareItems(const Item *a, const Item *b)
+// Hash the length word and the contents of an object.  The contents are
+// considered simply as uninterpreted words.  Four independent values are
+// combined so that the loop does not depend on the result of the previous
+// multiplication and the compiler can vectorise it.
+POLYUNSIGNED DepthVector::HashObject(PolyObject *obj, POLYUNSIGNED L)
 {
-    PolyObject *x = a->pt;
-    PolyObject *y = b->pt;
-//    POLYUNSIGNED  A = x->LengthWord();
-//    POLYUNSIGNED  B = y->LengthWord();
-
-//    ASSERT (OBJ_IS_DEPTH(A));
-//    ASSERT (OBJ_IS_DEPTH(B));
-//    ASSERT (A == B); // Should be the same depth.
+    const POLYUNSIGNED mult = (POLYUNSIGNED)0x9E3779B97F4A7C15ULL;
+    const POLYUNSIGNED *p = (const POLYUNSIGNED *)obj;
+    POLYUNSIGNED length = OBJ_OBJECT_LENGTH(L);
+    POLYUNSIGNED h0 = L, h1 = length, h2 = 0, h3 = 0;
+    POLYUNSIGNED i = 0;
+    for (; i+4 <= length; i += 4)
+    {
+        h0 = (h0 ^ p[i]) * mult;
+        h1 = (h1 ^ p[i+1]) * mult;
+        h2 = (h2 ^ p[i+2]) * mult;
+        h3 = (h3 ^ p[i+3]) * mult;
+    }
+    for (; i < length; i++)
+        h0 = (h0 ^ p[i]) * mult;
+    POLYUNSIGNED h = h0 ^ (h1 * 3) ^ (h2 * 5) ^ (h3 * 7);
+    // Mix the high-order bits down since the low-order bits select the table entry.
+    h ^= h >> (sizeof(POLYUNSIGNED)*4);
+    return h * mult;
+}
 
-//    ASSERT (OBJ_IS_LENGTH(a->L));
-//    ASSERT (OBJ_IS_LENGTH(b->L));
+void DepthVector::hashTask(GCTaskId*, void *s, void *e)
+{
+    for (Item *item = (Item*)s; item < (Item*)e; item++)
+        item->hash = HashObject(item->pt, item->L);
+}
 
-    if (a->L > b->L) return  1; // These tests include the flag bits
-    if (a->L < b->L) return -1;
+// Test whether two cells can be merged.
+bool DepthVector::SameItems(const Item *a, const Item *b)
+{
+    if (a->L != b->L) return false; // This test includes the flag bits
 
     // Return simple bitwise equality.
-    return memcmp(x, y, OBJ_OBJECT_LENGTH(a->L)*sizeof(PolyWord));
+    return memcmp(a->pt, b->pt, OBJ_OBJECT_LENGTH(a->L)*sizeof(PolyWord)) == 0;
 }
 
-// Merge cells with the same contents.
-POLYUNSIGNED DepthVector::MergeSameItems()
+// The order of sharing is significant.
+// Choose an object in the permanent memory if that is available.
+// This is necessary to retain the invariant that no object in
+// the permanent memory points to an object in the temporary heap.
+// (There may well be pointers to this object elsewhere in the permanent
+// heap).
+// Choose the lowest hierarchy value for preference since that
+// may reduce the size of saved state when resaving already saved
+// data.
+// If we can't find a permanent space choose a space that isn't
+// an allocation space.  Otherwise we could break the invariant
+// that immutable areas never point into the allocation area.
+bool DepthVector::BetterShare(MemSpace *bestSpace, MemSpace *space)
 {
-    DepthVector *v = this;
-
-    POLYUNSIGNED  N = v->nitems;
-    Item *itemVec = v->vector;
-    POLYUNSIGNED  n = 0;
-    POLYUNSIGNED  i = 0;
+    if (bestSpace->spaceType == ST_PERMANENT)
+        // Only update if the current space is also permanent and a lower hierarchy
+        return space->spaceType == ST_PERMANENT &&
+            ((PermanentMemSpace *)space)->hierarchy < ((PermanentMemSpace *)bestSpace)->hierarchy;
+    else if (bestSpace->spaceType == ST_LOCAL)
+        // Update if the current space is not an allocation space
+        return space->spaceType != ST_LOCAL || ! ((LocalMemSpace*)space)->allocationSpace;
+    return false;
+}
 
-    while (i < N)
+// Merge the cells with the same contents within a partition.  Each item is
+// entered into an open-addressed hash table.  Only items with the same hash
+// are compared.  When the table has been built every item points at its entry
+// and the entry holds the item to retain.
+POLYUNSIGNED DepthVector::MergePartition(Item *first, POLYUNSIGNED nitems)
+{
+    POLYUNSIGNED tableSize = 16;
+    while (tableSize < nitems + nitems / 2)
+        tableSize *= 2;
+    HashEntry *table = (HashEntry *)calloc(tableSize, sizeof(HashEntry));
+    if (table == 0)
     {
-        PolyObject *bestShare = 0; // Candidate to share.
-        MemSpace *bestSpace = 0;
+        // If we can't allocate the table just leave these items unshared.
+        for (POLYUNSIGNED i = 0; i < nitems; i++)
+            first[i].pt->SetLengthWord(first[i].L);
+        return 0;
+    }
 
-        POLYUNSIGNED j;
-        for (j = i; j < N; j++)
+    for (POLYUNSIGNED i = 0; i < nitems; i++)
+    {
+        Item *item = &first[i];
+        ASSERT (OBJ_IS_DEPTH(item->pt->LengthWord()));
+        POLYUNSIGNED slot = item->hash & (tableSize-1);
+        for (;;)
         {
-            ASSERT (OBJ_IS_DEPTH(itemVec[i].pt->LengthWord()));
-            // Search for identical objects.  Don't bother to compare it with itself.
-            if (i != j && CompareItems (& itemVec[i], & itemVec[j]) != 0) break;
-            // The order of sharing is significant.
-            // Choose an object in the permanent memory if that is available.
-            // This is necessary to retain the invariant that no object in
-            // the permanent memory points to an object in the temporary heap.
-            // (There may well be pointers to this object elsewhere in the permanent
-            // heap).
-            // Choose the lowest hierarchy value for preference since that
-            // may reduce the size of saved state when resaving already saved
-            // data.
-            // If we can't find a permanent space choose a space that isn't
-            // an allocation space.  Otherwise we could break the invariant
-            // that immutable areas never point into the allocation area.
-            MemSpace *space = gMem.SpaceForAddress(itemVec[j].pt);
-            if (bestSpace == 0)
-            {
-                bestShare = itemVec[j].pt;
-                bestSpace = space;
-            }
-            else if (bestSpace->spaceType == ST_PERMANENT)
+            HashEntry *entry = &table[slot];
+            if (entry->item == 0)
             {
-                // Only update if the current space is also permanent and a lower hierarchy
-                if (space->spaceType == ST_PERMANENT &&
-                        ((PermanentMemSpace *)space)->hierarchy < ((PermanentMemSpace *)bestSpace)->hierarchy)
-                {
-                    bestShare = itemVec[j].pt;
-                    bestSpace = space;
-                }
+                // New contents.
+                entry->hash = item->hash;
+                entry->item = item;
+                break;
             }
-            else if (bestSpace->spaceType == ST_LOCAL)
+            if (entry->hash == item->hash && SameItems(entry->item, item))
             {
-                // Update if the current space is not an allocation space
-                if (space->spaceType != ST_LOCAL || ! ((LocalMemSpace*)space)->allocationSpace)
-                {
-                    bestShare = itemVec[j].pt;
-                    bestSpace = space;
-                }
+                if (BetterShare(gMem.SpaceForAddress(entry->item->pt), gMem.SpaceForAddress(item->pt)))
+                    entry->item = item;
+                break;
             }
+            slot = (slot + 1) & (tableSize-1);
+        }
+        item->hash = slot;
+    }
+
+    // For each identical object set all but the one we want to point to
+    // the shared object.
+    POLYUNSIGNED n = 0;
+    for (POLYUNSIGNED j = 0; j < nitems; j++)
+    {
+        Item *item = &first[j];
+        PolyObject *bestShare = table[item->hash].item->pt;
+        if (item->pt == bestShare)
+        {
+            // This is the common object.
+            bestShare->SetLengthWord(item->L); // restore genuine length word
+            ASSERT (OBJ_IS_LENGTH(bestShare->LengthWord()));
         }
-        POLYUNSIGNED k = j; // Remember the first object that didn't match.
-        //.For each identical object set all but the one we want to point to
-        // the shared object.
-        for (j = i; j < k; j++)
+        else
         {
-            ASSERT (OBJ_IS_DEPTH(itemVec[j].pt->LengthWord()));
-            if (itemVec[j].pt == bestShare)
-            {
-                // This is the common object.
-                bestShare->SetLengthWord(itemVec[j].L); // restore genuine length word
-                ASSERT (OBJ_IS_LENGTH(bestShare->LengthWord()));
-            }
-            else
-            {
-                itemVec[j].pt->SetForwardingPtr(bestShare); /* an indirection */
-                ASSERT (itemVec[j].pt->ContainsForwardingPtr());
-                n++;
-            }
+            item->pt->SetForwardingPtr(bestShare); /* an indirection */
+            ASSERT (item->pt->ContainsForwardingPtr());
+            n++;
         }
-        ASSERT(! OBJ_IS_DEPTH(itemVec[i].pt->LengthWord()));
-        i = k;
     }
 
+    free(table);
     return n;
 }
 
-// Sort this vector
-void DepthVector::Sort()
+// Merge cells with the same contents.  The items are hashed in parallel and then
+// distributed into partitions using the high-order bits of the hash so that
+// identical items are always in the same partition.  The partitions are then
+// processed in parallel.
+POLYUNSIGNED DepthVector::MergeSameItems()
 {
-    SortRange(vector, vector+(nitems-1));
-    gpTaskFarm->WaitForCompletion();
+    if (nitems == 0) return 0;
 
-    // Check
-//    for (POLYUNSIGNED i = 0; i < nitems-1; i++)
-//       ASSERT(CompareItems(vector+i, vector+i+1) <= 0);
-}
+    // Long lists produce many levels with only a few items.  Process those
+    // directly rather than handing them to the task farm.
+    if (nitems < SHARE_MIN_PARTITION)
+    {
+        hashTask(0, vector, vector+nitems);
+        return MergePartition(vector, nitems);
+    }
 
-inline void swapItems(Item *i, Item *j)
-{
-    Item t = *i;
-    *i = *j;
-    *j = t;
-}
+    for (POLYUNSIGNED i = 0; i < nitems; i += SHARE_ITEMS_PER_TASK)
+    {
+        POLYUNSIGNED e = i + SHARE_ITEMS_PER_TASK;
+        if (e > nitems) e = nitems;
+        gpTaskFarm->AddWorkOrRunNow(hashTask, vector+i, vector+e);
+    }
+    gpTaskFarm->WaitForCompletion();
 
-// Simple parallel quick-sort.  "first" and "last" are the first
-// and last items (inclusive) in the vector.
-void DepthVector::SortRange(Item *first, Item *last)
-{
-    while (first < last)
+    unsigned nParts = 1, partShift = sizeof(POLYUNSIGNED)*8;
+    Item *partitioned = 0;
+    if (gpTaskFarm->ThreadCount() > 1)
     {
-        if (last-first <= 100)
+        while (nParts < gpTaskFarm->ThreadCount() * SHARE_PARTITIONS_PER_THREAD)
         {
-            // Use the standard library function for small ranges.
-            qsort(first, last-first+1, sizeof(Item), qsCompare);
-            return;
+            nParts *= 2;
+            partShift--;
         }
-        // Select the best pivot from the first, last and middle item
-        // by sorting these three items.  We use the middle item as
-        // the pivot and since the first and last items are sorted
-        // by this we can skip them when we start the partitioning.
-        Item *middle = first + (last-first)/2;
-        if (CompareItems(first, middle) > 0)
-            swapItems(first, middle);
-        if (CompareItems(middle, last) > 0)
+        // If we can't allocate a new vector we just use a single partition.
+        partitioned = (Item *)malloc(nitems * sizeof(Item));
+        if (partitioned == 0)
         {
-            swapItems(middle, last);
-            if (CompareItems(first, middle) > 0)
-                swapItems(first, middle);
+            nParts = 1;
+            partShift = sizeof(POLYUNSIGNED)*8;
         }
+    }
 
-        // Partition the data about the pivot.  This divides the
-        // vector into two partitions with all items <= pivot to
-        // the left and all items >= pivot to the right.
-        // Note: items equal to the pivot could be in either partition.
-        Item *f = first+1;
-        Item *l = last-1;
-
-        do {
-            // Find an item we have to move.  These loops will always
-            // terminate because testing the middle with itself
-            // will return == 0.
-            while (CompareItems(f, middle/* pivot*/) < 0)
-                f++;
-            while (CompareItems(middle/* pivot*/, l) < 0)
-                l--;
-            // If we haven't finished we need to swap the items.
-            if (f < l)
-            {
-                swapItems(f, l);
-                // If one of these was the pivot item it will have moved to
-                // the other position.
-                if (middle == f)
-                    middle = l;
-                else if (middle == l)
-                    middle = f;
-                f++;
-                l--;
-            }
-            else if (f == l)
-            {
-                f++;
-                l--;
-                break;
-            }
-        } while (f <= l);
+    ItemPartition *parts = (ItemPartition *)calloc(nParts, sizeof(ItemPartition));
+    if (parts == 0)
+    {
+        free(partitioned);
+        ItemPartition single = { vector, nitems, 0 };
+        mergeTask(0, &single, 0);
+        return single.shared;
+    }
 
-        // Process the larger partition as a separate task or
-        // by recursion and do the smaller partition by tail
-        // recursion.
-        if (l-first > last-f)
+    if (nParts == 1)
+    {
+        parts[0].first = vector;
+        parts[0].nitems = nitems;
+    }
+    else
+    {
+        // Count the items in each partition and then copy them into place.
+        for (POLYUNSIGNED i = 0; i < nitems; i++)
+            parts[vector[i].hash >> partShift].nitems++;
+        Item *next = partitioned;
+        for (unsigned p = 0; p < nParts; p++)
         {
-            // Lower part is larger
-            gpTaskFarm->AddWorkOrRunNow(sortTask, first, l);
-            first = f;
+            parts[p].first = next;
+            next += parts[p].nitems;
+            parts[p].nitems = 0;
         }
-        else
+        for (POLYUNSIGNED j = 0; j < nitems; j++)
         {
-            // Upper part is larger
-            gpTaskFarm->AddWorkOrRunNow(sortTask, f, last);
-            last = l;
+            ItemPartition *part = &parts[vector[j].hash >> partShift];
+            part->first[part->nitems++] = vector[j];
         }
+        free(vector);
+        vector = partitioned;
+        vsize = nitems;
     }
+
+    for (unsigned p = 0; p < nParts; p++)
+    {
+        if (parts[p].nitems != 0)
+            gpTaskFarm->AddWorkOrRunNow(mergeTask, &parts[p], 0);
+    }
+    gpTaskFarm->WaitForCompletion();
+
+    POLYUNSIGNED n = 0;
+    for (unsigned q = 0; q < nParts; q++)
+        n += parts[q].shared;
+    free(parts);
+    return n;
 }
 
 class ProcessFixupAddress: public ScanAddress
@@ -550,10 +595,11 @@ POLYUNSIGNED ProcessAddToVector::AddObjectsToDepthVectors(PolyWord old)
     }
 
     if (space->spaceType == ST_PERMANENT &&
-             ((PermanentMemSpace*)space)->hierarchy == 0)
+             (((PermanentMemSpace*)space)->hierarchy == 0 || ((PermanentMemSpace*)space)->isReadOnly))
     {
         // Immutable data in the permanent area can't be merged
-        // because it's read only.  We need to follow the addresses
+        // because it's read only.  That includes immutable data
+        // mapped from a saved state.  We need to follow the addresses
         // because they may point to mutable areas containing data
         // that can be.  A typical case is the root function pointing
         // at the global name table containing new declarations.
@@ -740,7 +786,7 @@ bool ShareData::RunShareData(PolyObject *root)
     for (unsigned j = 0; j < gMem.npSpaces; j++)
     {
         PermanentMemSpace *space = gMem.pSpaces[j];
-        if (!space->isMutable && space->hierarchy == 0)
+        if (!space->isMutable && (space->hierarchy == 0 || space->isReadOnly))
         {
             if (! space->shareBitmap.Create(space->spaceSize()))
                 return false;
@@ -773,7 +819,6 @@ bool ShareData::RunShareData(PolyObject *root)
     {
         DepthVector *vec = &depthVectors[depth];
         fixup.FixupItems(vec);
-        vec->Sort();
 
         POLYUNSIGNED n = vec->MergeSameItems();
 
@@ -101,6 +101,7 @@ int sigaltstack(const stack_t *, stack_t *);
 #include "sys.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "gc.h" // For convertedWeak
 #include "scanaddrs.h"
 #include "locking.h"
@@ -127,7 +128,7 @@ unsigned receivedSignalCount = 0; // Incremented each time we get a signal
 
 // sigLock protects access to the signalCount values in sigData but
 // not the "handler" field.
-static PLock sigLock;
+static PLock sigLock("Signal");
 
 #ifdef USE_PTHREAD_SIGNALS
 static PSemaphore *waitSema;
@@ -192,6 +193,8 @@ public:
     int signl, state;
 };
 
+static void startDetectionThread(void);
+
 // Called whenever a signal is received.
 static void handle_signal(SIG_HANDLER_ARGS(s, c))
 {
@@ -219,6 +222,7 @@ void SignalRequest::Perform()
         sigaction(signl, &action, 0);
         break;
     case HANDLE_SIG:
+        startDetectionThread();
         setSignalHandler(signl, handle_signal);
         break;
     }
@@ -235,6 +239,7 @@ void SignalRequest::Perform()
 Handle Sig_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 0: /* Set up signal handler. */
@@ -520,8 +525,18 @@ void SigHandler::Init(void)
     // Initialise the "wait" semaphore so that it blocks immediately.
     if (! waitSemaphore.Init(0, NSIG)) return;
     waitSema = &waitSemaphore;
-    // Create a new thread to handle signals synchronously.
-    // for it to finish.
+    // The detection thread is not created until a handler is installed.
+#endif
+}
+
+#ifdef USE_PTHREAD_SIGNALS
+// Create a new thread to handle signals synchronously.  This is only
+// needed once ML code has installed a handler so we delay creating it
+// until then.  Called by the main thread.
+static void startDetectionThread(void)
+{
+    if (sighandlerModule.threadRunning || waitSema == 0)
+        return;
     pthread_attr_t attrs;
     pthread_attr_init(&attrs);
 #ifdef PTHREAD_STACK_MIN
@@ -531,16 +546,18 @@ void SigHandler::Init(void)
     pthread_attr_setstacksize(&attrs, PTHREAD_STACK_MIN); // Only small stack.
 #endif
 #endif
-    threadRunning = pthread_create(&detectionThreadId, &attrs, SignalDetectionThread, 0) == 0;
+    sighandlerModule.threadRunning =
+        pthread_create(&sighandlerModule.detectionThreadId, &attrs, SignalDetectionThread, 0) == 0;
     pthread_attr_destroy(&attrs);
-#endif
 }
+#endif
 
 // Wait for the signal thread to finish before the semaphore is deleted in the
 // final clean-up.  Failing to do this causes a hang in Mac OS X.
 void SigHandler::Stop(void)
 {
 #ifdef USE_PTHREAD_SIGNALS
+    if (! threadRunning) return;
     terminate = true;
     waitSema->Signal();
     pthread_join(detectionThreadId, NULL);
@@ -0,0 +1,384 @@
+/*
+    Title:  statserver.cpp - Serve the statistics in text exposition format
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+This runs a separate thread, not an ML thread, that accepts connections on
+a local socket and replies to each request with the current statistics in
+the Prometheus text exposition format.  It reads the same data as is
+written to the shared memory so it needs no co-operation from the ML code.
+The reply is a minimal HTTP response so it can be scraped directly or,
+for a Unix domain socket, with e.g. curl --unix-socket.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_WIN32)
+#include "winconfig.h"
+#else
+#error "No configuration file"
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#ifdef HAVE_WINDOWS_H
+#include <windows.h>
+#endif
+
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+#ifdef USEWINSOCK2
+#include <winsock2.h>
+#else
+#include <winsock.h>
+#endif
+#endif
+
+#if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
+#include <pthread.h>
+#endif
+
+#include "globals.h"
+#include "statserver.h"
+#include "statistics.h"
+#include "rts_module.h"
+#include "diagnostics.h"
+
+#if (defined(_WIN32) && ! defined(__CYGWIN__))
+typedef SOCKET statSocket;
+#define closeSocket(s) closesocket(s)
+#define BAD_SOCKET INVALID_SOCKET
+#else
+typedef int statSocket;
+#define closeSocket(s) close(s)
+#define BAD_SOCKET (-1)
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define STATS_REPLY_SIZE    8192
+
+class StatsServer: public RtsModule
+{
+public:
+    StatsServer(): address(0), listenSocket(BAD_SOCKET), terminate(false), running(false) {}
+    virtual void Start(void);
+    virtual void Stop(void);
+
+    void ServerLoop(void);
+    void ReplyToClient(statSocket client);
+
+    const char *address;
+    statSocket listenSocket;
+    bool terminate, running;
+#if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
+    pthread_t threadId;
+#elif defined(HAVE_WINDOWS_H)
+    HANDLE threadHandle;
+#endif
+};
+
+// Declare this.  It will be automatically added to the table.
+static StatsServer statsServerModule;
+
+void SetStatsServerAddress(const char *address)
+{
+    statsServerModule.address = address;
+}
+
+// Add the description of a metric.
+static char *AddMetric(char *p, const char *name, const char *type, const char *help)
+{
+    return p + sprintf(p, "# HELP polyml_%s %s\n# TYPE polyml_%s %s\n", name, help, name, type);
+}
+
+static char *AddValue(char *p, const char *name, const char *labels, unsigned long long value)
+{
+    return p + sprintf(p, "polyml_%s%s %llu\n", name, labels, value);
+}
+
+#if defined(HAVE_WINDOWS_H)
+static char *AddTime(char *p, const char *labels, const FILETIME &ft)
+{
+    ULARGE_INTEGER li;
+    li.LowPart = ft.dwLowDateTime;
+    li.HighPart = ft.dwHighDateTime;
+    return p + sprintf(p, "polyml_cpu_seconds_total%s %llu.%07llu\n", labels,
+        (unsigned long long)(li.QuadPart / 10000000), (unsigned long long)(li.QuadPart % 10000000));
+}
+#elif defined(HAVE_GETRUSAGE)
+static char *AddTime(char *p, const char *labels, const struct timeval &tv)
+{
+    return p + sprintf(p, "polyml_cpu_seconds_total%s %lu.%06lu\n", labels,
+        (unsigned long)tv.tv_sec, (unsigned long)tv.tv_usec);
+}
+#endif
+
+// Format the statistics.  Returns the length or zero if they are not available.
+static size_t FormatStatistics(char *buff)
+{
+    polystatistics stats;
+    char *p = buff;
+    if (! globalStats.getLocalsStatistics(&stats))
+        return 0;
+
+    p = AddMetric(p, "threads", "gauge", "Total number of ML threads.");
+    p = AddValue(p, "threads", "", stats.psCounters[PSC_THREADS]);
+    p = AddMetric(p, "threads_state", "gauge", "Number of ML threads running ML code or waiting.");
+    p = AddValue(p, "threads_state", "{state=\"ml\"}", stats.psCounters[PSC_THREADS_IN_ML]);
+    p = AddValue(p, "threads_state", "{state=\"io\"}", stats.psCounters[PSC_THREADS_WAIT_IO]);
+    p = AddValue(p, "threads_state", "{state=\"mutex\"}", stats.psCounters[PSC_THREADS_WAIT_MUTEX]);
+    p = AddValue(p, "threads_state", "{state=\"condvar\"}", stats.psCounters[PSC_THREADS_WAIT_CONDVAR]);
+    p = AddValue(p, "threads_state", "{state=\"signal\"}", stats.psCounters[PSC_THREADS_WAIT_SIGNAL]);
+
+    p = AddMetric(p, "gc_total", "counter", "Number of garbage collections.");
+    p = AddValue(p, "gc_total", "{kind=\"full\"}", stats.psCounters[PSC_GC_FULLGC]);
+    p = AddValue(p, "gc_total", "{kind=\"partial\"}", stats.psCounters[PSC_GC_PARTIALGC]);
+
+    p = AddMetric(p, "heap_size_bytes", "gauge", "Total size of the local heap.");
+    p = AddValue(p, "heap_size_bytes", "", stats.psSizes[PSS_TOTAL_HEAP]);
+    p = AddMetric(p, "heap_free_after_gc_bytes", "gauge", "Space free after the last GC.");
+    p = AddValue(p, "heap_free_after_gc_bytes", "", stats.psSizes[PSS_AFTER_LAST_GC]);
+    p = AddMetric(p, "heap_free_after_full_gc_bytes", "gauge", "Space free after the last full GC.");
+    p = AddValue(p, "heap_free_after_full_gc_bytes", "", stats.psSizes[PSS_AFTER_LAST_FULLGC]);
+    p = AddMetric(p, "allocation_size_bytes", "gauge", "Size of the allocation area.");
+    p = AddValue(p, "allocation_size_bytes", "", stats.psSizes[PSS_ALLOCATION]);
+    p = AddMetric(p, "allocation_free_bytes", "gauge", "Space available in the allocation area.");
+    p = AddValue(p, "allocation_free_bytes", "", stats.psSizes[PSS_ALLOCATION_FREE]);
+
+#if (defined(HAVE_WINDOWS_H) || defined(HAVE_GETRUSAGE))
+    p = AddMetric(p, "cpu_seconds_total", "counter", "CPU time inside and outside the GC.");
+    p = AddTime(p, "{gc=\"false\",mode=\"user\"}", stats.psTimers[PST_NONGC_UTIME]);
+    p = AddTime(p, "{gc=\"false\",mode=\"system\"}", stats.psTimers[PST_NONGC_STIME]);
+    p = AddTime(p, "{gc=\"true\",mode=\"user\"}", stats.psTimers[PST_GC_UTIME]);
+    p = AddTime(p, "{gc=\"true\",mode=\"system\"}", stats.psTimers[PST_GC_STIME]);
+#endif
+
+    p = AddMetric(p, "user_counter", "gauge", "Counters set by the application.");
+    for (unsigned i = 0; i < N_PS_USER; i++)
+        p += sprintf(p, "polyml_user_counter{index=\"%u\"} %d\n", i, stats.psUser[i]);
+
+    return p - buff;
+}
+
+// Read the request, which we ignore, and send the reply.
+void StatsServer::ReplyToClient(statSocket client)
+{
+    char request[1024];
+    // Wait briefly for the request so that the client doesn't see the
+    // connection reset because there is unread data.
+    fd_set readFds;
+    FD_ZERO(&readFds);
+    FD_SET(client, &readFds);
+    struct timeval timeout = { 1, 0 };
+    if (select((int)client+1, &readFds, NULL, NULL, &timeout) > 0)
+        (void)recv(client, request, sizeof(request), 0);
+
+    char *reply = (char*)malloc(STATS_REPLY_SIZE);
+    if (reply == 0) return;
+    static const char header[] =
+        "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+    // If the statistics could not be set up send an error rather than an empty
+    // page, which would look like a process with nothing to report.
+    static const char unavailable[] =
+        "HTTP/1.0 503 Service Unavailable\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n"
+        "Poly/ML statistics are not available.\n";
+    strcpy(reply, header);
+    size_t length = FormatStatistics(reply + sizeof(header) - 1);
+    if (length == 0)
+    {
+        strcpy(reply, unavailable);
+        length = sizeof(unavailable) - 1;
+    }
+    else length += sizeof(header) - 1;
+    const char *p = reply;
+    while (length != 0)
+    {
+        int sent = send(client, p, (int)length, MSG_NOSIGNAL);
+        if (sent <= 0) break;
+        p += sent;
+        length -= sent;
+    }
+    free(reply);
+}
+
+void StatsServer::ServerLoop(void)
+{
+    while (! terminate)
+    {
+        fd_set readFds;
+        FD_ZERO(&readFds);
+        FD_SET(listenSocket, &readFds);
+        // Check the terminate flag at least once a second.
+        struct timeval timeout = { 1, 0 };
+        if (select((int)listenSocket+1, &readFds, NULL, NULL, &timeout) <= 0)
+            continue;
+        if (terminate) break;
+        statSocket client = accept(listenSocket, NULL, NULL);
+        if (client == BAD_SOCKET)
+            continue;
+        ReplyToClient(client);
+        closeSocket(client);
+    }
+}
+
+#if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
+static void *StatsServerThread(void *parameter)
+{
+    ((StatsServer*)parameter)->ServerLoop();
+    return 0;
+}
+#elif defined(HAVE_WINDOWS_H)
+static DWORD WINAPI StatsServerThread(void *parameter)
+{
+    ((StatsServer*)parameter)->ServerLoop();
+    return 0;
+}
+#endif
+
+void StatsServer::Start(void)
+{
+    if (address == 0) return;
+    bool isPort = address[0] != 0 && strspn(address, "0123456789") == strlen(address);
+    if (isPort)
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenSocket == BAD_SOCKET) return;
+        int on = 1;
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on));
+        if (bind(listenSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            Log("Statistics server: unable to bind to port %s\n", address);
+            closeSocket(listenSocket);
+            listenSocket = BAD_SOCKET;
+            return;
+        }
+    }
+    else
+    {
+#ifdef HAVE_SYS_UN_H
+        struct sockaddr_un addr;
+        if (strlen(address) >= sizeof(addr.sun_path))
+        {
+            Log("Statistics server: socket path %s is too long\n", address);
+            return;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address);
+        listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenSocket == BAD_SOCKET) return;
+        if (bind(listenSocket, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            Log("Statistics server: unable to bind to %s\n", address);
+            closeSocket(listenSocket);
+            listenSocket = BAD_SOCKET;
+            return;
+        }
+#else
+        Log("Statistics server: Unix domain sockets are not supported\n");
+        return;
+#endif
+    }
+    if (listen(listenSocket, 5) != 0)
+    {
+        closeSocket(listenSocket);
+        listenSocket = BAD_SOCKET;
+        return;
+    }
+#if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
+    running = pthread_create(&threadId, NULL, StatsServerThread, this) == 0;
+#elif defined(HAVE_WINDOWS_H)
+    DWORD dwThrdId; // Have to provide this although we don't use it.
+    threadHandle = CreateThread(NULL, 0, StatsServerThread, this, 0, &dwThrdId);
+    running = threadHandle != NULL;
+#endif
+    if (! running)
+        Log("Statistics server: unable to create thread\n");
+}
+
+void StatsServer::Stop(void)
+{
+    if (listenSocket == BAD_SOCKET) return;
+    terminate = true;
+    // Shutting down the socket wakes up the select in the server thread.
+    shutdown(listenSocket, 2);
+    if (running)
+    {
+#if ((!defined(_WIN32) || defined(__CYGWIN__)) && defined(HAVE_PTHREAD_H))
+        void *result;
+        pthread_join(threadId, &result);
+#elif defined(HAVE_WINDOWS_H)
+        WaitForSingleObject(threadHandle, 10000);
+        CloseHandle(threadHandle);
+#endif
+        running = false;
+    }
+    closeSocket(listenSocket);
+    listenSocket = BAD_SOCKET;
+#ifdef HAVE_SYS_UN_H
+    if (strspn(address, "0123456789") != strlen(address))
+        unlink(address);
+#endif
+}
@@ -0,0 +1,30 @@
+/*
+    Title:  statserver.h - Serve the statistics in text exposition format
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+#ifndef STATSERVER_H_INCLUDED
+#define STATSERVER_H_INCLUDED
+
+// Set by the --statsserver option.  If the address is a number the
+// statistics are served on that TCP port on the loopback interface,
+// otherwise it is the path of a Unix domain socket.
+extern void SetStatsServerAddress(const char *address);
+
+#endif
@@ -108,6 +108,7 @@
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "processes.h"
 #include "heapsizing.h"
 
@@ -156,6 +157,7 @@ static PLock timeLock("Timing");
 Handle timing_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 0: /* Get ticks per microsecond. */
@@ -127,6 +127,7 @@
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 
 #define STREAMID(x) (DEREFSTREAMHANDLE(x)->streamNo)
 
@@ -383,6 +384,7 @@ static void restoreSignals(void)
 Handle OS_spec_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_long(taskData, DEREFWORDHANDLE(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 0: /* Return our OS type.  Not in any structure. */
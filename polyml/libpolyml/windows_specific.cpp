@@ -71,6 +71,7 @@
 #include "polystring.h"
 #include "save_vec.h"
 #include "rts_module.h"
+#include "rtstrace.h"
 #include "machine_dep.h"
 
 #define STREAMID(x) (DEREFSTREAMHANDLE(x)->streamNo)
@@ -299,6 +300,7 @@ HKEY hkPredefinedKeyTab[] =
 Handle OS_spec_dispatch_c(TaskData *taskData, Handle args, Handle code)
 {
     int c = get_C_int(taskData, DEREFWORD(code));
+    RtsTraceSubCode(taskData, c);
     switch (c)
     {
     case 0: /* Return our OS type.  Not in any structure. */
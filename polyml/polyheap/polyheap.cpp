@@ -0,0 +1,462 @@
+/*
+    Title:  polyheap.cpp - Analyse a heap dump
+
+    Copyright (c) 2026
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+/*
+This reads a file written by PolyML.heapDump and prints a census of the
+objects by kind followed by the objects that retain the most memory.  The
+retained size of an object is the total size of the objects that would
+become unreachable if it were removed, i.e. the objects it dominates.  The
+dominator tree is computed with the Lengauer-Tarjan algorithm from a
+notional root whose successors are the RTS roots, including the thread
+stacks, and all the objects in the permanent areas.
+
+It is independent of the rest of Poly/ML and can be built with e.g.
+    c++ -O2 -o polyheap polyheap.cpp
+Usage:
+    polyheap [-n count] dumpfile
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../libpolyml/heapdump.h"
+
+typedef unsigned long long uint64;
+typedef unsigned nodeId;
+
+#define NO_NODE ((nodeId)-1)
+
+// Flags from the top byte of the length word.
+#define F_BYTE_OBJ      0x01
+#define F_CODE_OBJ      0x02
+#define F_MUTABLE_BIT   0x40
+
+static unsigned char *dumpData, *dumpEnd, *dumpPtr;
+
+static uint64 *nodeAddr;        // Word address of each object
+static uint64 *nodeLength;      // Length in words
+static unsigned char *nodeFlags;
+static unsigned char *nodeSpace; // HEAPDUMP_SPACE_LOCAL or HEAPDUMP_SPACE_PERMANENT
+static uint64 *edgeStart;       // Index into edges of the first edge of each node
+static uint64 *edges;           // Addresses and then, once resolved, nodeIds.
+static uint64 nNodes, nEdges, nRoots;
+static uint64 *roots;
+static unsigned wordSize;
+
+static void fail(const char *msg)
+{
+    fprintf(stderr, "polyheap: %s\n", msg);
+    exit(1);
+}
+
+static void *allocate(uint64 n, size_t size)
+{
+    void *p = calloc((size_t)n + 1, size);
+    if (p == 0) fail("insufficient memory");
+    return p;
+}
+
+static uint64 readNumber(void)
+{
+    uint64 result = 0;
+    unsigned shift = 0;
+    while (true)
+    {
+        if (dumpPtr >= dumpEnd) fail("unexpected end of file");
+        unsigned char b = *dumpPtr++;
+        result |= (uint64)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return result;
+        shift += 7;
+    }
+}
+
+// Read the file.  The first pass counts the objects, edges and roots so
+// the arrays can be allocated; the second fills them in.
+static void readDump(const char *fileName)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (f == 0) fail("cannot open dump file");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    dumpData = (unsigned char*)allocate(size, 1);
+    if (fread(dumpData, 1, size, f) != (size_t)size) fail("unable to read dump file");
+    fclose(f);
+    dumpEnd = dumpData + size;
+
+    size_t magicLen = strlen(HEAPDUMP_MAGIC);
+    if ((size_t)size < magicLen || memcmp(dumpData, HEAPDUMP_MAGIC, magicLen) != 0)
+        fail("not a heap dump");
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        dumpPtr = dumpData + magicLen;
+        if (readNumber() != HEAPDUMP_VERSION) fail("unsupported version");
+        wordSize = (unsigned)readNumber();
+        // Node zero is the notional root.
+        uint64 node = 1, edge = 0, root = 0;
+        unsigned space = HEAPDUMP_SPACE_LOCAL;
+        bool finished = false;
+        while (! finished)
+        {
+            if (dumpPtr >= dumpEnd) fail("unexpected end of file");
+            switch (*dumpPtr++)
+            {
+            case 'S':
+                space = (unsigned)readNumber();
+                (void)readNumber(); (void)readNumber(); (void)readNumber();
+                break;
+            case 'O':
+                {
+                    uint64 addr = readNumber(), length = readNumber();
+                    unsigned flags = (unsigned)readNumber();
+                    uint64 count = readNumber();
+                    if (pass == 1)
+                    {
+                        nodeAddr[node] = addr;
+                        nodeLength[node] = length;
+                        nodeFlags[node] = (unsigned char)flags;
+                        nodeSpace[node] = (unsigned char)space;
+                        edgeStart[node] = edge;
+                    }
+                    for (uint64 i = 0; i < count; i++)
+                    {
+                        uint64 target = readNumber();
+                        if (pass == 1) edges[edge] = target;
+                        edge++;
+                    }
+                    node++;
+                    break;
+                }
+            case 'R':
+                {
+                    uint64 target = readNumber();
+                    if (pass == 1) roots[root] = target;
+                    root++;
+                    break;
+                }
+            case 'E':
+                finished = true;
+                break;
+            default:
+                fail("bad record in dump file");
+            }
+        }
+        if (pass == 0)
+        {
+            nNodes = node; nEdges = edge; nRoots = root;
+            nodeAddr = (uint64*)allocate(nNodes, sizeof(uint64));
+            nodeLength = (uint64*)allocate(nNodes, sizeof(uint64));
+            nodeFlags = (unsigned char*)allocate(nNodes, 1);
+            nodeSpace = (unsigned char*)allocate(nNodes, 1);
+            edgeStart = (uint64*)allocate(nNodes+1, sizeof(uint64));
+            edges = (uint64*)allocate(nEdges, sizeof(uint64));
+            roots = (uint64*)allocate(nRoots, sizeof(uint64));
+        }
+        else edgeStart[nNodes] = nEdges;
+    }
+    free(dumpData);
+}
+
+// Convert addresses to node numbers.
+static nodeId *sortedNodes;
+
+static int compareAddr(const void *a, const void *b)
+{
+    uint64 x = nodeAddr[*(const nodeId*)a], y = nodeAddr[*(const nodeId*)b];
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static nodeId findNode(uint64 addr)
+{
+    uint64 lo = 0, hi = nNodes-1; // Excludes node zero
+    while (lo < hi)
+    {
+        uint64 mid = (lo + hi) / 2;
+        uint64 a = nodeAddr[sortedNodes[mid]];
+        if (a == addr) return sortedNodes[mid];
+        if (a < addr) lo = mid+1; else hi = mid;
+    }
+    return NO_NODE;
+}
+
+static void resolveAddresses(void)
+{
+    sortedNodes = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    for (uint64 i = 1; i < nNodes; i++) sortedNodes[i-1] = (nodeId)i;
+    qsort(sortedNodes, (size_t)(nNodes-1), sizeof(nodeId), compareAddr);
+    for (uint64 e = 0; e < nEdges; e++)
+        edges[e] = findNode(edges[e]);
+    for (uint64 r = 0; r < nRoots; r++)
+        roots[r] = findNode(roots[r]);
+    free(sortedNodes);
+}
+
+// The successors of node zero are the roots and the permanent objects.
+// Returns the number of successors and the i'th one.
+static uint64 successorCount(nodeId n)
+{
+    if (n == 0) return nRoots + nNodes - 1;
+    return edgeStart[n+1] - edgeStart[n];
+}
+
+static nodeId successor(nodeId n, uint64 i)
+{
+    if (n == 0)
+    {
+        if (i < nRoots) return (nodeId)roots[i];
+        nodeId p = (nodeId)(i - nRoots + 1);
+        return nodeSpace[p] == HEAPDUMP_SPACE_PERMANENT ? p : NO_NODE;
+    }
+    return (nodeId)edges[edgeStart[n] + i];
+}
+
+// Lengauer-Tarjan.  dfNum is zero for nodes that have not been reached.
+static nodeId *dfNum, *vertex, *parent, *semi, *ancestor, *label, *idom;
+static nodeId nReached;
+
+static void depthFirstSearch(void)
+{
+    nodeId *stack = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    uint64 *next = (uint64*)allocate(nNodes, sizeof(uint64));
+    uint64 sp = 0;
+    stack[sp++] = 0;
+    dfNum[0] = ++nReached;
+    vertex[nReached] = 0;
+    parent[0] = NO_NODE;
+    while (sp != 0)
+    {
+        nodeId n = stack[sp-1];
+        if (next[n] == successorCount(n)) { sp--; continue; }
+        nodeId s = successor(n, next[n]++);
+        if (s == NO_NODE || dfNum[s] != 0) continue;
+        dfNum[s] = ++nReached;
+        vertex[nReached] = s;
+        parent[s] = n;
+        stack[sp++] = s;
+    }
+    free(stack);
+    free(next);
+}
+
+// Find the node with the smallest semi-dominator on the path to the
+// root of the forest, compressing the path as we go.
+static nodeId evaluate(nodeId v)
+{
+    if (ancestor[v] == NO_NODE) return v;
+    // Collect the path then compress it from the top down.
+    static nodeId *path = 0;
+    if (path == 0) path = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    uint64 n = 0;
+    for (nodeId u = v; ancestor[ancestor[u]] != NO_NODE; u = ancestor[u])
+        path[n++] = u;
+    while (n != 0)
+    {
+        nodeId u = path[--n];
+        nodeId a = ancestor[u];
+        if (semi[label[a]] < semi[label[u]]) label[u] = label[a];
+        ancestor[u] = ancestor[a];
+    }
+    return label[v];
+}
+
+static void computeDominators(void)
+{
+    dfNum = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    vertex = (nodeId*)allocate(nNodes+1, sizeof(nodeId));
+    parent = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    semi = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    ancestor = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    label = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    idom = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    nodeId *bucketHead = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    nodeId *bucketNext = (nodeId*)allocate(nNodes, sizeof(nodeId));
+
+    depthFirstSearch();
+
+    // Build the predecessor lists for the reached nodes.
+    uint64 *predStart = (uint64*)allocate(nNodes+1, sizeof(uint64));
+    for (nodeId n = 0; n < nNodes; n++)
+    {
+        if (dfNum[n] == 0) continue;
+        for (uint64 i = 0; i < successorCount(n); i++)
+        {
+            nodeId s = successor(n, i);
+            if (s != NO_NODE) predStart[s+1]++;
+        }
+    }
+    for (uint64 n = 0; n < nNodes; n++) predStart[n+1] += predStart[n];
+    nodeId *preds = (nodeId*)allocate(predStart[nNodes], sizeof(nodeId));
+    uint64 *predFill = (uint64*)allocate(nNodes, sizeof(uint64));
+    for (nodeId n = 0; n < nNodes; n++)
+    {
+        if (dfNum[n] == 0) continue;
+        for (uint64 i = 0; i < successorCount(n); i++)
+        {
+            nodeId s = successor(n, i);
+            if (s != NO_NODE) preds[predStart[s] + predFill[s]++] = n;
+        }
+    }
+    free(predFill);
+
+    for (nodeId n = 0; n < nNodes; n++)
+    {
+        semi[n] = dfNum[n];
+        label[n] = n;
+        ancestor[n] = NO_NODE;
+        bucketHead[n] = NO_NODE;
+        idom[n] = NO_NODE;
+    }
+
+    for (nodeId i = nReached; i >= 2; i--)
+    {
+        nodeId w = vertex[i];
+        for (uint64 p = predStart[w]; p < predStart[w+1]; p++)
+        {
+            nodeId v = preds[p];
+            if (dfNum[v] == 0) continue;
+            nodeId u = evaluate(v);
+            if (semi[u] < semi[w]) semi[w] = semi[u];
+        }
+        nodeId s = vertex[semi[w]];
+        bucketNext[w] = bucketHead[s];
+        bucketHead[s] = w;
+        nodeId pw = parent[w];
+        ancestor[w] = pw; // Link
+        for (nodeId v = bucketHead[pw]; v != NO_NODE; v = bucketNext[v])
+        {
+            nodeId u = evaluate(v);
+            idom[v] = semi[u] < semi[v] ? u : pw;
+        }
+        bucketHead[pw] = NO_NODE;
+    }
+    for (nodeId i = 2; i <= nReached; i++)
+    {
+        nodeId w = vertex[i];
+        if (idom[w] != vertex[semi[w]]) idom[w] = idom[idom[w]];
+    }
+
+    free(preds); free(predStart); free(bucketHead); free(bucketNext);
+}
+
+static uint64 *retained;
+
+static int compareRetained(const void *a, const void *b)
+{
+    uint64 x = retained[*(const nodeId*)a], y = retained[*(const nodeId*)b];
+    return x > y ? -1 : x < y ? 1 : 0;
+}
+
+static const char *kindName(nodeId n)
+{
+    unsigned flags = nodeFlags[n];
+    bool isMutable = (flags & F_MUTABLE_BIT) != 0;
+    switch (flags & 3)
+    {
+    case F_BYTE_OBJ: return isMutable ? "mutable bytes" : "bytes";
+    case F_CODE_OBJ: return isMutable ? "mutable code" : "code";
+    default: return isMutable ? "mutable words" : "words";
+    }
+}
+
+static uint64 objectBytes(nodeId n) { return (nodeLength[n] + 1) * wordSize; }
+
+static void printCensus(void)
+{
+    const char *kinds[] = { "words", "mutable words", "bytes", "mutable bytes", "code", "mutable code" };
+    const unsigned nKinds = sizeof(kinds)/sizeof(kinds[0]);
+    uint64 counts[2][nKinds], sizes[2][nKinds], unreached = 0, unreachedBytes = 0;
+    memset(counts, 0, sizeof(counts));
+    memset(sizes, 0, sizeof(sizes));
+    for (nodeId n = 1; n < nNodes; n++)
+    {
+        const char *k = kindName(n);
+        for (unsigned i = 0; i < nKinds; i++)
+        {
+            if (strcmp(k, kinds[i]) == 0)
+            {
+                counts[nodeSpace[n]][i]++;
+                sizes[nodeSpace[n]][i] += objectBytes(n);
+            }
+        }
+        if (dfNum[n] == 0) { unreached++; unreachedBytes += objectBytes(n); }
+    }
+    printf("%-10s %-14s %12s %16s\n", "Space", "Kind", "Objects", "Bytes");
+    for (unsigned s = 0; s < 2; s++)
+        for (unsigned i = 0; i < nKinds; i++)
+            if (counts[s][i] != 0)
+                printf("%-10s %-14s %12llu %16llu\n", s == HEAPDUMP_SPACE_LOCAL ? "local" : "permanent",
+                    kinds[i], counts[s][i], sizes[s][i]);
+    printf("%llu objects (%llu bytes) not reachable from the roots\n\n", unreached, unreachedBytes);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned topCount = 20;
+    const char *fileName = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            topCount = (unsigned)atoi(argv[++i]);
+        else if (fileName == 0)
+            fileName = argv[i];
+        else fileName = 0, i = argc;
+    }
+    if (fileName == 0)
+    {
+        fprintf(stderr, "Usage: polyheap [-n count] dumpfile\n");
+        return 1;
+    }
+
+    readDump(fileName);
+    resolveAddresses();
+    computeDominators();
+
+    // Add the size of each object to its dominator, working up from the leaves.
+    retained = (uint64*)allocate(nNodes, sizeof(uint64));
+    for (nodeId n = 1; n < nNodes; n++) retained[n] = objectBytes(n);
+    for (nodeId i = nReached; i >= 2; i--)
+    {
+        nodeId w = vertex[i];
+        retained[idom[w]] += retained[w];
+    }
+
+    printCensus();
+
+    nodeId *order = (nodeId*)allocate(nNodes, sizeof(nodeId));
+    uint64 nOrder = 0;
+    for (nodeId n = 1; n < nNodes; n++)
+        if (dfNum[n] != 0) order[nOrder++] = n;
+    qsort(order, (size_t)nOrder, sizeof(nodeId), compareRetained);
+
+    printf("Total reachable: %llu bytes\n", retained[0]);
+    printf("%-16s %-14s %-9s %12s %16s  %s\n", "Address", "Kind", "Space", "Size", "Retained", "Dominator");
+    for (uint64 i = 0; i < nOrder && i < topCount; i++)
+    {
+        nodeId n = order[i];
+        printf("%016llx %-14s %-9s %12llu %16llu  ", nodeAddr[n] * wordSize, kindName(n),
+            nodeSpace[n] == HEAPDUMP_SPACE_LOCAL ? "local" : "permanent", objectBytes(n), retained[n]);
+        if (idom[n] == 0) printf("root\n");
+        else printf("%016llx\n", nodeAddr[idom[n]] * wordSize);
+    }
+    return 0;
+}